@@ -0,0 +1,73 @@
+/*
+ * File FCLayerBench.h
+ * Purpose: benchmark of FCLayer's forward/backward matrix products
+ */
+
+#ifndef FCLAYERBENCH_H
+#define FCLAYERBENCH_H
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <chrono>
+using namespace std;
+
+#include "sformat/fmt_lib.h"
+#include "tensor/xtensor_lib.h"
+#include "ann/annheader.h"
+
+/* bench_fc_tensordot:
+ *  one forward + backward of a Nin x Nout layer the way FCLayer used to
+ *  compute it: tensordot with transposed operands
+ */
+double bench_fc_tensordot(real_tensor& X, real_tensor& W, real_tensor& DY){
+    auto start = chrono::steady_clock::now();
+    unsigned long last_dim = X.shape().size() - 1;
+    real_tensor Y = xt::linalg::tensordot(X, xt::transpose(W), {last_dim}, {0});
+    real_tensor dW = xt::linalg::tensordot(xt::transpose(DY), X, {last_dim}, {0});
+    real_tensor dX = xt::linalg::tensordot(DY, W, {last_dim}, {0});
+    auto stop = chrono::steady_clock::now();
+    return chrono::duration<double>(stop - start).count();
+}
+
+/* bench_fc_layer:
+ *  one forward + backward through FCLayer (GEMM with transpose flags)
+ */
+double bench_fc_layer(FCLayer& layer, real_tensor& X, real_tensor& DY){
+    auto start = chrono::steady_clock::now();
+    real_tensor Y = layer.forward(X);
+    real_tensor dX = layer.backward(DY);
+    auto stop = chrono::steady_clock::now();
+    return chrono::duration<double>(stop - start).count();
+}
+
+/* bench_fc_gemm:
+ *  Nin = Nout = 2, 4, ..., max_n with a batch of batch_size samples;
+ *  report the best of a few runs of each path in ms and GFLOP/s
+ *  (3 products of 2*batch*Nin*Nout flops each).
+ */
+void bench_fc_gemm(int max_n=4096, int batch_size=64){
+    cout << fmt::format("gemm kernel: {:s}, threads: {:d}\n",
+            gemm_kernel(), gemm_get_num_threads());
+    cout << fmt::format("{:>6s}|{:>14s}|{:>14s}|{:>10s}|{:>10s}\n",
+            "N", "tensordot(ms)", "gemm(ms)", "GFLOP/s", "speedup");
+    for(int N = 2; N <= max_n; N *= 2){
+        FCLayer layer(N, N, false);
+        real_tensor W = xt::random::randn<real_t>({N, N});
+        layer.set_weights(W);
+        real_tensor X = xt::random::randn<real_t>({batch_size, N});
+        real_tensor DY = xt::random::randn<real_t>({batch_size, N});
+
+        double flops = 3*2.0*batch_size*N*N;
+        int nruns = flops < 1e8 ? 5 : 1;
+        double t_old = 1e30, t_new = 1e30;
+        for(int run = 0; run < nruns; run++){
+            t_old = min(t_old, bench_fc_tensordot(X, W, DY));
+            t_new = min(t_new, bench_fc_layer(layer, X, DY));
+        }
+        cout << fmt::format("{:>6d}|{:>14.3f}|{:>14.3f}|{:>10.2f}|{:>9.2f}x\n",
+                N, t_old*1e3, t_new*1e3, flops/t_new*1e-9, t_old/t_new);
+    }
+}
+
+#endif /* FCLAYERBENCH_H */
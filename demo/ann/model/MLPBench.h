@@ -0,0 +1,279 @@
+/*
+ * File MLPBench.h
+ * Purpose: throughput benchmarks for the MLP stack (training and inference)
+ */
+
+#ifndef MLPBENCH_H
+#define MLPBENCH_H
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <chrono>
+#include <thread>
+using namespace std;
+
+#include "sformat/fmt_lib.h"
+#include "ann/annheader.h"
+#include "loader/dataset.h"
+#include "loader/dataloader.h"
+#include "dataset/DSFactory.h"
+
+/* bench_mlp_throughput:
+ *  train the twoclasses_classification network (FC(2,50)-ReLU-FC(50,20)-
+ *  ReLU-FC(20,2)-Softmax) for "nepochs" epochs on the 2c-classification
+ *  dataset, then predict the test set "nepochs" times; report samples/s.
+ *  real_t is fixed at build time, so run it once from a default build and
+ *  once from a PRECISION=float32 build to compare both precisions.
+ *  + fused: build each FC+ReLU pair as one FCActLayer (as the modelzoo
+ *      does) instead of two layers
+ *  + loss_name: "SoftmaxCrossEntropy" (on logits) or "CrossEntropy"
+ */
+void bench_mlp_throughput(int nepochs=20, int batch_size=50, bool fused=true,
+                          string loss_name="SoftmaxCrossEntropy"){
+    xt::random::seed(42);
+    DSFactory factory("./config.txt");
+    xmap<string, Dataset<real_t, ulong>*>* pMap = factory.get_sparse_datasets_2cc();
+    Dataset<real_t, ulong>* train_ds = pMap->get("train_ds");
+    Dataset<real_t, ulong>* valid_ds = pMap->get("valid_ds");
+    Dataset<real_t, ulong>* test_ds = pMap->get("test_ds");
+    DataLoader<real_t, ulong> train_loader(train_ds, batch_size, true, false);
+    DataLoader<real_t, ulong> valid_loader(valid_ds, batch_size, false, false);
+    DataLoader<real_t, ulong> test_loader(test_ds, batch_size, false, false);
+
+    int nClasses = 2;
+    ILayer* layers[6];
+    int nlayers = 0;
+    if(fused){
+        layers[nlayers++] = new FCActLayer(2, 50, true, LayerType::RELU);
+        layers[nlayers++] = new FCActLayer(50, 20, true, LayerType::RELU);
+    }
+    else{
+        layers[nlayers++] = new FCLayer(2, 50, true);
+        layers[nlayers++] = new ReLU("", true);
+        layers[nlayers++] = new FCLayer(50, 20, true);
+        layers[nlayers++] = new ReLU("", true);
+    }
+    layers[nlayers++] = new FCLayer(20, nClasses, true);
+    layers[nlayers++] = new Softmax();
+    MLPClassifier model("./config.txt", "2c-classification", layers, nlayers);
+    SGD optim(2e-3);
+    ILossLayer* pLoss = create_loss_layer(loss_name);
+    ClassMetrics metrics(nClasses);
+    model.compile(&optim, pLoss, &metrics, batch_size);
+
+    auto start = chrono::steady_clock::now();
+    model.fit(&train_loader, &valid_loader, nepochs, 0);
+    auto stop = chrono::steady_clock::now();
+    double train_s = chrono::duration<double>(stop - start).count();
+
+    start = chrono::steady_clock::now();
+    for(int epoch = 0; epoch < nepochs; epoch++) model.predict(&test_loader, true);
+    stop = chrono::steady_clock::now();
+    double infer_s = chrono::duration<double>(stop - start).count();
+
+    cout << fmt::format("real_t: {} bytes, layers: {:s}, loss: {:s}\n",
+            sizeof(real_t), fused ? "fused" : "unfused", loss_name);
+    cout << fmt::format("{:<10s}|{:>10s}|{:>12s}|{:>14s}\n", "phase", "samples", "time (s)", "samples/s");
+    long ntrain = long(train_ds->len())*nepochs;
+    long ntest = long(test_ds->len())*nepochs;
+    cout << fmt::format("{:<10s}|{:>10d}|{:>12.3f}|{:>14.0f}\n", "train", ntrain, train_s, ntrain/train_s);
+    cout << fmt::format("{:<10s}|{:>10d}|{:>12.3f}|{:>14.0f}\n", "inference", ntest, infer_s, ntest/infer_s);
+    delete pLoss;
+    delete pMap;
+}
+
+/* bench_int8_inference:
+ *  train the modelzoo network (FCActLayer(2,50)-FCActLayer(50,20)-FC(20,n)-
+ *  Softmax) on the 2c- or 3c-classification dataset for "nepochs" epochs,
+ *  then evaluate the test set "nruns" times with the real weights and after
+ *  MLPClassifier::quantize (calibrated on the training set); reports the
+ *  metrics of both, their difference and the speedup of int8 inference.
+ *  + nclasses: 2 (2c-classification) or 3 (3c-classification)
+ */
+void bench_int8_inference(int nclasses=2, int nepochs=50, int batch_size=50, int nruns=50){
+    xt::random::seed(42);
+    DSFactory factory("./config.txt");
+    xmap<string, Dataset<real_t, ulong>*>* pMap = (nclasses == 3) ?
+            factory.get_sparse_datasets_3cc() : factory.get_sparse_datasets_2cc();
+    nclasses = (nclasses == 3) ? 3 : 2;
+    Dataset<real_t, ulong>* train_ds = pMap->get("train_ds");
+    Dataset<real_t, ulong>* valid_ds = pMap->get("valid_ds");
+    Dataset<real_t, ulong>* test_ds = pMap->get("test_ds");
+    DataLoader<real_t, ulong> train_loader(train_ds, batch_size, true, false);
+    DataLoader<real_t, ulong> valid_loader(valid_ds, batch_size, false, false);
+    DataLoader<real_t, ulong> test_loader(test_ds, batch_size, false, false);
+
+    ILayer* layers[] = {
+        new FCActLayer(2, 50, true, LayerType::RELU),
+        new FCActLayer(50, 20, true, LayerType::RELU),
+        new FCLayer(20, nclasses, true),
+        new Softmax()
+    };
+    string name = fmt::format("{:d}c-classification", nclasses);
+    MLPClassifier model("./config.txt", name, layers, sizeof(layers)/sizeof(ILayer*));
+    SGD optim(2e-3);
+    ILossLayer* pLoss = create_loss_layer("SoftmaxCrossEntropy");
+    ClassMetrics metrics(nclasses);
+    model.compile(&optim, pLoss, &metrics, batch_size);
+    model.fit(&train_loader, &valid_loader, nepochs, 0);
+
+    double_tensor results[2];
+    double infer_s[2];
+    for(int quantized = 0; quantized < 2; quantized++){
+        if(quantized) model.quantize(&train_loader);
+        auto start = chrono::steady_clock::now();
+        for(int run = 0; run < nruns; run++) results[quantized] = model.evaluate(&test_loader);
+        auto stop = chrono::steady_clock::now();
+        infer_s[quantized] = chrono::duration<double>(stop - start).count();
+    }
+
+    cout << fmt::format("{:s}: real_t: {} bytes, gemm_s8 kernel: {:s}\n",
+            name, sizeof(real_t), gemm_s8_kernel());
+    cout << fmt::format("{:<10s}|{:>10s}|{:>10s}|{:>10s}\n", "metric", "real", "int8", "delta");
+    const char* metric_names[] = {"accuracy", "prec-mac", "prec-wei", "rec-mac", "rec-wei", "f1-mac", "f1-wei"};
+    for(int idx = 0; idx < NUM_CLASS_METRICS; idx++){
+        double real_value = results[0](idx), int8_value = results[1](idx);
+        cout << fmt::format("{:<10s}|{:>10.4f}|{:>10.4f}|{:>+10.4f}\n",
+                metric_names[idx], real_value, int8_value, int8_value - real_value);
+    }
+    long ntest = long(test_ds->len())*nruns;
+    cout << fmt::format("{:<10s}|{:>10.0f}|{:>10.0f}|{:>9.2f}x (samples/s)\n", "inference",
+            ntest/infer_s[0], ntest/infer_s[1], infer_s[0]/infer_s[1]);
+    delete pLoss;
+    delete pMap;
+}
+
+/* scaled_3c_dataset:
+ *  the 3c-classification training set repeated "scale" times, with
+ *  N(0, 0.05^2) noise on the features of the copies; the caller owns it
+ */
+TensorDataset<real_t, ulong>* scaled_3c_dataset(Dataset<real_t, ulong>* train_ds, int scale){
+    int nsamples = train_ds->len();
+    unsigned long ntrain = (unsigned long)nsamples*scale;
+    real_tensor X = xt::zeros<real_t>({ntrain, 2ul});
+    xt::xarray<ulong> T = xt::zeros<ulong>({ntrain});
+    xt::xarray<int> indices = xt::arange<int>(nsamples);
+    for(int copy=0; copy < scale; copy++){
+        train_ds->getitems(indices.data(), nsamples, X.data() + (long)copy*nsamples*2, T.data() + (long)copy*nsamples);
+    }
+    X += 0.05*xt::random::randn<real_t>(X.shape());
+    return new TensorDataset<real_t, ulong>(X, T);
+}
+
+/* bench_data_parallel:
+ *  data-parallel training (MLPClassifier::set_num_replicas) on the
+ *  3c-classification training set scaled up "scale" times (scaled_3c_dataset),
+ *  with a wider network: FCActLayer(2,width)-FCActLayer(width,width)-
+ *  FC(width,3)-Softmax, SGD, batches of batch_size, nepochs epochs, from the
+ *  same initial weights for 1, 2, 4, ... replicas up to the hardware threads
+ *  (at least 4). Reports the training samples/s, the speedup over 1 replica
+ *  (where each gemm is split across the threads instead) and the test
+ *  accuracy, which must not depend on the replicas: the steps are the same
+ *  up to rounding.
+ */
+void bench_data_parallel(int scale=200, int nepochs=2, int batch_size=512, int width=256){
+    xt::random::seed(42);
+    DSFactory factory("./config.txt");
+    xmap<string, Dataset<real_t, ulong>*>* pMap = factory.get_sparse_datasets_3cc();
+    Dataset<real_t, ulong>* test_ds = pMap->get("test_ds");
+    TensorDataset<real_t, ulong>* big_ds = scaled_3c_dataset(pMap->get("train_ds"), scale);
+    DataLoader<real_t, ulong> test_loader(test_ds, 50, false, false);
+    long ntrain = big_ds->len();
+
+    int max_threads = max(1, (int)thread::hardware_concurrency());
+    cout << fmt::format("3c-classification x{:d}: {:d} samples, width {:d}, batch {:d}, hardware threads: {:d}\n",
+            scale, ntrain, width, batch_size, max_threads);
+    cout << fmt::format("{:>8s}|{:>12s}|{:>12s}|{:>9s}|{:>9s}\n", "replicas", "time (s)", "samples/s", "speedup", "accuracy");
+    double t_one = 0;
+    for(int nreplicas = 1; nreplicas <= max(4, max_threads); nreplicas *= 2){
+        xt::random::seed(7); //same weights and batches for every run
+        DataLoader<real_t, ulong> train_loader(big_ds, batch_size, true, false, 7);
+        ILayer* layers[] = {
+            new FCActLayer(2, width, true, LayerType::RELU),
+            new FCActLayer(width, width, true, LayerType::RELU),
+            new FCLayer(width, 3, true),
+            new Softmax()
+        };
+        MLPClassifier model("./config.txt", "3c-classification", layers, sizeof(layers)/sizeof(ILayer*));
+        model.set_num_replicas(nreplicas);
+        SGD optim(1e-3);
+        ILossLayer* pLoss = create_loss_layer("SoftmaxCrossEntropy");
+        ClassMetrics metrics(3);
+        model.compile(&optim, pLoss, &metrics, batch_size);
+
+        auto start = chrono::steady_clock::now();
+        model.fit(&train_loader, &test_loader, nepochs, 0);
+        auto stop = chrono::steady_clock::now();
+        double train_s = chrono::duration<double>(stop - start).count();
+        if(nreplicas == 1) t_one = train_s;
+        double accuracy = model.evaluate(&test_loader)(ulong(ACCURACY));
+        cout << fmt::format("{:>8d}|{:>12.3f}|{:>12.0f}|{:>8.2f}x|{:>9.4f}\n", nreplicas, train_s,
+                ntrain*nepochs/train_s, t_one/train_s, accuracy);
+        delete pLoss;
+    }
+    delete big_ds;
+    delete pMap;
+}
+
+/* bench_hogwild:
+ *  IModel::fit_async (Hogwild) against fit on the scaled-up 3c dataset
+ *  (scaled_3c_dataset), network FCActLayer(2,width)-FCActLayer(width,width)-
+ *  FC(width,3)-Softmax, SGD(lr), small batches of batch_size. fit, then
+ *  fit_async with 1, 2, 4, ... threads up to the hardware threads (at least
+ *  4), from the same initial weights; each trains one epoch at a time for
+ *  nepochs epochs. Reports the training samples/s, the speedup over fit and
+ *  the test accuracy after each epoch (convergence).
+ */
+void bench_hogwild(int scale=100, int nepochs=3, int batch_size=32, int width=64, double lr=1e-2){
+    xt::random::seed(42);
+    DSFactory factory("./config.txt");
+    xmap<string, Dataset<real_t, ulong>*>* pMap = factory.get_sparse_datasets_3cc();
+    Dataset<real_t, ulong>* test_ds = pMap->get("test_ds");
+    TensorDataset<real_t, ulong>* big_ds = scaled_3c_dataset(pMap->get("train_ds"), scale);
+    DataLoader<real_t, ulong> test_loader(test_ds, 50, false, false);
+    long ntrain = big_ds->len();
+
+    int max_threads = max(1, (int)thread::hardware_concurrency());
+    cout << fmt::format("3c-classification x{:d}: {:d} samples, width {:d}, batch {:d}, lr {:g}, hardware threads: {:d}\n",
+            scale, ntrain, width, batch_size, lr, max_threads);
+    string header = fmt::format("{:<10s}|{:>8s}|{:>10s}|{:>12s}|{:>9s}|", "mode", "threads", "time (s)", "samples/s", "speedup");
+    for(int epoch = 1; epoch <= nepochs; epoch++) header += fmt::format("{:>8s}", fmt::format("acc@{:d}", epoch));
+    cout << header << endl;
+    double t_sync = 0;
+    for(int nthreads = 0; nthreads <= max(4, max_threads); nthreads = max(1, 2*nthreads)){
+        xt::random::seed(7); //same initial weights for every run
+        DataLoader<real_t, ulong> train_loader(big_ds, batch_size, true, false, 7);
+        ILayer* layers[] = {
+            new FCActLayer(2, width, true, LayerType::RELU),
+            new FCActLayer(width, width, true, LayerType::RELU),
+            new FCLayer(width, 3, true),
+            new Softmax()
+        };
+        MLPClassifier model("./config.txt", "3c-classification", layers, sizeof(layers)/sizeof(ILayer*));
+        SGD optim(lr);
+        ILossLayer* pLoss = create_loss_layer("SoftmaxCrossEntropy");
+        ClassMetrics metrics(3);
+        model.compile(&optim, pLoss, &metrics, batch_size);
+
+        double train_s = 0;
+        string accuracies;
+        for(int epoch = 1; epoch <= nepochs; epoch++){
+            auto start = chrono::steady_clock::now();
+            //nthreads == 0: the synchronous reference
+            if(nthreads == 0) model.fit(&train_loader, &test_loader, 1, 0);
+            else model.fit_async(&train_loader, &test_loader, 1, nthreads, 0);
+            auto stop = chrono::steady_clock::now();
+            train_s += chrono::duration<double>(stop - start).count();
+            accuracies += fmt::format("{:>8.4f}", model.evaluate(&test_loader)(ulong(ACCURACY)));
+        }
+        if(nthreads == 0) t_sync = train_s;
+        cout << fmt::format("{:<10s}|{:>8d}|{:>10.3f}|{:>12.0f}|{:>8.2f}x|", (nthreads == 0) ? "fit" : "fit_async",
+                max(1, nthreads), train_s, ntrain*nepochs/train_s, t_sync/train_s) << accuracies << endl;
+        delete pLoss;
+    }
+    delete big_ds;
+    delete pMap;
+}
+
+#endif /* MLPBENCH_H */
@@ -0,0 +1,140 @@
+/*
+ * File OptimizerBench.h
+ * Purpose: memory bandwidth of the optimizer steps (vaxpy, adagrad_update,
+ *          adam_update) against a plain copy, and their scaling with threads
+ */
+
+#ifndef OPTIMIZERBENCH_H
+#define OPTIMIZERBENCH_H
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <chrono>
+#include <cstring>
+#include <thread>
+using namespace std;
+
+#include "sformat/fmt_lib.h"
+#include "tensor/xtensor_lib.h"
+#include "tensor/VMathBench.h"
+#include "optim/ParamBuffer.h"
+#include "optim/SGD.h"
+#include "optim/Adagrad.h"
+#include "optim/Adam.h"
+
+/* bench_optimizer_step:
+ *  one tensor of n values in a ParamBuffer, n = 1e4 .. max_n; the time of
+ *  one IOptimizer::step and the bandwidth it reaches (values read + written
+ *  per step: SGD 3n, Adagrad 5n, Adam 7n), next to
+ *  + copy: memcpy of n values (2n moved), the memory-bound reference
+ *  + adam(xt): the three xtensor expressions AdamParamGroup::step evaluated
+ *      before adam_update (same 7n counted, although they move more)
+ *  Past the last-level cache, the fused steps should run at about the copy's
+ *  bandwidth ("copy" column: ratio to it).
+ */
+void bench_optimizer_step(long max_n=10000000){
+    cout << fmt::format("vmath kernel: {:s}, threads: {:d}, real_t: {:d} bytes\n",
+            vmath_kernel(), gemm_get_num_threads(), (int)sizeof(real_t));
+    cout << fmt::format("{:<10s}|{:>9s}|{:>11s}|{:>9s}|{:>7s}\n",
+            "step", "n", "time(ms)", "GB/s", "copy");
+    for(long n = 10000; n <= max_n; n *= 10){
+        unsigned long un = n;
+        int nruns = n < 1000000 ? 50 : 5;
+        auto gbps = [&](double values, double ms){ return values*sizeof(real_t)/(ms*1e6); };
+
+        real_tensor X = xt::random::rand<real_t>({un});
+        real_tensor Y = xt::zeros<real_t>({un});
+        double t_copy = best_ms(nruns, [&](){ memcpy(Y.data(), X.data(), n*sizeof(real_t)); });
+        double copy_gbps = gbps(2.0*n, t_copy);
+        cout << fmt::format("{:<10s}|{:>9d}|{:>11.3f}|{:>9.2f}|{:>6.2f}x\n",
+                "copy", n, t_copy, copy_gbps, 1.0);
+
+        const char* names[] = {"sgd", "adagrad", "adam"};
+        double traffic[] = {3.0*n, 5.0*n, 7.0*n};
+        for(int kind = 0; kind < 3; kind++){
+            IOptimizer* pOptim;
+            if(kind == 0) pOptim = new SGD(1e-3);
+            else if(kind == 1) pOptim = new Adagrad(1e-3);
+            else pOptim = new Adam(1e-3);
+            real_tensor store = xt::zeros<real_t>({2*un});
+            real_view W = make_view(store.data(), {un});
+            real_view dW = make_view(store.data() + n, {un});
+            ParamBuffer buffer;
+            pOptim->bind(&buffer);
+            pOptim->create_group("W")->register_param("W", &W, &dW);
+            buffer.allocate();
+            W = xt::random::randn<real_t>({un});
+            dW = 1e-2*xt::random::randn<real_t>({un});
+            pOptim->step(); //first step: allocates the states
+            double t = best_ms(nruns, [&](){ pOptim->step(); });
+            double bw = gbps(traffic[kind], t);
+            cout << fmt::format("{:<10s}|{:>9d}|{:>11.3f}|{:>9.2f}|{:>6.2f}x\n",
+                    names[kind], n, t, bw, bw/copy_gbps);
+            delete pOptim;
+        }
+
+        real_tensor P = xt::random::randn<real_t>({un});
+        real_tensor G = 1e-2*xt::random::randn<real_t>({un});
+        real_tensor M = xt::zeros<real_t>({un}), V = xt::zeros<real_t>({un});
+        double beta1 = 0.9, beta2 = 0.999, lr_t = 1e-3;
+        double t_xt = best_ms(nruns, [&](){
+            M = beta1*M + (1 - beta1)*G;
+            V = beta2*V + (1 - beta2)*G*G;
+            P -= lr_t*M/(xt::sqrt(V) + 1e-8);
+        });
+        double bw = gbps(traffic[2], t_xt);
+        cout << fmt::format("{:<10s}|{:>9d}|{:>11.3f}|{:>9.2f}|{:>6.2f}x\n",
+                "adam(xt)", n, t_xt, bw, bw/copy_gbps);
+    }
+}
+
+/* bench_optimizer_threads:
+ *  the learnable tensors of a wide MLP (nlayers FC layers of width x width,
+ *  with biases: one group each) in a ParamBuffer; the time of zero_grad and
+ *  of an Adam step for 1 .. hardware threads (gemm_set_num_threads) and the
+ *  speedup against 1 thread.
+ */
+void bench_optimizer_threads(int width=1024, int nlayers=4){
+    unsigned long uw = width;
+    XArrayList<real_tensor*> stores;
+    XArrayList<real_view*> views;
+    ParamBuffer buffer;
+    Adam optim(1e-3);
+    optim.bind(&buffer);
+    for(int layer = 0; layer < nlayers; layer++){
+        real_tensor* pStore = new real_tensor(xt::zeros<real_t>({2*(uw*uw + uw)}));
+        real_t* data = pStore->data();
+        real_view* pW = new real_view(make_view(data, {uw, uw}));
+        real_view* pb = new real_view(make_view(data + uw*uw, {uw}));
+        real_view* pdW = new real_view(make_view(data + uw*uw + uw, {uw, uw}));
+        real_view* pdb = new real_view(make_view(data + 2*uw*uw + uw, {uw}));
+        IParamGroup* pGroup = optim.create_group(fmt::format("FC_{:d}", layer));
+        pGroup->register_param("weights", pW, pdW);
+        pGroup->register_param("bias", pb, pdb);
+        stores.add(pStore);
+        views.add(pW); views.add(pb); views.add(pdW); views.add(pdb);
+    }
+    buffer.allocate();
+    for(unsigned long long i = 0; i < buffer.size(); i++) buffer.grads()[i] = 1e-2*((i%7) - 3.0);
+    optim.step(); //allocates the moments
+
+    int max_threads = max(1, (int)thread::hardware_concurrency());
+    cout << fmt::format("{:d} layers of {:d} x {:d}: {:d} values; hardware threads: {:d}\n",
+            nlayers, width, width, (long)buffer.size(), max_threads);
+    cout << fmt::format("{:>8s}|{:>14s}|{:>11s}|{:>9s}\n", "threads", "zero_grad(ms)", "step(ms)", "speedup");
+    double t_one = 0;
+    for(int nthreads = 1; ; nthreads = min(2*nthreads, max_threads)){
+        gemm_set_num_threads(nthreads);
+        double t_zero = best_ms(10, [&](){ optim.zero_grad(); });
+        double t_step = best_ms(10, [&](){ optim.step(); });
+        if(nthreads == 1) t_one = t_step;
+        cout << fmt::format("{:>8d}|{:>14.3f}|{:>11.3f}|{:>8.2f}x\n", nthreads, t_zero, t_step, t_one/t_step);
+        if(nthreads == max_threads) break;
+    }
+    gemm_set_num_threads(0);
+    for(auto pView: views) delete pView;
+    for(auto pStore: stores) delete pStore;
+}
+
+#endif /* OPTIMIZERBENCH_H */
@@ -0,0 +1,125 @@
+/*
+ * File DataLoaderBench.h
+ * Purpose: benchmarks for DataLoader (prefetching workers, batch access)
+ */
+
+#ifndef DATALOADERBENCH_H
+#define DATALOADERBENCH_H
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <chrono>
+#include <thread>
+using namespace std;
+
+#include "sformat/fmt_lib.h"
+#include "tensor/xtensor/xpad.hpp"
+#include "ann/annheader.h"
+#include "loader/dataset.h"
+#include "loader/dataloader.h"
+
+/* bench_scaled_dataset:
+ *  load a table (x, y, target) from npy_file, repeat its rows "scale" times,
+ *  then normalize the features and one-hot encode the target.
+ */
+TensorDataset<real_t, real_t>* bench_scaled_dataset(string npy_file, int nclasses, int scale){
+    xt::xarray<double> table = xt::load_npy<double>(npy_file);
+    table = xt::tile(table, {scale, 1});
+
+    xt::xarray<double> mu, sigma;
+    estimate_params(xt::view(table, xt::all(), xt::range(0, 2)), mu, sigma);
+    real_tensor X = normalize(xt::view(table, xt::all(), xt::range(0, 2)), mu, sigma);
+    xt::xarray<double> t = xt::view(table, xt::all(), -1);
+    real_tensor T = onehot_enc(xt::cast<unsigned long>(t), nclasses);
+    return new TensorDataset<real_t, real_t>(X, T);
+}
+
+/* bench_epoch_time:
+ *  build a DataLoader with the given number of workers and train one epoch
+ *  of a small MLP on it; return the wall-time in seconds, loader
+ *  construction included (the eager loader copies everything there).
+ */
+double bench_epoch_time(TensorDataset<real_t, real_t>* pTrain, TensorDataset<real_t, real_t>* pValid,
+        int nclasses, int batch_size, int num_workers){
+    ILayer* layers[] = {
+        new FCLayer(2, 50, true),
+        new ReLU(),
+        new FCLayer(50, 20, true),
+        new ReLU(),
+        new FCLayer(20, nclasses, true),
+        new Softmax()
+    };
+    MLPClassifier model("./config.txt", "bench", layers, sizeof(layers)/sizeof(ILayer*));
+    SGD optim(2e-3);
+    CrossEntropy loss;
+    ClassMetrics metrics(nclasses);
+    model.compile(&optim, &loss, &metrics);
+    DataLoader<real_t, real_t> valid_loader(pValid, batch_size, false, false, -1, true);
+
+    auto start = chrono::steady_clock::now();
+    DataLoader<real_t, real_t> train_loader(pTrain, batch_size, true, false, 7, false, num_workers, 2);
+    model.fit(&train_loader, &valid_loader, 1, 0);
+    auto stop = chrono::steady_clock::now();
+    return chrono::duration<double>(stop - start).count();
+}
+
+void bench_dataloader_prefetch(int scale=100, int batch_size=50){
+    int ncores = thread::hardware_concurrency();
+    if(ncores < 2) ncores = 2;
+    int worker_counts[] = {0, 1, ncores};
+
+    struct { string name, train_file, valid_file; int nclasses; } tasks[] = {
+        {"2c-classification", "datasets/2c-classification/2c_train.npy", "datasets/2c-classification/2c_valid.npy", 2},
+        {"3c-classification", "datasets/3c-classification/3c_train.npy", "datasets/3c-classification/3c_valid.npy", 3}
+    };
+
+    cout << fmt::format("{:<20s}|{:>10s}|{:>8s}|{:>12s}\n", "dataset", "samples", "workers", "epoch (s)");
+    for(auto& task: tasks){
+        TensorDataset<real_t, real_t>* pTrain = bench_scaled_dataset(task.train_file, task.nclasses, scale);
+        TensorDataset<real_t, real_t>* pValid = bench_scaled_dataset(task.valid_file, task.nclasses, 1);
+        for(int num_workers: worker_counts){
+            double seconds = bench_epoch_time(pTrain, pValid, task.nclasses, batch_size, num_workers);
+            cout << fmt::format("{:<20s}|{:>10d}|{:>8d}|{:>12.3f}\n",
+                    task.name, pTrain->len(), num_workers, seconds);
+        }
+        delete pTrain;
+        delete pValid;
+    }
+}
+
+/* bench_dataloader_iteration:
+ *  iterate eager DataLoaders holding 10^3 .. max_batches single-sample
+ *  batches and report the cost per batch; it stays flat when
+ *  Iterator::operator* is O(1). For reference, indexing the same batches
+ *  in a DLinkedList (the former storage) is timed up to 10^4 batches.
+ */
+void bench_dataloader_iteration(int max_batches=1000000){
+    cout << fmt::format("{:>10s}|{:>16s}|{:>16s}\n", "batches", "loader (ns/b)", "dlist (ns/b)");
+    for(int nbatches = 1000; nbatches <= max_batches; nbatches *= 10){
+        real_tensor X = xt::arange<real_t>(nbatches).reshape({nbatches, 1});
+        real_tensor t = xt::zeros<real_t>({nbatches, 1});
+        TensorDataset<real_t, real_t> ds(X, t);
+        DataLoader<real_t, real_t> loader(&ds, 1, false, false);
+
+        double checksum = 0;
+        auto start = chrono::steady_clock::now();
+        for(auto& batch: loader) checksum += batch.getData()(0, 0);
+        auto stop = chrono::steady_clock::now();
+        double loader_ns = chrono::duration<double, nano>(stop - start).count()/nbatches;
+
+        string dlist_ns = "-";
+        if(nbatches <= 10000){
+            DLinkedList<Batch<real_t, real_t>> list;
+            for(auto& batch: loader) list.add(batch);
+            start = chrono::steady_clock::now();
+            for(int idx = 0; idx < nbatches; idx++) checksum += list.get(idx).getData()(0, 0);
+            stop = chrono::steady_clock::now();
+            dlist_ns = fmt::format("{:.1f}", chrono::duration<double, nano>(stop - start).count()/nbatches);
+        }
+        cout << fmt::format("{:>10d}|{:>16.1f}|{:>16s}", nbatches, loader_ns, dlist_ns)
+             << "  (checksum " << checksum << ")" << endl;
+    }
+}
+
+#endif /* DATALOADERBENCH_H */
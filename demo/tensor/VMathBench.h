@@ -0,0 +1,92 @@
+/*
+ * File VMathBench.h
+ * Purpose: benchmark of vexp/vtanh/vsigmoid (vmath.cpp) against the loops
+ *          the activations used before them
+ */
+
+#ifndef VMATHBENCH_H
+#define VMATHBENCH_H
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <chrono>
+#include <functional>
+using namespace std;
+
+#include "sformat/fmt_lib.h"
+#include "tensor/xtensor_lib.h"
+#include "ann/functions.h"
+
+/* best_ms: best of nruns calls of f, in ms */
+double best_ms(int nruns, const function<void()>& f){
+    double best = 1e30;
+    for(int run = 0; run < nruns; run++){
+        auto start = chrono::steady_clock::now();
+        f();
+        auto stop = chrono::steady_clock::now();
+        best = min(best, chrono::duration<double>(stop - start).count());
+    }
+    return best*1e3;
+}
+
+/* bench_vmath:
+ *  for n = 1e3 .. max_n values in [-8, 8], the time of
+ *  + exp: xt::exp vs vexp
+ *  + tanh: a loop of std::tanh (Tanh::forward) vs vtanh
+ *  + sigmoid: 1/(1 + xt::exp(-X)) (Sigmoid::forward) vs vsigmoid
+ *  + softmax: the xtensor expression softmax() used (rows of 10) vs softmax()
+ *  in exact and fast mode; the speedups are against the old loop.
+ */
+void bench_vmath(long max_n=10000000){
+    cout << fmt::format("vmath kernel: {:s}, threads: {:d}\n",
+            vmath_kernel(), gemm_get_num_threads());
+    cout << fmt::format("{:<8s}|{:>9s}|{:>11s}|{:>11s}|{:>11s}|{:>9s}|{:>9s}\n",
+            "func", "n", "old(ms)", "exact(ms)", "fast(ms)", "exact", "fast");
+    for(long n = 1000; n <= max_n; n *= 10){
+        real_tensor X = 16*xt::random::rand<real_t>({(unsigned long)n}) - 8;
+        real_tensor Y = xt::zeros<real_t>({(unsigned long)n});
+        int nruns = n < 1000000 ? 20 : 3;
+        const char* names[] = {"exp", "tanh", "sigmoid", "softmax"};
+        for(int func = 0; func < 4; func++){
+            function<void()> old_loop;
+            function<void(VMathMode)> new_loop;
+            if(func == 0){
+                old_loop = [&](){ Y = xt::exp(X); };
+                new_loop = [&](VMathMode mode){ vexp(X.data(), Y.data(), n, mode); };
+            }
+            else if(func == 1){
+                old_loop = [&](){ for(long i = 0; i < n; i++) Y.flat(i) = std::tanh(X.flat(i)); };
+                new_loop = [&](VMathMode mode){ vtanh(X.data(), Y.data(), n, mode); };
+            }
+            else if(func == 2){
+                old_loop = [&](){ Y = 1.0/(1.0 + xt::exp(-X)); };
+                new_loop = [&](VMathMode mode){ vsigmoid(X.data(), Y.data(), n, mode); };
+            }
+            else{
+                X.reshape({(unsigned long)n/10, 10});
+                old_loop = [&](){
+                    real_tensor Xmax = xt::amax(X, {1}, xt::keep_dims);
+                    real_tensor E = xt::exp(X - Xmax);
+                    real_tensor S = xt::sum(E, {1}, xt::keep_dims);
+                    Y = E/S;
+                };
+                new_loop = [&](VMathMode mode){
+                    VMathMode old_mode = vmath_get_mode();
+                    vmath_set_mode(mode);
+                    Y = softmax(X, -1);
+                    vmath_set_mode(old_mode);
+                };
+            }
+            double t_old = best_ms(nruns, old_loop);
+            double t_exact = best_ms(nruns, [&](){ new_loop(VMATH_EXACT); });
+            double t_fast = best_ms(nruns, [&](){ new_loop(VMATH_FAST); });
+            cout << fmt::format("{:<8s}|{:>9d}|{:>11.3f}|{:>11.3f}|{:>11.3f}|{:>8.2f}x|{:>8.2f}x\n",
+                    names[func], n, t_old, t_exact, t_fast, t_old/t_exact, t_old/t_fast);
+            X.reshape({(unsigned long)n});
+            Y.resize({(unsigned long)n});
+        }
+    }
+}
+
+#endif /* VMATHBENCH_H */
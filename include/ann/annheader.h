@@ -13,12 +13,14 @@
 #ifndef ANNHEADER_H
 #define ANNHEADER_H
 #include "layer/FCLayer.h"
+#include "layer/FCActLayer.h"
 #include "layer/ReLU.h"
 #include "layer/Sigmoid.h"
 #include "layer/Tanh.h"
 #include "layer/Softmax.h"
 #include "ann/functions.h"
 #include "loss/CrossEntropy.h"
+#include "loss/SoftmaxCrossEntropy.h"
 #include "model/MLPClassifier.h"
 #include "optim/IOptimizer.h"
 #include "loss/ILossLayer.h"
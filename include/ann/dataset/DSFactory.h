@@ -22,21 +22,52 @@ namespace fs = std::filesystem;
 #include "config/Config.h"
 #include "loader/dataset.h"
 #include "loader/dataloader.h"
+#include "loader/mmapdataset.h"
+#include "loader/lazydataset.h"
+#include "util/ThreadPool.h"
 using namespace std;
 #include "dsaheader.h"
 
+/* DSFactory:
+ *  builds the train/valid/test datasets of the demo problems, with one-hot
+ *  targets (get_datasets_xxx: N x C reals) or class-index targets
+ *  (get_sparse_datasets_xxx: N unsigned longs, C times smaller). The
+ *  preprocessed tensors (normalized X, encoded T) are cached under the
+ *  config key "cache_root" (default: ./cache; "none" disables the cache)
+ *  in a folder named after the dataset and a key hashed from the source
+ *  files, the number of classes, the target encoding and real_t. Later runs map the cached
+ *  .npy files (MmapNpyDataset) instead of preprocessing again; editing a
+ *  source file changes the key, so stale entries are never read.
+ *  Without a cache entry, the splits are loaded and preprocessed in
+ *  parallel on the factory's thread pool and returned as LazyDataset
+ *  proxies; the splits listed in the config key "lazy_splits" (default:
+ *  test) are not built until first use, unless the cache is being written.
+ */
 class DSFactory {
 public:
     DSFactory(string cfg_filename);
     DSFactory(const DSFactory& orig);
     virtual ~DSFactory();
     
-    xmap<string, TensorDataset<double, double>*>* get_datasets_3cc();
-    xmap<string, TensorDataset<double, double>*>* get_datasets_2cc();
+    xmap<string, Dataset<real_t, real_t>*>* get_datasets_3cc();
+    xmap<string, Dataset<real_t, real_t>*>* get_datasets_2cc();
+    xmap<string, Dataset<real_t, ulong>*>* get_sparse_datasets_3cc();
+    xmap<string, Dataset<real_t, ulong>*>* get_sparse_datasets_2cc();
     
 protected:
+    /* get_datasets:
+     *  + ds_name: folder of the dataset under "dataset_root"
+     *  + prefix: files are <prefix>_train.npy, <prefix>_valid.npy, <prefix>_test.npy;
+     *      each one is a table whose first two columns are data and last is target
+     *  + nclasses: number of classes for the one-hot encoding
+     *  + LType: real_t for one-hot targets, ulong for class indices
+     */
+    template<typename LType>
+    xmap<string, Dataset<real_t, LType>*>* get_datasets(string ds_name, string prefix, int nclasses);
+    string cache_folder(string ds_name, string source_files[], int nfiles, int nclasses, string targets);
     
     Config* m_pConfig;
+    ThreadPool* m_pPool;
 private:
 
 };
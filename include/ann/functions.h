@@ -37,13 +37,27 @@ enum class_metrics{
 
 
 
-xt::xarray<double> softmax(xt::xarray<double> X, int axis=-1);
+xt::xarray<real_t> softmax(xt::xarray<real_t> X, int axis=-1);
+/* softmax_rows, softmax_backward_rows:
+ *  softmax over each row of a row-major nrows x ncols buffer, and its
+ *  backward as a per-row Jacobian-vector product:
+ *      DX[r] = Y[r]*(DY[r] - <DY[r], Y[r]>)
+ *  O(nrows*ncols); rows run in parallel for large batches (parallel_rows).
+ *  Y may be X, DX may be DY.
+ */
+void softmax_rows(const real_t* X, real_t* Y, int nrows, int ncols);
+void softmax_backward_rows(const real_t* Y, const real_t* DY, real_t* DX, int nrows, int ncols);
 double cross_entropy(xt::xarray<double> Ypred, xt::xarray<double> Ygt, bool mean_reduced=true);
 double cross_entropy(xt::xarray<double> Ypred, xt::xarray<unsigned long> ygt, bool mean_reduced=true);
 xt::xarray<double> onehot_enc(xt::xarray<unsigned long> x, int nclasses);
-xt::xarray<ulong> confusion_matrix(xt::xarray<ulong> y_true, xt::xarray<ulong> y_pred,  int nclasses);
+xt::xarray<ulong> confusion_matrix(const xt::xarray<ulong>& y_true, const xt::xarray<ulong>& y_pred,  int nclasses);
 xt::xarray<ulong> class_count(xt::xarray<ulong> confusion);
-double_tensor calc_classifcation_metrics(ulong_tensor y_true, ulong_tensor y_pred, int nclasses);
+double_tensor calc_classifcation_metrics(const ulong_tensor& y_true, const ulong_tensor& y_pred, int nclasses);
+/* class_indices: class of each sample; argmax of one-hot rows, or
+ *  class-index labels returned as they are (no copy)
+ */
+ulong_tensor class_indices(const xt::xarray<real_t>& T);
+const ulong_tensor& class_indices(const ulong_tensor& labels);
 
 
 
@@ -0,0 +1,58 @@
+/*
+ * File:   FCActLayer.h
+ * Purpose: an FCLayer fused with the activation that follows it
+ *          (ReLU, Sigmoid or Tanh).
+ */
+
+#ifndef FCACTLAYER_H
+#define FCACTLAYER_H
+#include "layer/FCLayer.h"
+
+/* FCActLayer:
+ *  Y = act(X*W^T + b) in one layer. The activation is applied in place on
+ *  the GEMM output, and only act'(Z) is kept for backward, so the pair
+ *  needs no intermediate tensors; for ReLU, act'(Z) is ReLU's packed mask.
+ *  + act: LayerType::RELU, LayerType::SIGMOID or LayerType::TANH
+ *  + act_name: name of the activation; written to arch.txt by save, so a
+ *      saved model lists the same two layers as its unfused version
+ */
+class FCActLayer: public FCLayer {
+public:
+    FCActLayer(int Nin, int Nout, bool use_bias, LayerType act, string act_name="");
+    FCActLayer(string sParams, string filename_w, string filename_b,
+               LayerType act, string sName="", string act_name="");
+    FCActLayer(const FCActLayer& orig);
+    virtual ~FCActLayer();
+
+    xt::xarray<real_t> forward(xt::xarray<real_t> X);
+    xt::xarray<real_t> backward(xt::xarray<real_t> DY);
+    void forward_into(const real_view& X, real_view& Y);
+    void backward_into(real_view& DY, real_view& DX);
+    string get_desc();
+    LayerType get_type();
+    LayerType get_activation(){ return m_eActivation; }
+    bool keeps_output(){ return m_eActivation != LayerType::RELU; }
+    string get_act_name(){ return m_sAct_Name; }
+
+    /* is_fusable:
+     *  true if a layer of type "act" can follow an FCLayer in an FCActLayer
+     */
+    static bool is_fusable(LayerType act){
+        return (act == LayerType::RELU) || (act == LayerType::SIGMOID) || (act == LayerType::TANH);
+    }
+
+protected:
+    ILayer* copy(){ return new FCActLayer(*this); }
+private:
+    LayerType m_eActivation;
+    string m_sAct_Name;
+    xt::xarray<real_t> m_aCached_dA; //act'(Z), same shape as the output (Sigmoid, Tanh)
+    xt::xarray<uint64_t> m_aMask; //ReLU: bit i is Z[i] >= 0
+    xt::svector<unsigned long> m_output_shape; //shape of the last forward
+    const real_t* m_pCached_Y; //output of the last forward_into
+
+    void init_activation(LayerType act, string act_name);
+    uint64_t* prepare_mask(size_t size);
+};
+
+#endif /* FCACTLAYER_H */
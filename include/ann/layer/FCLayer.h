@@ -13,6 +13,7 @@
 #ifndef FCLAYER_H
 #define FCLAYER_H
 #include "layer/ILayer.h"
+#include <stdexcept>
 
 class FCLayer: public ILayer {
 public:
@@ -22,40 +23,96 @@ public:
     FCLayer(const FCLayer& orig);
     virtual ~FCLayer();
     
-    xt::xarray<double> forward(xt::xarray<double> X);
-    xt::xarray<double> backward(xt::xarray<double> DY);
+    xt::xarray<real_t> forward(xt::xarray<real_t> X);
+    xt::xarray<real_t> backward(xt::xarray<real_t> DY);
+    int get_output_size(int nin);
+    void forward_into(const real_view& X, real_view& Y);
+    void backward_into(real_view& DY, real_view& DX);
     int register_params(IParamGroup* ptr_group);
     void save(string model_path);
     void load(string model_path, string layer_name="");
     int getNin(){return m_nNin; }
     int getNout(){return m_nNout; }
     string get_desc();
-    void set_weights(double_tensor W){
+    //written into the tensors in place (maybe in a ParamBuffer): same shapes
+    void set_weights(real_tensor W){
+        if(W.shape() != m_aWeights.shape()){
+            throw std::invalid_argument(m_sName + ": set_weights: shape " + shape2str(W.shape()) +
+                    " != " + shape2str(m_aWeights.shape()));
+        }
         this->m_aWeights = W;
     }
-    void set_bias(double_tensor b){
+    void set_bias(real_tensor b){
+        if(b.shape() != m_aBias.shape()){
+            throw std::invalid_argument(m_sName + ": set_bias: shape " + shape2str(b.shape()) +
+                    " != " + shape2str(m_aBias.shape()));
+        }
         this->m_aBias = b;
     }
     void set_use_bias(bool use_bias){
         this->m_bUse_Bias = use_bias;
     }
+    /* set_mean_rows: rows of the whole batch when backward sees a slice of
+     *  it (data-parallel training): the bias gradient is then the slice's
+     *  share of the batch mean, so the slices' gradients add up to the
+     *  batch's; 0 (default): the mean over the rows given to backward
+     */
+    void set_mean_rows(int nrows){ m_nMean_rows = nrows; }
     bool has_learnable_param(){ return true; };
     LayerType get_type(){ return LayerType::FC; };
+    /* int8 inference (see MLPClassifier::quantize):
+     *  + begin_calibration(): back to the real weights; the forwards that
+     *      follow record the range max|X| of the input
+     *  + quantize(): int8 weights with one scale per output channel
+     *      (max|W(j,:)|/127) and an input scale from the recorded range;
+     *      forwards in inference mode then run gemm_s8. Training mode keeps
+     *      using (and updating) the real weights: quantize again after it.
+     *  + dequantize(): back to the real weights
+     */
+    void begin_calibration();
+    void quantize();
+    void dequantize();
+    bool is_quantized(){ return m_bQuantized; }
 
 protected:
+    ILayer* copy(){ return new FCLayer(*this); }
     virtual void init_weights();
+    /* compute_forward, compute_backward:
+     *  the products of forward/backward on row-major buffers of nrows rows;
+     *  compute_forward keeps the pointer X for compute_backward
+     */
+    void compute_forward(const real_t* X, int nrows, real_t* Y);
+    void compute_backward(const real_t* DY, int nrows, real_t* DX);
+    void compute_forward_s8(const real_t* X, int nrows, real_t* Y);
     
 private:
     int m_nNin, m_nNout;
     bool m_bUse_Bias;
+    int m_nMean_rows; //divisor of the bias gradient; 0: rows of the backward
     
-    xt::xarray<double> m_aWeights; //N_out x N_in
-    xt::xarray<double> m_aBias;
+    /* the learnable tensors are views: into m_aParams_store until
+     * register_params, then into the model's ParamBuffer
+     */
+    real_tensor m_aParams_store; //W, b, grad W, grad b
+    real_view m_aWeights; //N_out x N_in
+    real_view m_aBias; //N_out (zeros and not learned without bias)
     
-    xt::xarray<double> m_aGrad_W;
-    xt::xarray<double> m_aGrad_b;
-    xt::xarray<double> m_aCached_X;
+    real_view m_aGrad_W;
+    real_view m_aGrad_b;
+    xt::xarray<real_t> m_aCached_X; //input of forward (own copy)
+    const real_t* m_pCached_X; //input of the last forward/forward_into
     unsigned long long m_unSample_Counter;
+    
+    bool m_bCalibrating, m_bQuantized;
+    real_t m_in_absmax; //range of the input seen while calibrating
+    real_t m_in_scale; //input: X ~ m_in_scale*X_q
+    xt::xarray<int8_t> m_aWeights_q; //N_out x N_in, packed by gemm_s8_pack
+    xt::xarray<real_t> m_aOut_scale; //N_out: m_in_scale*(scale of row j of W)
+    xt::xarray<int8_t> m_aX_q; //quantized input (grow only)
+    xt::xarray<int32_t> m_aAcc; //int32 products (grow only)
+    
+    void init_quantization();
+    void allocate_params(); //W, b and their grads (zeros) in a new m_aParams_store
 };
 
 
@@ -24,6 +24,9 @@ enum LayerType{
     SIGMOID,
     TANH,
     SOFTMAX,
+    FC_RELU,
+    FC_SIGMOID,
+    FC_TANH,
     NUM_LAYERS
 };
 class ILayer {
@@ -33,8 +36,27 @@ public:
     virtual ~ILayer();
     
     virtual void set_working_mode(bool mode=true){ m_trainable = mode; };
-    virtual xt::xarray<double> forward(xt::xarray<double> X)=0;
-    virtual xt::xarray<double> backward(xt::xarray<double> DY)=0;
+    virtual xt::xarray<real_t> forward(xt::xarray<real_t> X)=0;
+    virtual xt::xarray<real_t> backward(xt::xarray<real_t> DY)=0;
+    /* allocation-free API, for 2D batches (nrows x ncols):
+     *  + get_output_size(nin): number of output columns for nin input columns
+     *  + forward_into(X, Y): same as Y = forward(X), written into Y (shape
+     *      nrows x get_output_size(ncols)); X must stay unchanged until
+     *      backward_into, so layers may keep a reference to X or Y instead of
+     *      a copy
+     *  + backward_into(DY, DX): same as DX = backward(DY), written into DX;
+     *      DY may be overwritten (used as scratch)
+     *  + in_place(): true if forward_into accepts Y == X (and forward may
+     *      return X's storage); the model then gives it the previous layer's
+     *      output as Y, unless that layer keeps_output()
+     *  + keeps_output(): true if backward_into reads the Y of forward_into
+     *  The defaults go through forward/backward, so they still allocate.
+     */
+    virtual int get_output_size(int nin){ return nin; }
+    virtual bool in_place(){ return false; }
+    virtual bool keeps_output(){ return false; }
+    virtual void forward_into(const real_view& X, real_view& Y);
+    virtual void backward_into(real_view& DY, real_view& DX);
     virtual void init_gradbuffer(){};
     virtual int register_params(IParamGroup* ptr_group){ return 0; } //default: 0=no learnable parameters
     virtual string getname(){return m_sName; }
@@ -44,7 +66,16 @@ public:
     virtual void load(string model_path, string layer_name=""){};
     virtual bool has_learnable_param(){ return false; };
     virtual LayerType get_type()=0;
+    /* replicate: a new layer of the same type, shape, name and working mode,
+     *  with a copy of the parameters in tensors of its own and no cached
+     *  state (see MLPClassifier::set_num_replicas); nullptr if the layer has
+     *  no copy(). The default names of later layers are not affected.
+     */
+    ILayer* replicate();
 
+protected:
+    virtual ILayer* copy(){ return nullptr; } //new layer from the copy constructor
+    
 protected:
     bool m_trainable;
     static unsigned long long m_unLayer_idx;
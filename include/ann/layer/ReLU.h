@@ -14,19 +14,34 @@
 #define RELU_H
 #include "layer/ILayer.h"
 
+/* ReLU:
+ *  Y = max(X, 0). The mask (X >= 0) is kept packed, one bit per value,
+ *  and applied in backward with a blend (relu_forward/relu_backward).
+ *  + in_place: forward writes Y over X (see ILayer::in_place)
+ */
 class ReLU: public ILayer {
 public:
-    ReLU(string name="");
+    ReLU(string name="", bool in_place=false);
     ReLU(const ReLU& orig);
     virtual ~ReLU();
     
-    xt::xarray<double> forward(xt::xarray<double> X);
-    xt::xarray<double> backward(xt::xarray<double> DY);
+    xt::xarray<real_t> forward(xt::xarray<real_t> X);
+    xt::xarray<real_t> backward(xt::xarray<real_t> DY);
+    void forward_into(const real_view& X, real_view& Y);
+    void backward_into(real_view& DY, real_view& DX);
     string get_desc();
     LayerType get_type(){ return LayerType::RELU; };
+    bool in_place(){ return m_bIn_place; }
     
+protected:
+    ILayer* copy(){ return new ReLU(*this); }
 private:
-    xt::xarray<bool> m_aMask;
+    bool m_bIn_place;
+    xt::xarray<uint64_t> m_aMask; //bit i: X[i] >= 0 (relu_mask_words words)
+    xt::svector<unsigned long> m_mask_shape; //shape of the last forward
+
+    uint64_t* prepare_mask(const xt::svector<unsigned long>& shape, size_t size);
+    void check_mask(const xt::svector<unsigned long>& shape);
 };
 
 #endif /* RELU_H */
@@ -20,13 +20,19 @@ public:
     Sigmoid(const Sigmoid& orig);
     virtual ~Sigmoid();
     
-    xt::xarray<double> forward(xt::xarray<double> X);
-    xt::xarray<double> backward(xt::xarray<double> DY);
+    xt::xarray<real_t> forward(xt::xarray<real_t> X);
+    xt::xarray<real_t> backward(xt::xarray<real_t> DY);
+    void forward_into(const real_view& X, real_view& Y);
+    void backward_into(real_view& DY, real_view& DX);
     
     string get_desc();
     LayerType get_type(){ return LayerType::SIGMOID; };
+    bool keeps_output(){ return true; }
+protected:
+    ILayer* copy(){ return new Sigmoid(*this); }
 private:
-    xt::xarray<double> m_aCached_Y;
+    xt::xarray<real_t> m_aCached_Y;
+    const real_t* m_pCached_Y; //output of the last forward_into
 
 };
 
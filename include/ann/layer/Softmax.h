@@ -20,17 +20,23 @@ public:
     Softmax(const Softmax& orig);
     virtual ~Softmax();
 
-    virtual xt::xarray<double> forward(xt::xarray<double> X);
-    virtual xt::xarray<double> backward(xt::xarray<double> DY);
+    virtual xt::xarray<real_t> forward(xt::xarray<real_t> X);
+    virtual xt::xarray<real_t> backward(xt::xarray<real_t> DY);
+    virtual void forward_into(const real_view& X, real_view& Y);
+    virtual void backward_into(real_view& DY, real_view& DX);
     
     string get_desc();
     LayerType get_type(){ return LayerType::SOFTMAX; };
+    bool keeps_output(){ return true; }
     
     //void save(string model_path);
     //void load(string model_path, string layer_name="");
+protected:
+    ILayer* copy(){ return new Softmax(*this); }
 private:
     int m_nAxis;
-    xt::xarray<double> m_aCached_Y;    
+    xt::xarray<real_t> m_aCached_Y;    
+    const real_t* m_pCached_Y; //output of the last forward_into
 };
 
 #endif /* SOFTMAX_H */
@@ -20,13 +20,19 @@ public:
     Tanh(const Tanh& orig);
     virtual ~Tanh();
     
-    xt::xarray<double> forward(xt::xarray<double> X);
-    xt::xarray<double> backward(xt::xarray<double> DY);
+    xt::xarray<real_t> forward(xt::xarray<real_t> X);
+    xt::xarray<real_t> backward(xt::xarray<real_t> DY);
+    void forward_into(const real_view& X, real_view& Y);
+    void backward_into(real_view& DY, real_view& DX);
     
     string get_desc();
     LayerType get_type(){ return LayerType::TANH; };
+    bool keeps_output(){ return true; }
+protected:
+    ILayer* copy(){ return new Tanh(*this); }
 private:
-    xt::xarray<double> m_aCached_Y;
+    xt::xarray<real_t> m_aCached_Y;
+    const real_t* m_pCached_Y; //output of the last forward_into
 };
 
 #endif /* TANH_H */
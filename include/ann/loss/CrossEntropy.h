@@ -21,12 +21,20 @@ public:
     CrossEntropy(const CrossEntropy& orig);
     virtual ~CrossEntropy();
     
-    virtual double forward(xt::xarray<double> X, xt::xarray<double> t);
-    virtual xt::xarray<double> backward();
+    virtual double forward(xt::xarray<real_t> X, xt::xarray<real_t> t);
+    virtual xt::xarray<real_t> backward();
+    virtual double forward_into(const real_view& X, const real_tensor& t);
+    virtual double forward_into(const real_view& X, const ulong_tensor& labels);
+    virtual void backward_into(real_view& DX);
+    virtual string get_name(){ return "CrossEntropy"; }
     
 private:
-    xt::xarray<double> m_aYtarget;
-    xt::xarray<double> m_aCached_Ypred;  
+    xt::xarray<real_t> m_aYtarget;
+    xt::xarray<real_t> m_aCached_Ypred;  
+    const real_t* m_pYpred; //X of the last forward_into
+    const real_t* m_pYtarget; //t of the last forward_into
+    const ulong* m_pLabels; //labels of the last forward_into, if sparse
+    unsigned long m_nRows, m_nCols;
     //int m_nClasses;
 };
 
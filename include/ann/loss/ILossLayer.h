@@ -26,11 +26,38 @@ public:
     ILossLayer(const ILossLayer& orig);
     virtual ~ILossLayer();
     
-    virtual double forward(xt::xarray<double> X, xt::xarray<double> t)=0;
-    virtual xt::xarray<double> backward()=0;
+    virtual double forward(xt::xarray<real_t> X, xt::xarray<real_t> t)=0;
+    virtual xt::xarray<real_t> backward()=0;
+    /* allocation-free API:
+     *  + forward_into(X, t): same as forward(X, t); X and t must stay
+     *      unchanged until backward_into, so they may be kept by reference
+     *  + backward_into(DX): same as DX = backward(), written into DX
+     *  The defaults go through forward/backward, so they still allocate.
+     *  + forward_into(X, labels): sparse targets, one class index per row
+     *      of X (i.e., t = onehot_enc(labels)); the default one-hot
+     *      encodes them into m_aSparse_Target.
+     */
+    virtual double forward_into(const real_view& X, const real_tensor& t);
+    virtual double forward_into(const real_view& X, const ulong_tensor& labels);
+    virtual void backward_into(real_view& DX);
+    /* get_name: type name, as written to arch.txt ("loss: <name>")
+     * takes_logits: true if X is the network output before its Softmax
+     */
+    virtual string get_name()=0;
+    virtual bool takes_logits(){ return false; }
 protected:
     LossReduction m_eReduction;
+    real_tensor m_aSparse_Target; //used by the default forward_into(X, labels)
+    
+    /* check_labels: labels must be 1D with one entry in [0, ncols) per row */
+    void check_labels(string loss_name, const real_view& X, const ulong_tensor& labels);
 };
 
+/* create_loss_layer:
+ *  loss layer from its name ("CrossEntropy", "SoftmaxCrossEntropy"); the
+ *  caller owns it. An unknown name throws invalid_argument.
+ */
+ILossLayer* create_loss_layer(string name, LossReduction reduction=REDUCE_MEAN);
+
 #endif /* LOSSLAYER_H */
 
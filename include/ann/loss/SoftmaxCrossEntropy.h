@@ -0,0 +1,45 @@
+/*
+ * File:   SoftmaxCrossEntropy.h
+ * Purpose: softmax and cross-entropy fused into one loss on logits
+ */
+
+#ifndef SOFTMAXCROSSENTROPY_H
+#define SOFTMAXCROSSENTROPY_H
+#include "loss/ILossLayer.h"
+
+/* SoftmaxCrossEntropy:
+ *  X are logits (the network without its final Softmax); per row,
+ *      loss = log(sum(exp(X))) - <t, X>   (for one-hot or soft targets t)
+ *  computed in one log-sum-exp pass, and the gradient is (softmax(X) - t)/N
+ *  (or softmax(X) - t for REDUCE_SUM). With class-index labels, <t, X> is
+ *  just X[label] and t is never materialized.
+ *  MLPClassifier skips a trailing Softmax layer while it trains with this
+ *  loss, so predict/evaluate still output probabilities.
+ */
+class SoftmaxCrossEntropy: public ILossLayer {
+public:
+    SoftmaxCrossEntropy(LossReduction reduction=REDUCE_MEAN);
+    SoftmaxCrossEntropy(const SoftmaxCrossEntropy& orig);
+    virtual ~SoftmaxCrossEntropy();
+
+    virtual double forward(xt::xarray<real_t> X, xt::xarray<real_t> t);
+    virtual xt::xarray<real_t> backward();
+    virtual double forward_into(const real_view& X, const real_tensor& t);
+    virtual double forward_into(const real_view& X, const ulong_tensor& labels);
+    virtual void backward_into(real_view& DX);
+    virtual string get_name(){ return "SoftmaxCrossEntropy"; }
+    virtual bool takes_logits(){ return true; }
+
+private:
+    real_tensor m_aProb; //softmax(X) of the last forward; grows, never shrinks
+    const real_t* m_pYtarget; //t of the last forward
+    const ulong* m_pLabels; //labels of the last forward, if sparse
+    real_tensor m_aYtarget; //own copy of t for forward(X, t)
+    unsigned long m_nRows, m_nCols;
+
+    /* compute: loss of X against t (dense) or labels (sparse; t == nullptr) */
+    double compute(const real_t* X, const real_t* t, const ulong* labels, unsigned long nrows, unsigned long ncols);
+    void gradient(real_t* DX);
+};
+
+#endif /* SOFTMAXCROSSENTROPY_H */
@@ -22,6 +22,7 @@ public:
     
     void reset_metrics();
     double_tensor calculate_metrics(double_tensor y_true, double_tensor y_pred);
+    double_tensor calculate_metrics(const ulong_tensor& y_true, const ulong_tensor& y_pred);
 private:
 
 };
@@ -25,6 +25,11 @@ public:
     virtual void reset_metrics()=0;
     virtual void accumulate(double_tensor y_true, double_tensor y_pred);
     virtual double_tensor calculate_metrics(double_tensor y_true, double_tensor y_pred) = 0;
+    /* class-index versions: y_true, y_pred hold one label per sample.
+     *  The default calculate_metrics converts them to doubles.
+     */
+    virtual void accumulate(const ulong_tensor& y_true, const ulong_tensor& y_pred);
+    virtual double_tensor calculate_metrics(const ulong_tensor& y_true, const ulong_tensor& y_pred);
     virtual const double_tensor& get_metrics(){return m_metrics; };
     virtual ulong get_counts(){ return m_sample_counter; }
     
@@ -36,33 +36,79 @@ public:
      *          => output probabilities for each class.
      *  + make_decision: do not use for regression.
      */
-    virtual double_tensor predict(
-                double_tensor X, 
+    virtual real_tensor predict(
+                real_tensor X, 
                 bool make_decision=false)=0;
-    virtual double_tensor predict(
-                DataLoader<double, double>* pLoader,
+    virtual real_tensor predict(
+                DataLoader<real_t, real_t>* pLoader,
                 bool make_decision=false)=0;
     virtual double_tensor evaluate(
-                DataLoader<double, double>* pLoader)=0;
+                DataLoader<real_t, real_t>* pLoader)=0;
+    //same, for loaders of class-index labels (one ulong per sample)
+    virtual real_tensor predict(
+                DataLoader<real_t, ulong>* pLoader,
+                bool make_decision=false)=0;
+    virtual double_tensor evaluate(
+                DataLoader<real_t, ulong>* pLoader)=0;
     
     
     //for the training mode:
+    /* compile
+     *  + max_batch_size: largest batch that fit will see; the workspace
+     *      for forward_into/backward_into is sized for it up front.
+     *      <= 0: sized on the first batch instead
+     */
     virtual void compile(
                 IOptimizer* pOptimizer,
                 ILossLayer* pLossLayer, 
-                IMetrics* pMetricLayer)=0;
+                IMetrics* pMetricLayer,
+                int max_batch_size=0)=0;
     
     /*
      * fit : used to train models
      *  + NOTES:
      *      * MUST CALL 'compile' before calling 'fit'
+     *      * labels: one-hot rows (real_t) or class indices (ulong); the
+     *          latter go to the loss and the metrics as they are
      */
     virtual void fit(
-            DataLoader<double, double>* pTrainLoader,
-            DataLoader<double, double>* pValidLoader,
+            DataLoader<real_t, real_t>* pTrainLoader,
+            DataLoader<real_t, real_t>* pValidLoader,
+            unsigned int nepoch=10,
+            unsigned int verbose=1); //defined in this class
+    virtual void fit(
+            DataLoader<real_t, ulong>* pTrainLoader,
+            DataLoader<real_t, ulong>* pValidLoader,
             unsigned int nepoch=10,
             unsigned int verbose=1); //defined in this class
     
+    /*
+     * fit_async : Hogwild training (lock-free asynchronous SGD)
+     *  + nthreads workers (<= 0: one per hardware thread) pull the batches
+     *      of pTrainLoader in turn; each runs forward and backward on state
+     *      of its own (activations, gradients, loss) and applies its SGD
+     *      update to the shared weights at once, without locks: the
+     *      updates of the workers interleave and may overwrite each other,
+     *      which Hogwild accepts for throughput (best with sparse updates).
+     *      Only the loader, the metrics and the logging are serialized.
+     *  + NOTES:
+     *      * MUST CALL 'compile' with an SGD optimizer (no per-parameter
+     *          state to share) before calling 'fit_async'
+     *      * the model provides the workers: begin_async, async_step
+     */
+    virtual void fit_async(
+            DataLoader<real_t, real_t>* pTrainLoader,
+            DataLoader<real_t, real_t>* pValidLoader,
+            unsigned int nepoch=10,
+            int nthreads=0,
+            unsigned int verbose=1); //defined in this class
+    virtual void fit_async(
+            DataLoader<real_t, ulong>* pTrainLoader,
+            DataLoader<real_t, ulong>* pValidLoader,
+            unsigned int nepoch=10,
+            int nthreads=0,
+            unsigned int verbose=1); //defined in this class
+    
     /*
      * Subclasses of IModel should:
      * 1. set m_bIs_training := bIs_training 
@@ -94,8 +140,29 @@ public:
     virtual bool load(string model_path, bool use_name_in_file=false)=0;
     
 protected:
-    virtual double_tensor forward(double_tensor X)=0;
+    virtual real_tensor forward(const real_tensor& X)=0;
     virtual void backward()=0;
+    /* forward_into, backward_into: same as forward/backward, but every
+     *  intermediate tensor lives in a workspace owned by the model; the
+     *  returned view is valid until the next forward_into
+     */
+    virtual real_view forward_into(const real_tensor& X)=0;
+    virtual void backward_into()=0;
+    /* begin_async, async_step, end_async: the workers of fit_async
+     *  + begin_async(nworkers): state for nworkers workers, sharing the
+     *      model's weights
+     *  + async_step(worker, X, t, y_pred): one batch on worker's state:
+     *      forward, loss, backward and SGD update of the shared weights
+     *      with lr; returns the loss and the predicted classes in y_pred.
+     *      Called by the workers concurrently (one call per worker at once)
+     *  + end_async(): release the workers' state
+     */
+    virtual void begin_async(int nworkers)=0;
+    virtual double async_step(int worker, const real_tensor& X, const real_tensor& t,
+                              double lr, ulong_tensor& y_pred)=0;
+    virtual double async_step(int worker, const real_tensor& X, const ulong_tensor& t,
+                              double lr, ulong_tensor& y_pred)=0;
+    virtual void end_async()=0;
     
 protected:
     bool m_trainable; //TRUE: training; False: Inference
@@ -107,9 +174,27 @@ protected:
     // The following variables/methods: ONLY USED for method fit  
     // to avoid passing between method "on_xxxx"
     /////////////////////////////////////////////////////////////
+    template<typename LType>
+    void fit_loop(
+            DataLoader<real_t, LType>* pTrainLoader,
+            DataLoader<real_t, LType>* pValidLoader,
+            unsigned int nepoch,
+            unsigned int verbose); //both versions of fit
+    template<typename LType>
+    void fit_async_loop(
+            DataLoader<real_t, LType>* pTrainLoader,
+            DataLoader<real_t, LType>* pValidLoader,
+            unsigned int nepoch,
+            int nthreads,
+            unsigned int verbose); //both versions of fit_async
+    void on_begin_training(
+            DataLoader<real_t, real_t>* pTrainLoader,
+            DataLoader<real_t, real_t>* pValidLoader,
+            unsigned int nepoch=10,
+            int verbose=1);
     void on_begin_training(
-            DataLoader<double, double>* pTrainLoader,
-            DataLoader<double, double>* pValidLoader,
+            DataLoader<real_t, ulong>* pTrainLoader,
+            DataLoader<real_t, ulong>* pValidLoader,
             unsigned int nepoch=10,
             int verbose=1);
     void on_end_training();
@@ -122,8 +207,10 @@ protected:
     ILossLayer* m_pLossLayer; 
     IMetrics* m_pMetricLayer;
     //
-    DataLoader<double, double>* m_pTrainLoader;
-    DataLoader<double, double>* m_pValidLoader;
+    DataLoader<real_t, real_t>* m_pTrainLoader;
+    DataLoader<real_t, real_t>* m_pValidLoader;
+    DataLoader<real_t, ulong>* m_pSparseTrainLoader; //set instead of the two above
+    DataLoader<real_t, ulong>* m_pSparseValidLoader; //for class-index labels
     int m_nepoches; //total number of epoches
     int m_current_epoch; //current epoch-idx
     int m_current_batch; //current batch-idx
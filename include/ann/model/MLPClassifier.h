@@ -18,6 +18,8 @@
 #include "layer/ILayer.h"
 #include "layer/FCLayer.h"
 #include "model/IModel.h"
+#include "model/Workspace.h"
+#include "optim/ParamBuffer.h"
 #include "config/Config.h"
 
 class MLPClassifier: public IModel {
@@ -28,34 +30,124 @@ public:
     ~MLPClassifier();
     
     //for the inference mode:
-    double_tensor predict(double_tensor X, 
+    real_tensor predict(real_tensor X, 
                 bool make_decision=false);
-    double_tensor predict(
-                DataLoader<double, double>* pLoader,
+    real_tensor predict(
+                DataLoader<real_t, real_t>* pLoader,
                 bool make_decision=false);
-    double_tensor evaluate(DataLoader<double, double>* pLoader);
+    double_tensor evaluate(DataLoader<real_t, real_t>* pLoader);
+    real_tensor predict(
+                DataLoader<real_t, ulong>* pLoader,
+                bool make_decision=false);
+    double_tensor evaluate(DataLoader<real_t, ulong>* pLoader);
+    /* quantize: post-training int8 inference
+     *  runs up to nbatches batches of pCalib_loader (<= 0: all of them)
+     *  through the model in inference mode to record the input range of each
+     *  FCLayer (and FCActLayer), then gives them int8 weights (see
+     *  FCLayer::quantize); predict and evaluate then run on gemm_s8.
+     *  Training uses the real weights: call quantize again after fit.
+     * dequantize: back to real-valued inference
+     */
+    void quantize(DataLoader<real_t, real_t>* pCalib_loader, int nbatches=0);
+    void quantize(DataLoader<real_t, ulong>* pCalib_loader, int nbatches=0);
+    void dequantize();
+    bool is_quantized();
     
     //for the training mode:
+    /* compile: as IModel::compile; pLossLayer == nullptr: use the loss named
+     *  in arch.txt by load (CrossEntropy if none), owned by the model
+     */
     void compile(
                 IOptimizer* pOptimizer,
                 ILossLayer* pLossLayer, 
-                IMetrics* pMetricLayer);
+                IMetrics* pMetricLayer,
+                int max_batch_size=0);
     bool save(string model_path="");
     bool load(string model_path, bool use_name_in_file=false);
     
     
     void set_working_mode(bool trainable);
+    /* set_num_replicas: data-parallel training on nreplicas slices of each
+     *  batch; 1 (default): off. The model keeps nreplicas-1 replicas of its
+     *  layers (ILayer::replicate) that read its weights (see
+     *  ParamBuffer::share_params) and write gradients of their own. In
+     *  training mode, forward_into and backward_into run slice s of the batch
+     *  on replica s (slice 0 on the model), the slices in parallel on gemm's
+     *  threads; backward_into then adds the gradients of all slices into the
+     *  model's by a tree reduction, so the optimizer steps once per batch as
+     *  without replicas. The replicas are built by the first training step
+     *  after compile (or load).
+     */
+    void set_num_replicas(int nreplicas);
+    int get_num_replicas(){ return m_nReplicas; }
+    string get_loss_name(){ return m_sLoss_name; }
     int get_num_classes(){
         FCLayer* pLayer = (FCLayer*)m_layers.get(m_layers.size() - 2); 
         return pLayer->getNout();
     };
 
 protected:
-    double_tensor forward(double_tensor X);
+    real_tensor forward(const real_tensor& X);
     void backward();
+    real_view forward_into(const real_tensor& X);
+    void backward_into();
+    //fit_async: one replica (see set_num_replicas) with its own loss per worker
+    void begin_async(int nworkers);
+    double async_step(int worker, const real_tensor& X, const real_tensor& t,
+                      double lr, ulong_tensor& y_pred);
+    double async_step(int worker, const real_tensor& X, const ulong_tensor& t,
+                      double lr, ulong_tensor& y_pred);
+    void end_async();
+    template<typename LType>
+    double async_step_batch(int worker, const real_tensor& X, const xt::xarray<LType>& t,
+                            double lr, ulong_tensor& y_pred); //both versions of async_step
+    /* prepare_workspace:
+     *  lay out one output slot per layer and two gradient slots for
+     *  inputs of nin columns, and make room for nrows rows
+     */
+    void prepare_workspace(int nin, int nrows);
+    /* forward_rows, backward_rows:
+     *  the layer loops of forward_into and backward_into for nrows rows,
+     *  on the model alone; backward_rows reads DY from gradient slot 0
+     */
+    real_view forward_rows(const real_t* X, int nrows, int nin);
+    void backward_rows(int nrows);
+    //data parallelism (see set_num_replicas)
+    void prepare_replicas();
+    void clear_replicas();
+    MLPClassifier* new_replica(); //copies of the layers on the model's weights
+    void reduce_grads(); //sum of the slices' gradients into m_params
+    MLPClassifier* slice_model(int slice){ return (slice == 0) ? this : m_replicas.get(slice - 1); }
+    int slice_begin(int slice){ return (long)slice*m_nBatch_rows/m_nSlices; } //first row
+    /* num_train_layers:
+     *  layers run by forward/backward; a trailing Softmax is left out while
+     *  training with a loss that takes logits (e.g., SoftmaxCrossEntropy)
+     */
+    int num_train_layers();
+    //both versions of predict(pLoader), evaluate(pLoader)
+    template<typename LType>
+    real_tensor predict_loader(DataLoader<real_t, LType>* pLoader, bool make_decision);
+    template<typename LType>
+    double_tensor evaluate_loader(DataLoader<real_t, LType>* pLoader);
+    template<typename LType>
+    void quantize_loader(DataLoader<real_t, LType>* pLoader, int nbatches);
+    XArrayList<FCLayer*> fc_layers(); //FCLayers and FCActLayers, in order
     
 protected:
     DLinkedList<ILayer*> m_layers;
+    Workspace m_workspace;
+    ParamBuffer m_params; //learnable tensors of all layers, from compile
+    XArrayList<int> m_act_slots; //output slot of each layer
+    int m_grad_slots[2]; //gradients, used in turn by backward_into
+    int m_nWorkspace_nin; //input columns of the layout; 0: no layout yet
+    int m_nMax_batch; //from compile
+    int m_nBatch_rows; //rows of the last forward_into
+    string m_sLoss_name; //from compile, or from arch.txt by load
+    ILossLayer* m_pOwned_Loss; //created by compile(., nullptr, .)
+    int m_nReplicas; //slices of a training batch; 1: no data parallelism
+    int m_nSlices; //slices of the last forward_into
+    XArrayList<MLPClassifier*> m_replicas; //run slices 1 .. m_nReplicas-1
+    XArrayList<MLPClassifier*> m_workers; //of fit_async
     
 private:
 };
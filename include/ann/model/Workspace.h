@@ -0,0 +1,49 @@
+/*
+ * File:   Workspace.h
+ * Purpose: one contiguous block of real_t sliced into per-batch buffers
+ *          (layer outputs, gradients) that are reused at every step.
+ */
+
+#ifndef WORKSPACE_H
+#define WORKSPACE_H
+#include "tensor/xtensor_lib.h"
+#include "list/XArrayList.h"
+
+/* Workspace:
+ *  a slot is a buffer of max_rows x ncols values; a batch of nrows <= max_rows
+ *  uses the first nrows rows of it. All slots share one allocation, so the
+ *  steps of an epoch, including a smaller last batch, allocate nothing.
+ *  + reserve(ncols): declare a slot; returns its id
+ *  + allocate(max_rows): (re)allocate the block for all declared slots; only
+ *      reallocates when max_rows or the declared slots changed
+ *  + view(slot, nrows, ncols): nrows x ncols view of a slot; ncols < 0 (default)
+ *      means all the columns reserved for the slot
+ *  + clear(): forget all slots and release the block
+ */
+class Workspace {
+public:
+    Workspace();
+    Workspace(const Workspace& orig) = delete;
+    Workspace& operator=(const Workspace& orig) = delete;
+    virtual ~Workspace();
+
+    int reserve(int ncols);
+    void allocate(int max_rows);
+    real_view view(int slot, int nrows, int ncols=-1);
+    void clear();
+
+    int num_slots(){ return m_slot_cols.size(); }
+    int get_cols(int slot){ return m_slot_cols.get(slot); }
+    int get_max_rows(){ return m_nMax_rows; }
+    bool is_allocated(){ return m_bAllocated; }
+    unsigned long long size(){ return m_aBlock.size(); }
+
+private:
+    XArrayList<int> m_slot_cols;
+    XArrayList<unsigned long long> m_slot_offsets;
+    real_tensor m_aBlock;
+    int m_nMax_rows;
+    bool m_bAllocated;
+};
+
+#endif /* WORKSPACE_H */
@@ -28,22 +28,24 @@ using namespace std;
 #include "optim/Adagrad.h"
 #include "optim/Adam.h"
 
-void threeclasses_classification(){
+/* threeclasses_classification:
+ *  + loss_name: "SoftmaxCrossEntropy" (default: trains on the logits,
+ *      skipping the final Softmax) or "CrossEntropy" (on probabilities)
+ */
+void threeclasses_classification(string loss_name="SoftmaxCrossEntropy"){
     DSFactory factory("./config.txt");
-    xmap<string, TensorDataset<double, double>*>* pMap = factory.get_datasets_3cc();
-    TensorDataset<double, double>* train_ds = pMap->get("train_ds");
-    TensorDataset<double, double>* valid_ds = pMap->get("valid_ds");
-    TensorDataset<double, double>* test_ds = pMap->get("test_ds");
-    DataLoader<double, double> train_loader(train_ds, 50, true, false);
-    DataLoader<double, double> valid_loader(valid_ds, 50, false, false);
-    DataLoader<double, double> test_loader(test_ds, 50, false, false);
+    xmap<string, Dataset<real_t, ulong>*>* pMap = factory.get_sparse_datasets_3cc();
+    Dataset<real_t, ulong>* train_ds = pMap->get("train_ds");
+    Dataset<real_t, ulong>* valid_ds = pMap->get("valid_ds");
+    Dataset<real_t, ulong>* test_ds = pMap->get("test_ds");
+    DataLoader<real_t, ulong> train_loader(train_ds, 50, true, false);
+    DataLoader<real_t, ulong> valid_loader(valid_ds, 50, false, false);
+    DataLoader<real_t, ulong> test_loader(test_ds, 50, false, false);
     
     int nClasses = 3;
     ILayer* layers[] = {
-                    new FCLayer(2, 50, true),
-                    new ReLU(),
-                    new FCLayer(50, 20, true),
-                    new ReLU(),
+                    new FCActLayer(2, 50, true, LayerType::RELU),
+                    new FCActLayer(50, 20, true, LayerType::RELU),
                     new FCLayer(20, nClasses, true),
                     new Softmax()
     };
@@ -51,11 +53,11 @@ void threeclasses_classification(){
     
     
     Adam optim(1e-3, 0.9, 0.99);
-    CrossEntropy loss;
+    ILossLayer* pLoss = create_loss_layer(loss_name);
     ClassMetrics metrics(nClasses);
     
     //train + eval
-    model.compile(&optim, &loss, &metrics);
+    model.compile(&optim, pLoss, &metrics);
     model.fit(&train_loader, &valid_loader, 1000);
     string base_path = "./models";
     model.save(base_path + "/" + "3c-classification-1");
@@ -69,6 +71,7 @@ void threeclasses_classification(){
     double_tensor eval_rs1 = pretrained1.evaluate(&test_loader);
     cout << "Load + Eval a pretrained model : " << endl;
     cout << eval_rs1 << endl;
+    delete pLoss;
 }
 
 #endif /* THEECLASSES_H */
@@ -20,16 +20,10 @@ public:
     AdaParamGroup(const AdaParamGroup& orig);
     virtual ~AdaParamGroup();
     
-    void register_param(string param_name, xt::xarray<double>* ptr_param, xt::xarray<double>* ptr_grad); //override
-    void register_sample_count(unsigned long long* pCounter);
-    void zero_grad();
     void step(double lr);
 
 protected:
-    xmap<string, xt::xarray<double>*>* m_pParams;
-    xmap<string, xt::xarray<double>*>* m_pGrads;
-    xmap<string, xt::xarray<double>*>* m_pSquaredGrads;
-    unsigned long long* m_pCounter;
+    real_tensor m_aSquaredGrads; //one per value in [begin(), end())
     double m_decay;
 private:
 };
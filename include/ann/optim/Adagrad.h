@@ -21,7 +21,9 @@ public:
     Adagrad(const Adagrad& orig);
     virtual ~Adagrad();
     
-    IParamGroup* create_group(string name);
+protected:
+    IParamGroup* new_group();
+    
 private:
     double m_decay;
 };
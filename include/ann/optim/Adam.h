@@ -20,10 +20,11 @@ public:
     Adam(double lr=1e-3, double beta_1=0.9, double beta_2=0.999);
     Adam(const Adam& orig);
     virtual ~Adam();
-    IParamGroup* create_group(string name);
+    
+protected:
+    IParamGroup* new_group();
     
 private:
-    double m_learning_rate;
     double m_beta_1, m_beta_2;
 };
 
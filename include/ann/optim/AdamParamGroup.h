@@ -20,18 +20,12 @@ public:
     AdamParamGroup(const AdamParamGroup& orig);
     virtual ~AdamParamGroup();
     
-    void register_param(string param_name, xt::xarray<double>* ptr_param, xt::xarray<double>* ptr_grad); //override
-    void register_sample_count(unsigned long long* pCounter);
-    void zero_grad();
     void step(double lr);
     
 protected:
-    xmap<string, xt::xarray<double>*>* m_pParams;
-    xmap<string, xt::xarray<double>*>* m_pGrads;
-    unsigned long long* m_pCounter;
-    //
-    xmap<string, xt::xarray<double>*>* m_pFirstMomment;
-    xmap<string, xt::xarray<double>*>* m_pSecondMomment;
+    //one per value in [begin(), end())
+    real_tensor m_aFirstMoment;
+    real_tensor m_aSecondMoment;
 
     double m_beta1, m_beta2;
     double m_step_idx; //started with 1
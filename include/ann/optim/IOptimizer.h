@@ -18,21 +18,41 @@
 #include "dsaheader.h"
 
 
+/* IOptimizer:
+ *  + bind(pBuffer): the model's ParamBuffer; drops the groups created so far.
+ *      The groups created next (create_group) register their tensors in it.
+ *  + step(): one update of all the tensors of the buffer at once, by a group
+ *      spanning the whole buffer (one kernel; no per-group/per-tensor loop).
+ *      The kernel splits the buffer in chunks on gemm's threads, across the
+ *      boundaries of the groups and tensors, and returns when all are done:
+ *      the next forward sees the updated weights.
+ *  + zero_grad(): all the grads to 0 (one memset, also on gemm's threads),
+ *      sample counts to 0
+ *  + new_group(): the optimizer's kind of group (SGDParamGroup, ...)
+ */
 class IOptimizer {
 public:
     IOptimizer(double learning_rate=1e-4);
     IOptimizer(const IOptimizer& orig);
     virtual ~IOptimizer();
 
-    virtual int num_group(){return m_pGroupMap->size(); }
+    virtual int num_group(){return m_groups.size(); }
+    double get_learning_rate(){ return m_fLearningRate; }
     virtual void zero_grad();
     virtual void step();
-    virtual IParamGroup* create_group(string name)=0;
+    void bind(ParamBuffer* pBuffer);
+    IParamGroup* create_group(string name);
 
 protected:
+    virtual IParamGroup* new_group()=0;
+    void clear_groups();
+
     double m_fLearningRate;
     
     xmap<string, IParamGroup*>* m_pGroupMap;
+    XArrayList<IParamGroup*> m_groups; //same groups, in order of creation
+    ParamBuffer* m_pBuffer;
+    IParamGroup* m_pAll; //spans m_pBuffer; created at the first step
 };
 
 #endif /* OPTIMIZER_H */
@@ -17,16 +17,39 @@
 #include <string>
 using namespace std;
 #include "dsaheader.h"
+#include "optim/ParamBuffer.h"
 
+/* IParamGroup:
+ *  the learnable tensors of one layer; they live in the ParamBuffer given to
+ *  bind() (see IOptimizer::bind), as tensors [first, last) of it, i.e., the
+ *  values [begin(), end()) of its params() and grads().
+ *  + register_param: declare a tensor and its gradient in the buffer; the
+ *      tensors of a group must be registered one after another
+ *  + zero_grad: grads of the group to 0, sample count to 0
+ *  + step: one update of the params of the group (one kernel over the range)
+ *  + bind(pBuffer, whole): whole=true makes the group span the whole buffer
+ *      (IOptimizer::step updates all the tensors with it)
+ */
 class IParamGroup {
 public:
-    IParamGroup(){};
-    IParamGroup(const IParamGroup& orig){};
+    IParamGroup();
+    IParamGroup(const IParamGroup& orig);
     virtual ~IParamGroup(){};
-    virtual void register_param(string param_name, xt::xarray<double>* ptr_param, xt::xarray<double>* ptr_grad)=0;
-    virtual void register_sample_count(unsigned long long* pCounter)=0;
-    virtual void zero_grad()=0;
+    virtual void register_param(string param_name, real_view* ptr_param, real_view* ptr_grad);
+    virtual void register_sample_count(unsigned long long* pCounter);
+    virtual void zero_grad();
     virtual void step(double lr)=0;
+
+    void bind(ParamBuffer* pBuffer, bool whole=false);
+    void reset_sample_count(){ if(m_pCounter != nullptr) *m_pCounter = 0; }
+    unsigned long long begin();
+    unsigned long long end();
+
+protected:
+    ParamBuffer* m_pBuffer;
+    bool m_bWhole;
+    int m_first_id, m_last_id; //tensors [m_first_id, m_last_id) of m_pBuffer
+    unsigned long long* m_pCounter;
 private:
 
 };
@@ -0,0 +1,64 @@
+/*
+ * File:   ParamBuffer.h
+ * Purpose: the learnable tensors of a model (and their gradients) laid out
+ *          back to back in one block, updated by the optimizers in one pass.
+ */
+
+#ifndef PARAMBUFFER_H
+#define PARAMBUFFER_H
+#include "tensor/xtensor_lib.h"
+#include "list/XArrayList.h"
+
+/* ParamBuffer:
+ *  the block holds all the params, then all the grads, in the same layout;
+ *  every tensor starts on a 64-byte line and the padding stays 0. The layers
+ *  keep their tensors as real_views, re-pointed into the block by allocate(),
+ *  so an optimizer updates all of them with one kernel over [0, size()) and
+ *  zero_grad is one memset.
+ *  + reserve(param, grad): declare a tensor and its gradient (same size);
+ *      returns its id
+ *  + allocate(): (re)allocate the block for all declared tensors: copies the
+ *      current values of the params in, sets the grads to 0 and re-points the
+ *      views; only reallocates when tensors were declared since the last call
+ *  + offset(id): first value of tensor id in params() and grads(); offset of
+ *      num_tensors() is size()
+ *  + zero_grad(): all the grads to 0 (parallel_rows for a large buffer)
+ *  + clear(): forget all tensors; the block is kept (the views still point
+ *      into it) until the next allocate() copies them out of it
+ *  + share_params(source): re-point the param views (and params()) into the
+ *      params of source, which must have the same layout (the same tensors,
+ *      declared in the same order); the grads stay in this buffer. Replicas
+ *      of a model use it to read one set of weights.
+ */
+class ParamBuffer {
+public:
+    ParamBuffer();
+    ParamBuffer(const ParamBuffer& orig) = delete;
+    ParamBuffer& operator=(const ParamBuffer& orig) = delete;
+    virtual ~ParamBuffer();
+
+    int reserve(real_view* ptr_param, real_view* ptr_grad);
+    void allocate();
+    void zero_grad();
+    void clear();
+    void share_params(ParamBuffer& source);
+
+    real_t* params(){ return m_pParams; }
+    real_t* grads(){ return m_pGrads; }
+    unsigned long long offset(int id);
+    unsigned long long size(){ return m_nSize; }
+    int num_tensors(){ return m_params.size(); }
+    bool is_allocated(){ return m_bAllocated; }
+
+private:
+    XArrayList<real_view*> m_params;
+    XArrayList<real_view*> m_grads;
+    XArrayList<unsigned long long> m_offsets;
+    real_tensor m_aBlock;
+    real_t* m_pParams; //64-byte aligned, in m_aBlock
+    real_t* m_pGrads;
+    unsigned long long m_nSize; //values per part, padding included
+    bool m_bAllocated;
+};
+
+#endif /* PARAMBUFFER_H */
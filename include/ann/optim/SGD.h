@@ -20,9 +20,8 @@ public:
     SGD(const SGD& orig);
     virtual ~SGD();
     
-    IParamGroup* create_group(string name);
 protected:
-
+    IParamGroup* new_group();
 };
 
 #endif /* SGD_H */
@@ -20,16 +20,8 @@ public:
     SGDParamGroup(const SGDParamGroup& orig);
     virtual ~SGDParamGroup();
 
-    void register_param(string param_name, xt::xarray<double>* ptr_param, xt::xarray<double>* ptr_grad); //override
-    void register_sample_count(unsigned long long* pCounter);
-    void zero_grad();
     void step(double lr);
     
-protected:
-    xmap<string, xt::xarray<double>*>* m_pParams;
-    xmap<string, xt::xarray<double>*>* m_pGrads;
-    unsigned long long* m_pCounter;
-    
 private:
 };
 
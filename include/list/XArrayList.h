@@ -301,7 +301,7 @@ template <class T>
 void XArrayList<T>::add(T e) {
     // TODO
     ensureCapacity(count);
-    data[count++] = e;
+    data[count++] = std::move(e);
 }
 
 template <class T>
@@ -14,7 +14,14 @@
 #define DATALOADER_H
 #include "tensor/xtensor_lib.h"
 #include "loader/dataset.h"
+#include "loader/sampler.h"
 #include "list/listheader.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <vector>
+#include <algorithm>
 
 using namespace std;
 
@@ -23,63 +30,114 @@ class DataLoader{
 public:
     
 private:
-    DLinkedList<Batch<DType, LType>> batches;
+    XArrayList<Batch<DType, LType>> batches; //contiguous: get(i) is O(1)
     Dataset<DType, LType>* ptr_dataset;
     int batch_size;
     bool shuffle;
     bool drop_last;
     int m_seed;
     /*TODO: add more member variables to support the iteration*/
+    bool m_lazy;                    //true: assemble each batch on demand
+    xt::xarray<int> m_indices;      //sample order (shuffled or not)
+    Sampler* m_pSampler;            //not owned; nullptr: order fixed at construction
+    int m_num_batches;
+    //lazy mode: batches are assembled into a ring of RING_SIZE recycled
+    //buffers, so a reference handed out stays valid for RING_SIZE-1 more
+    //batches and no tensor is allocated once the ring is warm
+    static const int RING_SIZE = 2;
+    Batch<DType, LType> m_ring[RING_SIZE];
+    int m_ring_pos;                 //ring entry of the current batch
+    int m_current_idx;              //index of the current batch; -1: none
+
+    //prefetching: workers fill a ring of m_queue_depth slots; batch i goes
+    //to slot (i % m_queue_depth) and is taken out by get_batch(i)
+    int m_num_workers;
+    int m_prefetch_factor;
+    int m_queue_depth;
+    vector<thread> m_workers;
+    vector<Batch<DType, LType>> m_slots;
+    vector<int> m_slot_batch;       //batch held by each slot; -1: empty
+    mutex m_mutex;
+    condition_variable m_cv;
+    int m_next_task;                //next batch to be assembled by a worker
+    int m_next_expected;            //next batch the consumer will take
+    bool m_stop;
+    exception_ptr m_worker_error;
 public:
+    /* lazy:
+     *  + false: all batches are copied from the dataset in the constructor
+     *  + true: only the index permutation is built in the constructor;
+     *          Iterator::operator* assembles the requested batch from it
+     *          into a recycled buffer, so at most two batches are held in
+     *          memory and a batch stays valid until two more are taken.
+     * num_workers:
+     *  + 0: batches are assembled on the calling thread (see lazy)
+     *  + >0: batches are assembled on the fly by num_workers background
+     *          threads, which keep up to num_workers*prefetch_factor ready
+     *          batches queued ahead of the consumer. Iteration is expected
+     *          to be sequential; a jump restarts the workers from there.
+     */
     DataLoader(Dataset<DType, LType>* ptr_dataset,
             int batch_size,
             bool shuffle=true,
             bool drop_last=false,
-            int seed=-1) : ptr_dataset(ptr_dataset), batch_size(batch_size), shuffle(shuffle), drop_last(drop_last), m_seed(seed) {
+            int seed=-1,
+            bool lazy=false,
+            int num_workers=0,
+            int prefetch_factor=2) :
+            batches(0, 0, (lazy || num_workers > 0) ? 0 : ptr_dataset->len()/batch_size),
+            ptr_dataset(ptr_dataset), batch_size(batch_size), shuffle(shuffle), drop_last(drop_last), m_seed(seed), m_lazy(lazy), m_pSampler(nullptr),
+            m_num_workers(num_workers), m_prefetch_factor(prefetch_factor) {
         /*TODO: Add your code to do the initialization */
 
         int num_samples = ptr_dataset->len();
-        xt::xarray <int> indices = xt::xarray<int>::from_shape({(unsigned long)num_samples});
-        for (int i = 0; i < num_samples; i++) indices[i] = i;
+        m_indices = xt::xarray<int>::from_shape({(unsigned long)num_samples});
+        for (int i = 0; i < num_samples; i++) m_indices[i] = i;
         if (shuffle) {
             if (m_seed >= 0) {
                 xt::random::seed(m_seed);
             }
-            xt::random::shuffle(indices);
+            xt::random::shuffle(m_indices);
         }
+        setup();
+    }
 
-        int num_batches = (num_samples / batch_size);
+    /* DataLoader with a sampler:
+     *  the order of samples comes from ptr_sampler, which is asked for a new
+     *  permutation on every set_epoch(.). Batches are always gathered lazily
+     *  from that permutation, so changing the order never copies data.
+     *  The sampler is not owned by the loader.
+     */
+    DataLoader(Dataset<DType, LType>* ptr_dataset,
+            Sampler* ptr_sampler,
+            int batch_size,
+            bool drop_last=false,
+            int num_workers=0,
+            int prefetch_factor=2) :
+            batches(0, 0, 0),
+            ptr_dataset(ptr_dataset), batch_size(batch_size), shuffle(false), drop_last(drop_last), m_seed(-1), m_lazy(true), m_pSampler(ptr_sampler),
+            m_num_workers(num_workers), m_prefetch_factor(prefetch_factor) {
+        m_indices = m_pSampler->indices();
+        setup();
+    }
+    virtual ~DataLoader(){
+        stop_workers();
+    }
 
-        for (int i = 0; i < num_batches; i++) {
-            int start = i * batch_size;
-            int end = -1;
-            if (!drop_last && i == num_batches - 1) {
-                end = num_samples;
-            } else {
-                end = start + batch_size;
-            }
-            int batch_size = end - start;
-            
-            xt::svector<unsigned long> data_shape = ptr_dataset->get_data_shape();
-            xt::svector<unsigned long> label_shape = ptr_dataset->get_label_shape();
-            data_shape[0] = batch_size;
-            label_shape[0] = batch_size;
-
-            xt::xarray<DType> data = xt::xarray<DType>::from_shape(data_shape);
-            xt::xarray<LType> label;
-            if (label_shape.size()) label  = xt::xarray<LType>::from_shape(label_shape);
-
-            for (int j = start; j < end; j++) {
-                DataLabel<DType, LType> item = ptr_dataset->getitem(indices[j]);
-                xt::view(data, j - start) = item.getData();
-                if (label_shape.size()) {
-                    xt::view(label, j - start) = item.getLabel();
-                }
-            }
-            batches.add(Batch<DType, LType>(data, label));
-        }
+    /* set_epoch:
+     *  with a sampler: let the sampler produce the order for "epoch";
+     *  without a sampler: nothing to do, the order is the one built in the
+     *  constructor.
+     */
+    void set_epoch(int epoch){
+        if (m_pSampler == nullptr) return;
+        stop_workers();
+        m_pSampler->set_epoch(epoch);
+        m_indices = m_pSampler->indices();
+        m_num_batches = int(m_indices.size()) / batch_size;
+        m_current_idx = -1;
+        m_next_expected = -1;
     }
-    virtual ~DataLoader(){}
 
     //New method: from V2: begin
     int get_batch_size(){ return batch_size; }
@@ -87,6 +145,31 @@ public:
     int get_total_batch(){return int(ptr_dataset->len()/batch_size); }
     
     //New method: from V2: end
+    bool is_lazy(){ return m_lazy; }
+    int get_num_batches(){ return m_num_batches; }
+    int get_num_workers(){ return m_num_workers; }
+    Sampler* get_sampler(){ return m_pSampler; }
+
+    /* get_batch(batch_idx):
+     *  + eager mode: return the batch built in the constructor
+     *  + lazy mode: build the batch from the index permutation into the next
+     *      ring buffer (or reuse it when the same batch is requested again)
+     */
+    Batch<DType, LType>& get_batch(int batch_idx){
+        if (!m_lazy) return batches.get(batch_idx);
+        if (batch_idx < 0 || batch_idx >= m_num_batches) {
+            throw out_of_range("Batch index is out of range!");
+        }
+        if (batch_idx != m_current_idx) {
+            int pos = (m_ring_pos + 1) % RING_SIZE;
+            m_current_idx = -1; //in case the batch can not be built
+            if (m_num_workers > 0) take_prefetched(batch_idx, m_ring[pos]);
+            else fill_batch(batch_idx, m_ring[pos]);
+            m_ring_pos = pos;
+            m_current_idx = batch_idx;
+        }
+        return m_ring[m_ring_pos];
+    }
     
     /////////////////////////////////////////////////////////////////////////
     // The section for supporting the iteration and for-each to DataLoader //
@@ -116,7 +199,7 @@ public:
 
         Batch<DType, LType> &operator*()
         {
-            return pLoader->batches.get(cursor);
+            return pLoader->get_batch(cursor);
         }
 
         bool operator!=(const Iterator &iterator)
@@ -157,17 +240,19 @@ public:
 
     Iterator begin()
     {
+        //get the workers going before the first batch is requested
+        if (m_num_workers > 0 && m_next_expected != 0) start_workers(0);
         return Iterator(this, 0);
     }
 
     Iterator end()
     {
-        return Iterator(this, batches.size());
+        return Iterator(this, m_num_batches);
     }
 
     Iterator bbegin()
     {
-        return Iterator(this, batches.size() - 1);
+        return Iterator(this, m_num_batches - 1);
     }
 
     Iterator bend()
@@ -179,6 +264,166 @@ public:
     // The section for supporting the iteration and for-each to DataLoader //
     /// END: Section                                                       //
     /////////////////////////////////////////////////////////////////////////
+
+private:
+    /* setup:
+     *  called by the constructors once m_indices holds the sample order
+     */
+    void setup(){
+        m_num_batches = int(m_indices.size()) / batch_size;
+        m_current_idx = -1;
+        m_ring_pos = 0;
+
+        if (m_num_workers < 0) m_num_workers = 0;
+        if (m_prefetch_factor < 1) m_prefetch_factor = 1;
+        m_queue_depth = m_num_workers * m_prefetch_factor;
+        m_next_task = m_next_expected = -1;
+        m_stop = false;
+        if (m_num_workers > 0) {
+            m_lazy = true; //workers build the batches: nothing to copy here
+            m_slots.resize(m_queue_depth);
+            m_slot_batch.assign(m_queue_depth, -1);
+        }
+        if (m_lazy) return;
+
+        for (int i = 0; i < m_num_batches; i++) {
+            batches.add(make_batch(i));
+        }
+    }
+
+    Batch<DType, LType> make_batch(int batch_idx){
+        Batch<DType, LType> batch;
+        fill_batch(batch_idx, batch);
+        return batch;
+    }
+
+    /* fill_batch(batch_idx, batch):
+     *  copy the samples of batch "batch_idx" (taken in the order given by
+     *  m_indices) out of the dataset into "batch"; the last batch absorbs
+     *  the remaining samples when drop_last=false.
+     *  The tensors of "batch" are reused when they already have the right
+     *  shape, so refilling a recycled batch allocates nothing.
+     */
+    void fill_batch(int batch_idx, Batch<DType, LType>& batch){
+        int num_samples = m_indices.size();
+        int start = batch_idx * batch_size;
+        int end = -1;
+        if (!drop_last && batch_idx == m_num_batches - 1) {
+            end = num_samples;
+        } else {
+            end = start + batch_size;
+        }
+        int cur_batch_size = end - start;
+
+        xt::svector<unsigned long> data_shape = ptr_dataset->get_data_shape();
+        xt::svector<unsigned long> label_shape = ptr_dataset->get_label_shape();
+        data_shape[0] = cur_batch_size;
+        if (label_shape.size()) label_shape[0] = cur_batch_size;
+
+        xt::xarray<DType>& data = batch.getData();
+        xt::xarray<LType>& label = batch.getLabel();
+        if (!same_shape(data, data_shape)) data.resize(data_shape);
+        if (label_shape.size() == 0) {
+            if (label.dimension() != 0) label = xt::xarray<LType>();
+        }
+        else if (!same_shape(label, label_shape)) label.resize(label_shape);
+
+        ptr_dataset->getitems(m_indices.data() + start, cur_batch_size,
+                data.data(), label_shape.size() ? label.data() : nullptr);
+    }
+
+    template<typename T>
+    static bool same_shape(const xt::xarray<T>& tensor, const xt::svector<unsigned long>& shape){
+        return tensor.dimension() == shape.size() &&
+               std::equal(shape.begin(), shape.end(), tensor.shape().begin());
+    }
+
+    /////////////////////////////////////////////////////////////////////////
+    // Prefetching: worker threads + consumer                             //
+    /////////////////////////////////////////////////////////////////////////
+    void start_workers(int first_batch){
+        stop_workers();
+        m_stop = false;
+        m_worker_error = nullptr;
+        m_next_task = first_batch;
+        m_next_expected = first_batch;
+        m_current_idx = -1;
+        for (int s = 0; s < m_queue_depth; s++) m_slot_batch[s] = -1;
+        for (int w = 0; w < m_num_workers; w++) {
+            m_workers.push_back(thread(&DataLoader<DType, LType>::worker_loop, this));
+        }
+    }
+
+    void stop_workers(){
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_all();
+        for (auto& worker : m_workers) worker.join();
+        m_workers.clear();
+    }
+
+    void worker_loop(){
+        while (true) {
+            int batch_idx;
+            {
+                unique_lock<mutex> lock(m_mutex);
+                //a batch may be started only when its slot has been consumed
+                m_cv.wait(lock, [this]{
+                    return m_stop || m_next_task >= m_num_batches ||
+                           m_next_task < m_next_expected + m_queue_depth;
+                });
+                if (m_stop || m_next_task >= m_num_batches) return;
+                batch_idx = m_next_task++;
+            }
+
+            //slot (batch_idx % m_queue_depth) was consumed (see the wait
+            //above) and no other worker can be given it: fill it in place
+            int slot = batch_idx % m_queue_depth;
+            exception_ptr error = nullptr;
+            try {
+                fill_batch(batch_idx, m_slots[slot]);
+            } catch (...) {
+                error = current_exception();
+            }
+
+            {
+                lock_guard<mutex> lock(m_mutex);
+                m_slot_batch[slot] = batch_idx;
+                if (error && !m_worker_error) m_worker_error = error;
+            }
+            m_cv.notify_all();
+        }
+    }
+
+    /* take_prefetched(batch_idx, out):
+     *  wait for batch_idx, then swap it into "out"; the old buffers of
+     *  "out" go back to the slot and are refilled by a worker.
+     */
+    void take_prefetched(int batch_idx, Batch<DType, LType>& out){
+        if (batch_idx != m_next_expected || m_workers.empty()) {
+            start_workers(batch_idx);
+        }
+        unique_lock<mutex> lock(m_mutex);
+        int slot = batch_idx % m_queue_depth;
+        m_cv.wait(lock, [&]{
+            return m_slot_batch[slot] == batch_idx || m_worker_error;
+        });
+        if (m_worker_error) {
+            exception_ptr error = m_worker_error;
+            m_worker_error = nullptr;
+            lock.unlock();
+            stop_workers();
+            m_next_expected = -1;
+            rethrow_exception(error);
+        }
+        std::swap(out, m_slots[slot]);
+        m_slot_batch[slot] = -1;
+        m_next_expected = batch_idx + 1;
+        lock.unlock();
+        m_cv.notify_all();
+    }
 };
 
 
@@ -13,6 +13,7 @@
 #ifndef DATASET_H
 #define DATASET_H
 #include "tensor/xtensor_lib.h"
+#include <cstring>
 using namespace std;
 
 template<typename DType, typename LType>
@@ -36,8 +37,12 @@ private:
 public:
     Batch() {};
     Batch(xt::xarray<DType> data,  xt::xarray<LType> label):
-    data(data), label(label){
+    data(std::move(data)), label(std::move(label)){
     }
+    Batch(const Batch&) = default;
+    Batch(Batch&&) = default;
+    Batch& operator=(const Batch&) = default;
+    Batch& operator=(Batch&&) = default;
     virtual ~Batch(){}
     xt::xarray<DType>& getData(){return data; }
     xt::xarray<LType>& getLabel(){return label; }
@@ -55,7 +60,27 @@ public:
     virtual DataLabel<DType, LType> getitem(int index)=0;
     virtual xt::svector<unsigned long> get_data_shape()=0;
     virtual xt::svector<unsigned long> get_label_shape()=0;
-    
+
+    /* getitems:
+     *  copy the items idx[0], ..., idx[n-1] (in this order) into out_data
+     *  and out_label, which must be contiguous row-major buffers of n rows
+     *  of get_data_shape() and get_label_shape() (dimension 0 excluded).
+     *  out_label is ignored when there is no label.
+     *  The default implementation goes through getitem; subclasses that
+     *  own their samples should override it with a direct row copy.
+     */
+    virtual void getitems(const int* idx, int n, DType* out_data, LType* out_label){
+        bool has_label = get_label_shape().size() != 0;
+        for(int j=0; j < n; j++){
+            DataLabel<DType, LType> item = getitem(idx[j]);
+            xt::xarray<DType> data = item.getData();
+            out_data = std::copy(data.begin(), data.end(), out_data);
+            if(has_label && out_label != nullptr){
+                xt::xarray<LType> label = item.getLabel();
+                out_label = std::copy(label.begin(), label.end(), out_label);
+            }
+        }
+    }
 };
 
 //////////////////////////////////////////////////////////////////////
@@ -108,6 +133,30 @@ public:
 
         return DataLabel<DType, LType>(data_item, xt::view(label, index));
     }
+
+    /* getitems:
+     *  row gather straight from the underlying (row-major) tensors:
+     *  one memcpy per row and per label, no temporary arrays.
+     */
+    void getitems(const int* idx, int n, DType* out_data, LType* out_label) {
+        unsigned long data_row = row_size(data_shape);
+        unsigned long label_row = row_size(label_shape);
+        bool has_label = (label_shape.size() != 0) && (out_label != nullptr);
+        int nsamples = len();
+        const DType* src_data = data.data();
+        const LType* src_label = label.data();
+
+        for (int j = 0; j < n; j++) {
+            int index = idx[j];
+            if (index < 0 || index >= nsamples) {
+                throw out_of_range("Index is out of range!");
+            }
+            memcpy(out_data + j*data_row, src_data + index*data_row, data_row*sizeof(DType));
+            if (has_label) {
+                memcpy(out_label + j*label_row, src_label + index*label_row, label_row*sizeof(LType));
+            }
+        }
+    }
     
     xt::svector<unsigned long> get_data_shape() {
         /* TODO: your code is here to return data_shape
@@ -119,6 +168,14 @@ public:
          */
         return label_shape;
     }
+
+private:
+    //number of elements in one sample (all dimensions except dimension 0)
+    static unsigned long row_size(const xt::svector<unsigned long>& shape){
+        unsigned long size = 1;
+        for (unsigned long d = 1; d < shape.size(); d++) size *= shape[d];
+        return size;
+    }
 };
 
 
@@ -0,0 +1,87 @@
+/*
+ * File:   lazydataset.h
+ * Purpose: a Dataset proxy whose real dataset is built later, either by a
+ *          background job (e.g., on a ThreadPool) or on first use.
+ */
+
+#ifndef LAZYDATASET_H
+#define LAZYDATASET_H
+#include "loader/dataset.h"
+#include <future>
+#include <functional>
+#include <mutex>
+using namespace std;
+
+/* LazyDataset:
+ *  every Dataset method first materializes the wrapped dataset (once,
+ *  thread-safe), then forwards to it. The wrapped dataset is owned and
+ *  deleted by the proxy.
+ *  + LazyDataset(future): the dataset is being built elsewhere; first use
+ *      waits for it
+ *  + LazyDataset(make): nothing is built until first use, which calls make()
+ *      in the calling thread
+ *  An exception from the build is rethrown at every use.
+ */
+template<typename DType, typename LType>
+class LazyDataset: public Dataset<DType, LType>{
+private:
+    shared_future<Dataset<DType, LType>*> m_future;
+    function<Dataset<DType, LType>*()> m_make;
+    Dataset<DType, LType>* m_pDataset;
+    exception_ptr m_error;
+    once_flag m_once;
+
+public:
+    LazyDataset(shared_future<Dataset<DType, LType>*> future):
+        m_future(future), m_pDataset(nullptr){
+    }
+    LazyDataset(function<Dataset<DType, LType>*()> make):
+        m_make(make), m_pDataset(nullptr){
+    }
+    LazyDataset(const LazyDataset&) = delete;
+    LazyDataset& operator=(const LazyDataset&) = delete;
+    ~LazyDataset(){
+        //a background build that nobody used still has to be reclaimed
+        if(m_pDataset == nullptr && m_future.valid()){
+            try{
+                m_pDataset = m_future.get();
+            }
+            catch(...){}
+        }
+        if(m_pDataset != nullptr) delete m_pDataset;
+    }
+
+    /* get:
+     *  return the wrapped dataset, building or waiting for it if needed
+     */
+    Dataset<DType, LType>* get(){
+        call_once(m_once, [this](){
+            try{
+                m_pDataset = m_future.valid() ? m_future.get() : m_make();
+            }
+            catch(...){
+                m_error = current_exception();
+            }
+        });
+        if(m_error) rethrow_exception(m_error);
+        return m_pDataset;
+    }
+
+    int len(){
+        return get()->len();
+    }
+    DataLabel<DType, LType> getitem(int index){
+        return get()->getitem(index);
+    }
+    void getitems(const int* idx, int n, DType* out_data, LType* out_label){
+        get()->getitems(idx, n, out_data, out_label);
+    }
+    xt::svector<unsigned long> get_data_shape(){
+        return get()->get_data_shape();
+    }
+    xt::svector<unsigned long> get_label_shape(){
+        return get()->get_label_shape();
+    }
+};
+
+#endif /* LAZYDATASET_H */
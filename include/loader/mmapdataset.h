@@ -0,0 +1,208 @@
+/*
+ * File:   mmapdataset.h
+ * Purpose: a Dataset whose samples stay in .npy files mapped into memory
+ *          (mmap); nothing is read until a row is touched, so it opens
+ *          instantly and works for files larger than RAM.
+ */
+
+#ifndef MMAPDATASET_H
+#define MMAPDATASET_H
+#include "tensor/xtensor_lib.h"
+#include "loader/dataset.h"
+#include <fstream>
+#include <cstring>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+using namespace std;
+
+/* NpyMapping:
+ *  maps a C-ordered .npy file of element type T; the header is parsed with
+ *  xtensor's npy helpers, the payload is exposed as a read-only T array.
+ */
+template<typename T>
+class NpyMapping{
+private:
+    string m_filename;
+    void* m_pBase;
+    size_t m_nMapped;
+    const T* m_pPayload;
+    xt::svector<unsigned long> m_shape;
+
+public:
+    NpyMapping(string filename): m_filename(filename), m_pBase(nullptr), m_nMapped(0), m_pPayload(nullptr){
+        //parse the header
+        ifstream stream(filename, ios::binary);
+        if(!stream.is_open()){
+            throw runtime_error(filename + ": can not open for reading.");
+        }
+        unsigned char v_major, v_minor;
+        xt::detail::read_magic(stream, &v_major, &v_minor);
+        string header;
+        if(v_major == 1 && v_minor == 0) header = xt::detail::read_header_1_0(stream);
+        else if(v_major == 2 && v_minor == 0) header = xt::detail::read_header_2_0(stream);
+        else throw runtime_error(filename + ": unsupported npy format version.");
+
+        string descr;
+        bool fortran_order;
+        vector<size_t> shape;
+        xt::detail::parse_header(header, descr, &fortran_order, shape);
+        if(descr != xt::detail::build_typestring<T>()){
+            throw runtime_error(filename + ": element type " + descr +
+                    " does not match " + xt::detail::build_typestring<T>() + ".");
+        }
+        if(fortran_order){
+            throw runtime_error(filename + ": fortran-ordered arrays are not supported.");
+        }
+        size_t offset = size_t(stream.tellg());
+        stream.close();
+
+        size_t count = 1;
+        for(size_t d: shape){
+            m_shape.push_back(d);
+            count *= d;
+        }
+
+        //map header + payload
+        int fd = open(filename.c_str(), O_RDONLY);
+        if(fd < 0) throw runtime_error(filename + ": can not open for mapping.");
+        struct stat info;
+        if(fstat(fd, &info) != 0 || size_t(info.st_size) < offset + count*sizeof(T)){
+            close(fd);
+            throw runtime_error(filename + ": file is shorter than its header says.");
+        }
+        m_nMapped = size_t(info.st_size);
+        if(m_nMapped > 0){
+            m_pBase = mmap(nullptr, m_nMapped, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        close(fd);
+        if(m_pBase == MAP_FAILED){
+            m_pBase = nullptr;
+            throw runtime_error(filename + ": mmap failed.");
+        }
+        m_pPayload = reinterpret_cast<const T*>(static_cast<const char*>(m_pBase) + offset);
+    }
+    NpyMapping(const NpyMapping&) = delete;
+    NpyMapping& operator=(const NpyMapping&) = delete;
+    ~NpyMapping(){
+        if(m_pBase != nullptr) munmap(m_pBase, m_nMapped);
+    }
+
+    const T* data() const { return m_pPayload; }
+    const xt::svector<unsigned long>& shape() const { return m_shape; }
+    string filename() const { return m_filename; }
+    //number of elements in one row (all dimensions except dimension 0)
+    unsigned long row_size() const {
+        unsigned long size = 1;
+        for(unsigned long d = 1; d < m_shape.size(); d++) size *= m_shape[d];
+        return size;
+    }
+};
+
+//////////////////////////////////////////////////////////////////////
+/* MmapNpyDataset:
+ *  + data_file: .npy file with the samples along dimension 0
+ *  + label_file: .npy file with the labels along dimension 0; "" = no label
+ *  Both files must hold DType (resp. LType) in C order. row(i) and
+ *  label_row(i) are zero-copy pointers into the mapping; getitems copies
+ *  rows straight from it into the batch buffers of DataLoader.
+ */
+template<typename DType, typename LType>
+class MmapNpyDataset: public Dataset<DType, LType>{
+private:
+    NpyMapping<DType>* m_pData;
+    NpyMapping<LType>* m_pLabel;
+    xt::svector<unsigned long> data_shape, label_shape;
+    unsigned long m_nData_row, m_nLabel_row;
+
+public:
+    MmapNpyDataset(string data_file, string label_file=""): m_pData(nullptr), m_pLabel(nullptr){
+        m_pData = new NpyMapping<DType>(data_file);
+        if(label_file.size() != 0){
+            try{
+                m_pLabel = new NpyMapping<LType>(label_file);
+            }
+            catch(...){
+                delete m_pData;
+                throw;
+            }
+        }
+        data_shape = m_pData->shape();
+        if(data_shape.size() == 0){
+            delete m_pData; delete m_pLabel;
+            throw runtime_error(data_file + ": a dataset needs at least one dimension.");
+        }
+        if(m_pLabel != nullptr){
+            label_shape = m_pLabel->shape();
+            if(label_shape.size() == 0 || label_shape[0] != data_shape[0]){
+                delete m_pData; delete m_pLabel;
+                throw runtime_error(label_file + ": number of labels is not the same with number of samples.");
+            }
+        }
+        m_nData_row = m_pData->row_size();
+        m_nLabel_row = (m_pLabel != nullptr) ? m_pLabel->row_size() : 0;
+    }
+    MmapNpyDataset(const MmapNpyDataset&) = delete;
+    MmapNpyDataset& operator=(const MmapNpyDataset&) = delete;
+    ~MmapNpyDataset(){
+        if(m_pData != nullptr) delete m_pData;
+        if(m_pLabel != nullptr) delete m_pLabel;
+    }
+
+    int len(){
+        return data_shape[0];
+    }
+
+    //zero-copy access: pointer to the first element of sample/label "index"
+    const DType* row(int index){
+        check_index(index);
+        return m_pData->data() + index*m_nData_row;
+    }
+    const LType* label_row(int index){
+        check_index(index);
+        if(m_pLabel == nullptr) return nullptr;
+        return m_pLabel->data() + index*m_nLabel_row;
+    }
+
+    DataLabel<DType, LType> getitem(int index){
+        const DType* pRow = row(index);
+        xt::svector<unsigned long> item_shape(data_shape.begin() + 1, data_shape.end());
+        xt::xarray<DType> data_item = xt::xarray<DType>::from_shape(item_shape);
+        memcpy(data_item.data(), pRow, m_nData_row*sizeof(DType));
+        if(m_pLabel == nullptr){
+            return DataLabel<DType, LType>(data_item, xt::xarray<LType>());
+        }
+        xt::svector<unsigned long> label_item_shape(label_shape.begin() + 1, label_shape.end());
+        xt::xarray<LType> label_item = xt::xarray<LType>::from_shape(label_item_shape);
+        memcpy(label_item.data(), label_row(index), m_nLabel_row*sizeof(LType));
+        return DataLabel<DType, LType>(data_item, label_item);
+    }
+
+    void getitems(const int* idx, int n, DType* out_data, LType* out_label){
+        bool has_label = (m_pLabel != nullptr) && (out_label != nullptr);
+        for(int j = 0; j < n; j++){
+            memcpy(out_data + j*m_nData_row, row(idx[j]), m_nData_row*sizeof(DType));
+            if(has_label){
+                memcpy(out_label + j*m_nLabel_row, label_row(idx[j]), m_nLabel_row*sizeof(LType));
+            }
+        }
+    }
+
+    xt::svector<unsigned long> get_data_shape(){
+        return data_shape;
+    }
+    xt::svector<unsigned long> get_label_shape(){
+        return label_shape;
+    }
+
+private:
+    void check_index(int index){
+        if(index < 0 || index >= len()){
+            throw out_of_range("Index is out of range!");
+        }
+    }
+};
+
+#endif /* MMAPDATASET_H */
@@ -0,0 +1,69 @@
+/*
+ * File:   sampler.h
+ * Purpose: samplers decide the order in which a DataLoader visits the
+ *          samples of a dataset; they only produce index permutations.
+ */
+
+#ifndef SAMPLER_H
+#define SAMPLER_H
+#include "tensor/xtensor_lib.h"
+using namespace std;
+
+class Sampler{
+public:
+    Sampler(int num_samples): m_nSamples(num_samples), m_nEpoch(0){}
+    virtual ~Sampler(){}
+
+    virtual int len(){ return m_nSamples; }
+    /* set_epoch:
+     *  called by the loader at the start of every epoch; samplers whose
+     *  order depends on the epoch (e.g., RandomSampler) use it to produce
+     *  a fresh permutation.
+     */
+    virtual void set_epoch(int epoch){ m_nEpoch = epoch; }
+    int get_epoch(){ return m_nEpoch; }
+    /* indices:
+     *  return the order of the samples for the current epoch
+     */
+    virtual xt::xarray<int> indices()=0;
+
+protected:
+    int m_nSamples;
+    int m_nEpoch;
+};
+
+//////////////////////////////////////////////////////////////////////
+class SequentialSampler: public Sampler{
+public:
+    SequentialSampler(int num_samples): Sampler(num_samples){}
+
+    xt::xarray<int> indices(){
+        return xt::arange<int>(0, m_nSamples);
+    }
+};
+
+//////////////////////////////////////////////////////////////////////
+class RandomSampler: public Sampler{
+public:
+    /* seed:
+     *  + seed >= 0: the permutation of epoch e is generated from (seed + e),
+     *      so it is reproducible and does not touch xt::random's engine
+     *  + seed < 0: every call draws a new permutation from xt::random
+     */
+    RandomSampler(int num_samples, int seed=-1): Sampler(num_samples), m_nSeed(seed){}
+
+    xt::xarray<int> indices(){
+        xt::xarray<int> order = xt::arange<int>(0, m_nSamples);
+        if(m_nSeed >= 0){
+            xt::random::default_engine_type engine(m_nSeed + m_nEpoch);
+            xt::random::shuffle(order, engine);
+        }
+        else xt::random::shuffle(order);
+        return order;
+    }
+
+private:
+    int m_nSeed;
+};
+
+#endif /* SAMPLER_H */
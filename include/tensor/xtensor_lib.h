@@ -14,6 +14,8 @@
 #define XTENSOR_LIB_H
 #include <string>
 #include <sstream>
+#include <functional>
+#include <cstdint>
 using namespace std;
 
 #include "tensor/xtensor/xio.hpp"
@@ -26,12 +28,33 @@ using namespace std;
 #include "tensor/xtensor/xsort.hpp"
 #include "tensor/xtensor/xarray.hpp"
 #include "tensor/xtensor/xnpy.hpp"
+#include "tensor/xtensor/xadapt.hpp"
 #include <ctime>
 
 typedef unsigned long ulong;
 typedef xt::xarray<ulong> ulong_tensor;
 typedef xt::xarray<double> double_tensor;
 
+/* real_t:
+ *  element type of the network (weights, activations, gradients and the
+ *  datasets fed to it); double by default, float when built with
+ *  -DANN_FLOAT32 (see PRECISION in Makefile).
+ */
+#ifdef ANN_FLOAT32
+typedef float real_t;
+#else
+typedef double real_t;
+#endif
+typedef xt::xarray<real_t> real_tensor;
+/* real_view:
+ *  a row-major tensor over real_t memory it does not own (e.g., a slice of
+ *  a Workspace); used like real_tensor, but never allocates. Copying a
+ *  real_view copies the reference, and so does assigning a real_view to
+ *  one (it re-points it); assigning any other expression writes the elements.
+ */
+typedef decltype(xt::adapt((real_t*)nullptr, 0, xt::no_ownership(),
+                           xt::svector<unsigned long>())) real_view;
+real_view make_view(real_t* data, xt::svector<unsigned long> shape);
 
 
 string shape2str(xt::svector<unsigned long> vec);
@@ -39,6 +62,145 @@ int positive_index(int idx, int size);
 xt::xarray<double> outer_stack(xt::xarray<double> X, xt::xarray<double>  Y);
 xt::xarray<double> diag_stack(xt::xarray<double> X);
 xt::xarray<double> matmul_on_stack(xt::xarray<double> X, xt::xarray<double>  Y);
+real_tensor load_real_npy(string filename);
+
+/* gemm:
+ *  C = alpha*op(A)*op(B) + beta*C on row-major buffers, where op(A) is
+ *  m x k and op(B) is k x n; op(M) is M, or M transposed when trans_M is
+ *  true, read in place (no transposed copy). lda, ldb, ldc are the row
+ *  strides of A, B, C as stored. Implemented in gemm.cpp (no external BLAS).
+ */
+void gemm(bool trans_a, bool trans_b, int m, int n, int k,
+        double alpha, const double* A, int lda, const double* B, int ldb,
+        double beta, double* C, int ldc);
+void gemm(bool trans_a, bool trans_b, int m, int n, int k,
+        float alpha, const float* A, int lda, const float* B, int ldb,
+        float beta, float* C, int ldc);
+/* gemm_kernel, gemm_set_kernel:
+ *  name of the micro-kernel in use ("avx512", "avx2" or "scalar"); by
+ *  default the best one the CPU supports. gemm_set_kernel forces another
+ *  one and returns false if the CPU does not support it.
+ * gemm_set_num_threads:
+ *  upper bound on the threads of one gemm call; <= 0 (default): one per
+ *  hardware thread. Small products always run on the calling thread.
+ */
+string gemm_kernel();
+bool gemm_set_kernel(string name);
+void gemm_set_num_threads(int num_threads);
+int gemm_get_num_threads();
+/* parallel_rows:
+ *  run body(begin, end) on contiguous ranges covering [0, nrows), in
+ *  parallel on gemm's threads (same limit: gemm_set_num_threads); work is
+ *  the total cost (~ number of values touched). Small work, or a call made
+ *  from inside one of those threads, runs body(0, nrows) inline.
+ */
+void parallel_rows(int nrows, long work, const function<void(int, int)>& body);
+/* run_serial:
+ *  body() on the calling thread, where the gemm and parallel_rows calls it
+ *  makes then run as well (as inside a block of parallel_rows); for threads
+ *  that already share the work out, e.g., the workers of IModel::fit_async
+ */
+void run_serial(const function<void()>& body);
+/* gemm (tensors):
+ *  same for 2D tensors; C is resized to m x n when its shape differs
+ *  (only allowed with beta == 0).
+ */
+void gemm(bool trans_a, bool trans_b, real_t alpha,
+        const real_tensor& A, const real_tensor& B, real_t beta, real_tensor& C);
+
+/* vexp, vtanh, vsigmoid:
+ *  Y[i] = exp(X[i]), tanh(X[i]), 1/(1 + exp(-X[i])) for i in [0, n); Y may
+ *  be X. SIMD (AVX-512 or AVX2+FMA, else portable C++; see vmath_kernel)
+ *  and, for long arrays, on gemm's threads. Implemented in vmath.cpp.
+ *  + VMATH_EXACT: max error 1.2 ulp (exp), 3.2 ulp (tanh), 2.3 ulp
+ *      (sigmoid), for double and float
+ *  + VMATH_FAST: shorter polynomials; max relative error 2e-8 (double:
+ *      up to 1.3e8 ulp) and 1e-5 (float: up to 110 ulp)
+ *  + VMATH_DEFAULT: the mode set by vmath_set_mode (VMATH_EXACT at start)
+ *  exp underflows to 0 (through subnormals) and overflows to inf as
+ *  std::exp; NaN goes through.
+ * vmath_kernel, vmath_set_kernel: as gemm_kernel, gemm_set_kernel
+ */
+enum VMathMode{
+    VMATH_DEFAULT = 0,
+    VMATH_EXACT,
+    VMATH_FAST
+};
+void vexp(const double* X, double* Y, long n, VMathMode mode=VMATH_DEFAULT);
+void vexp(const float* X, float* Y, long n, VMathMode mode=VMATH_DEFAULT);
+void vtanh(const double* X, double* Y, long n, VMathMode mode=VMATH_DEFAULT);
+void vtanh(const float* X, float* Y, long n, VMathMode mode=VMATH_DEFAULT);
+void vsigmoid(const double* X, double* Y, long n, VMathMode mode=VMATH_DEFAULT);
+void vsigmoid(const float* X, float* Y, long n, VMathMode mode=VMATH_DEFAULT);
+void vmath_set_mode(VMathMode mode);
+VMathMode vmath_get_mode();
+string vmath_kernel();
+bool vmath_set_kernel(string name);
+/* relu_forward:
+ *  Y[i] = X[i] if X[i] >= 0, else 0; Y may be X. Bit i%64 of mask[i/64]
+ *  records X[i] >= 0: mask holds relu_mask_words(n) words.
+ * relu_backward:
+ *  DX[i] = DY[i] where bit i of mask is set, else 0; DX may be DY.
+ *  Same kernels and threads as vexp (vmath.cpp).
+ */
+inline long relu_mask_words(long n){ return (n + 63)/64; }
+void relu_forward(const double* X, double* Y, uint64_t* mask, long n);
+void relu_forward(const float* X, float* Y, uint64_t* mask, long n);
+void relu_backward(const uint64_t* mask, const double* DY, double* DX, long n);
+void relu_backward(const uint64_t* mask, const float* DY, float* DX, long n);
+/* vaxpy:
+ *  Y[i] += alpha*X[i] for i in [0, n) (e.g., an SGD step: P += -lr*G); same
+ *  kernels and threads as vexp (vmath.cpp).
+ */
+void vaxpy(long n, double alpha, const double* X, double* Y);
+void vaxpy(long n, float alpha, const float* X, float* Y);
+/* adam_update:
+ *  one Adam step on n values, in one pass (P, G, M, V read once; P, M, V
+ *  written once):
+ *      M = beta1*M + (1 - beta1)*G,  V = beta2*V + (1 - beta2)*G^2
+ *      P -= lr_t*M/(sqrt(V) + eps)
+ *  lr_t: learning rate with the bias corrections (see AdamParamGroup::step)
+ * adagrad_update:
+ *  the same for Sq = decay*Sq + (1 - decay)*G^2, P -= lr*G/(sqrt(Sq) + eps)
+ *  Same kernels and threads as vexp (vmath.cpp).
+ */
+void adam_update(long n, double* P, const double* G, double* M, double* V,
+        double beta1, double beta2, double lr_t, double eps);
+void adam_update(long n, float* P, const float* G, float* M, float* V,
+        float beta1, float beta2, float lr_t, float eps);
+void adagrad_update(long n, double* P, const double* G, double* Sq, double decay, double lr, double eps);
+void adagrad_update(long n, float* P, const float* G, float* Sq, float decay, float lr, float eps);
+
+/* gemm_s8:
+ *  C = A*B^T for int8 A (m x k) and B (n x k), both row-major and read along
+ *  k (B: weights as FCLayer stores them); C (m x n) gets the exact int32
+ *  sums (k < 2^17). AVX-512 VNNI or AVX2, else portable C++; on gemm's
+ *  threads. Implemented in gemm_s8.cpp.
+ * gemm_s8_pack, gemm_s8_packed:
+ *  the same in two steps, for a B used many times (weights): gemm_s8_pack
+ *  lays B out for the kernel once, into gemm_s8_pack_size(n, k) bytes;
+ *  gemm_s8_packed then multiplies by it.
+ * quantize_s8:
+ *  Q[i] = round(X[i]/scale), clamped to [-127, 127]
+ * dequantize_s32:
+ *  Y(i, j) = C(i, j)*scale[j] + bias[j] for an m x n C; bias may be nullptr
+ * gemm_s8_kernel, gemm_s8_set_kernel: as gemm_kernel, gemm_set_kernel
+ *  ("avx512vnni", "avx2" or "scalar")
+ */
+void gemm_s8(int m, int n, int k, const int8_t* A, int lda,
+        const int8_t* B, int ldb, int32_t* C, int ldc);
+long gemm_s8_pack_size(int n, int k);
+void gemm_s8_pack(int n, int k, const int8_t* B, int ldb, int8_t* packed);
+void gemm_s8_packed(int m, int n, int k, const int8_t* A, int lda,
+        const int8_t* packed, int32_t* C, int ldc);
+void quantize_s8(const double* X, int8_t* Q, long n, double scale);
+void quantize_s8(const float* X, int8_t* Q, long n, float scale);
+void dequantize_s32(int m, int n, const int32_t* C, int ldc,
+        const double* scale, const double* bias, double* Y, int ldy);
+void dequantize_s32(int m, int n, const int32_t* C, int ldc,
+        const float* scale, const float* bias, float* Y, int ldy);
+string gemm_s8_kernel();
+bool gemm_s8_set_kernel(string name);
 
 
 #endif /* XTENSOR_LIB_H */
@@ -0,0 +1,90 @@
+/*
+ * File:   ThreadPool.h
+ * Purpose: a fixed set of worker threads running submitted jobs in FIFO
+ *          order; every job returns its result through a std::future.
+ */
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <memory>
+#include <deque>
+#include <vector>
+#include <stdexcept>
+using namespace std;
+
+class ThreadPool{
+public:
+    /* ThreadPool:
+     *  + num_threads: number of workers; <= 0 means one per hardware thread
+     */
+    ThreadPool(int num_threads=0): m_stop(false){
+        if(num_threads <= 0) num_threads = thread::hardware_concurrency();
+        if(num_threads <= 0) num_threads = 1;
+        for(int idx=0; idx < num_threads; idx++){
+            m_workers.emplace_back(&ThreadPool::worker_loop, this);
+        }
+    }
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    /* ~ThreadPool:
+     *  runs the jobs still queued, then joins the workers
+     */
+    ~ThreadPool(){
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_all();
+        for(thread& worker: m_workers) worker.join();
+    }
+
+    int size(){ return m_workers.size(); }
+
+    /* submit:
+     *  queue job (callable without arguments); an exception thrown by the
+     *  job is rethrown by get() on the returned future.
+     *  Jobs start in submission order, so a job may wait on the future of
+     *  any job submitted before it without deadlocking the pool.
+     */
+    template<typename F>
+    future<decltype(declval<F>()())> submit(F job){
+        typedef decltype(declval<F>()()) R;
+        auto pTask = make_shared<packaged_task<R()>>(std::move(job));
+        future<R> result = pTask->get_future();
+        {
+            lock_guard<mutex> lock(m_mutex);
+            if(m_stop) throw runtime_error("ThreadPool: submit after shutdown.");
+            m_tasks.emplace_back([pTask](){ (*pTask)(); });
+        }
+        m_cv.notify_one();
+        return result;
+    }
+
+private:
+    vector<thread> m_workers;
+    deque<function<void()>> m_tasks;
+    mutex m_mutex;
+    condition_variable m_cv;
+    bool m_stop;
+
+    void worker_loop(){
+        while(true){
+            function<void()> task;
+            {
+                unique_lock<mutex> lock(m_mutex);
+                m_cv.wait(lock, [this](){ return m_stop || !m_tasks.empty(); });
+                if(m_tasks.empty()) return; //m_stop and nothing left
+                task = std::move(m_tasks.front());
+                m_tasks.pop_front();
+            }
+            task();
+        }
+    }
+};
+
+#endif /* THREADPOOL_H */
@@ -11,109 +11,238 @@
  */
 
 #include "dataset/DSFactory.h"
+#include "sformat/fmt_lib.h"
+#include <cstdint>
+#include <unistd.h>
+
+#define DS_CACHE_VERSION 1
+static const int NUM_SPLITS = 3;
+static const string SPLITS[NUM_SPLITS] = {"train", "valid", "test"};
 
 DSFactory::DSFactory(string cfg_filename) {
     m_pConfig = new Config(cfg_filename);
+    m_pPool = new ThreadPool(NUM_SPLITS); //one job per split; they are mostly I/O
 }
 
-DSFactory::DSFactory(const DSFactory& orig) {
+DSFactory::DSFactory(const DSFactory& orig): m_pConfig(nullptr), m_pPool(nullptr) {
 }
 
 DSFactory::~DSFactory() {
+    if(m_pPool != nullptr) delete m_pPool; //waits for the jobs still running
     if(m_pConfig != nullptr) delete m_pConfig;
 }
 
-xmap<string, TensorDataset<double, double>*>* DSFactory::get_datasets_3cc(){
-    //YOUR CODE IS HERE
-    string ds_name = "3c-classification";
-    string dataset_root = m_pConfig->get("dataset_root", "datasets");
-    fs::path dataset_path = fs::path(dataset_root) / fs::path(ds_name);
-    string train_file = (dataset_path / fs::path("3c_train.npy")).string();
-    string valid_file = (dataset_path / fs::path("3c_valid.npy")).string();
-    string test_file = (dataset_path / fs::path("3c_test.npy")).string();
-    
-    xt::xarray<double> train_table = xt::load_npy<double>(train_file);
-    xt::xarray<double> valid_table = xt::load_npy<double>(valid_file);
-    xt::xarray<double> test_table = xt::load_npy<double>(test_file);
-    
+xmap<string, Dataset<real_t, real_t>*>* DSFactory::get_datasets_3cc(){
+    return get_datasets<real_t>("3c-classification", "3c", 3);
+}
+
+xmap<string, Dataset<real_t, real_t>*>* DSFactory::get_datasets_2cc(){
+    return get_datasets<real_t>("2c-classification", "2c", 2);
+}
+
+xmap<string, Dataset<real_t, ulong>*>* DSFactory::get_sparse_datasets_3cc(){
+    return get_datasets<ulong>("3c-classification", "3c", 3);
+}
+
+xmap<string, Dataset<real_t, ulong>*>* DSFactory::get_sparse_datasets_2cc(){
+    return get_datasets<ulong>("2c-classification", "2c", 2);
+}
+
+//////////////////////////////////////////////////////////////////////
+//FNV-1a, 64 bits; "hash" chains several calls into one digest
+static const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+static uint64_t fnv1a(const char* data, size_t size, uint64_t hash=FNV_OFFSET){
+    for(size_t idx=0; idx < size; idx++){
+        hash ^= (unsigned char)data[idx];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+static uint64_t fnv1a_file(string filename, uint64_t hash){
+    ifstream stream(filename, ios::binary);
+    if(!stream.is_open()){
+        throw runtime_error(filename + ": can not open for reading.");
+    }
+    char buffer[1 << 16];
+    while(stream){
+        stream.read(buffer, sizeof(buffer));
+        hash = fnv1a(buffer, stream.gcount(), hash);
+    }
+    return hash;
+}
+
+//normalization parameters, estimated on the train split and applied to all splits
+struct NormStats{
     xt::xarray<double> mu, sigma;
-    estimate_params(xt::view(train_table, xt::all(), xt::range(0,2)), mu, sigma);
-    
-    xt::xarray<double> X_train = normalize(xt::view(train_table, xt::all(), xt::range(0,2)), mu, sigma );
-    xt::xarray<double> t_train = xt::view(train_table, xt::all(), -1);
-    xt::xarray<double> T_train = onehot_enc(xt::cast<unsigned long>(t_train), 3);  // 3 lớp
+};
 
-    xt::xarray<double> X_valid = normalize(xt::view(valid_table, xt::all(), xt::range(0,2)), mu, sigma );
-    xt::xarray<double> t_valid = xt::view(valid_table, xt::all(), -1);
-    xt::xarray<double> T_valid = onehot_enc(xt::cast<unsigned long>(t_valid), 3);  // 3 lớp
+//target encodings: one-hot rows (real_t) or class indices (ulong)
+static void encode_targets(const xt::xarray<double>& t, int nclasses, xt::xarray<real_t>& T){
+    T = onehot_enc(xt::cast<unsigned long>(t), nclasses);
+}
+static void encode_targets(const xt::xarray<double>& t, int nclasses, xt::xarray<ulong>& T){
+    T = xt::cast<ulong>(t);
+}
+static string targets_name(real_t*){ return "onehot"; }
+static string targets_name(ulong*){ return "index"; }
 
-    xt::xarray<double> X_test = normalize(xt::view(test_table, xt::all(), xt::range(0,2)), mu, sigma );
-    xt::xarray<double> t_test = xt::view(test_table, xt::all(), -1);
-    xt::xarray<double> T_test = onehot_enc(xt::cast<unsigned long>(t_test), 3);  // 3 lớp
-    
-    TensorDataset<double, double>* train_ds = new TensorDataset<double, double>(X_train, T_train);
-    TensorDataset<double, double>* valid_ds = new TensorDataset<double, double>(X_valid, T_valid);
-    TensorDataset<double, double>* test_ds = new TensorDataset<double, double>(X_test, T_test);
-    
-    xmap<string, TensorDataset<double, double>*>* pMap =
-        new xmap<string, TensorDataset<double, double>*>(
-            &stringHash,
-            0.75, // load-factor
-            0, // value-comparator: use ==
-            xmap<string, TensorDataset<double, double>*>::freeValue);
-    pMap->put("train_ds", train_ds);
-    pMap->put("valid_ds", valid_ds);
-    pMap->put("test_ds", test_ds);
+/* preprocess_split:
+ *  normalize the features (columns [0, 2)) and encode the target (last
+ *  column) of a table; when dump_folder is not empty, X_<split>.npy
+ *  and T_<split>.npy are also dumped there for the cache.
+ */
+template<typename LType>
+static Dataset<real_t, LType>* preprocess_split(xt::xarray<double>& table, const NormStats& stats,
+        int nclasses, string split, string dump_folder){
+    real_tensor X = normalize(xt::view(table, xt::all(), xt::range(0,2)), stats.mu, stats.sigma);
+    xt::xarray<double> t = xt::view(table, xt::all(), -1);
+    xt::xarray<LType> T;
+    encode_targets(t, nclasses, T);
+    if(dump_folder.size() != 0){
+        try{
+            xt::dump_npy((fs::path(dump_folder) / fs::path("X_" + split + ".npy")).string(), X);
+            xt::dump_npy((fs::path(dump_folder) / fs::path("T_" + split + ".npy")).string(), T);
+        }
+        catch(exception& e){
+            cerr << dump_folder << ": can not write the cache (" << e.what() << ")" << endl;
+        }
+    }
+    return new TensorDataset<real_t, LType>(X, T);
+}
 
-    return pMap;
+/* commit_cache:
+ *  once every split has been dumped into tmp_path, rename it to cache_path;
+ *  a reader never sees a half-written entry. Failing to write (e.g.,
+ *  read-only disk) only costs the cache.
+ */
+template<typename LType>
+static void commit_cache(string tmp_path, string cache_path, shared_future<Dataset<real_t, LType>*> futures[]){
+    bool complete = true;
+    for(int idx=0; idx < NUM_SPLITS; idx++){
+        try{
+            futures[idx].wait();
+            futures[idx].get();
+        }
+        catch(...){
+            complete = false;
+        }
+        for(string name: {"X_", "T_"}){
+            complete = complete && fs::exists(fs::path(tmp_path) / fs::path(name + SPLITS[idx] + ".npy"));
+        }
+    }
+    std::error_code ec;
+    if(complete) fs::rename(tmp_path, cache_path, ec);
+    fs::remove_all(tmp_path, ec); //left only if something failed
 }
 
+string DSFactory::cache_folder(string ds_name, string source_files[], int nfiles, int nclasses, string targets){
+    string cache_root = m_pConfig->get("cache_root", "./cache");
+    if(cache_root == "none") return "";
+    
+    //preprocessing parameters: features are columns [0, 2), target is the last column
+    string params = fmt::format("v{}|{}|features=0:2|nclasses={}|targets={}",
+            DS_CACHE_VERSION, xt::detail::build_typestring<real_t>(), nclasses, targets);
+    uint64_t hash = fnv1a(params.data(), params.size());
+    //the files are hashed in parallel, then their digests are chained
+    vector<future<uint64_t>> digests;
+    for(int idx=0; idx < nfiles; idx++){
+        string filename = source_files[idx];
+        digests.push_back(m_pPool->submit([filename](){ return fnv1a_file(filename, FNV_OFFSET); }));
+    }
+    for(int idx=0; idx < nfiles; idx++){
+        uint64_t digest = digests[idx].get();
+        hash = fnv1a((const char*)&digest, sizeof(digest), hash);
+    }
+    
+    string folder = fmt::format("{}-{:016x}", ds_name, hash);
+    return (fs::path(cache_root) / fs::path(folder)).string();
+}
 
-xmap<string, TensorDataset<double, double>*>* DSFactory::get_datasets_2cc(){
+template<typename LType>
+xmap<string, Dataset<real_t, LType>*>* DSFactory::get_datasets(string ds_name, string prefix, int nclasses){
     //prepare the path to files
-    string ds_name = "2c-classification";
     string dataset_root = m_pConfig->get("dataset_root", "datasets");
     fs::path dataset_path = fs::path(dataset_root) / fs::path(ds_name);
-    string train_file = (dataset_path / fs::path("2c_train.npy")).string();
-    string valid_file = (dataset_path / fs::path("2c_valid.npy")).string();
-    string test_file = (dataset_path / fs::path("2c_test.npy")).string();
-    
-    //load data from files
-    // tables: the first two columns are data (i.e., x and y) and the last is target
-    xt::xarray<double> train_table = xt::load_npy<double>(train_file);
-    xt::xarray<double> valid_table = xt::load_npy<double>(valid_file);
-    xt::xarray<double> test_table = xt::load_npy<double>(test_file);
+    string source_files[NUM_SPLITS];
+    for(int idx=0; idx < NUM_SPLITS; idx++){
+        source_files[idx] = (dataset_path / fs::path(prefix + "_" + SPLITS[idx] + ".npy")).string();
+    }
     
-    
-    xt::xarray<double> mu, sigma;
-    estimate_params(xt::view(train_table, xt::all(), xt::range(0,2)), mu, sigma);
-    
-    cout << shape2str(train_table.shape()) << endl;
-    xt::xarray<double> X_train = normalize(xt::view(train_table, xt::all(), xt::range(0,2)), mu, sigma );
-    xt::xarray<double> t_train = xt::view(train_table, xt::all(), -1);
-    xt::xarray<double> T_train = onehot_enc(xt::cast<unsigned long>(t_train), 2);
-    
-    xt::xarray<double> X_valid = normalize(xt::view(valid_table, xt::all(), xt::range(0,2)), mu, sigma  );
-    xt::xarray<double> t_valid = xt::view(valid_table, xt::all(), -1);
-    xt::xarray<double> T_valid = onehot_enc(xt::cast<unsigned long>(t_valid), 2);
-    
-    xt::xarray<double> X_test = normalize(xt::view(test_table, xt::all(), xt::range(0,2)), mu, sigma  );
-    xt::xarray<double> t_test = xt::view(test_table, xt::all(), -1);
-    xt::xarray<double> T_test = onehot_enc(xt::cast<unsigned long>(t_test), 2);
-    
-  
-    TensorDataset<double, double>* train_ds = new TensorDataset<double, double>(X_train, T_train);
-    TensorDataset<double, double>* valid_ds = new TensorDataset<double, double>(X_valid, T_valid);
-    TensorDataset<double, double>* test_ds = new TensorDataset<double, double>(X_test, T_test);
-    
-    xmap<string, TensorDataset<double, double>*>* pMap =
-        new xmap<string, TensorDataset<double, double>*>(
+    xmap<string, Dataset<real_t, LType>*>* pMap =
+        new xmap<string, Dataset<real_t, LType>*>(
             &stringHash,
             0.75, //load-factor
             0, //value-comparator: use ==
-            xmap<string, TensorDataset<double, double>*>::freeValue);
-    pMap->put("train_ds", train_ds);
-    pMap->put("valid_ds", valid_ds);
-    pMap->put("test_ds", test_ds);
+            xmap<string, Dataset<real_t, LType>*>::freeValue);
+    
+    //cache hit: map the preprocessed tensors, no preprocessing at all
+    string cache_path = cache_folder(ds_name, source_files, NUM_SPLITS, nclasses, targets_name((LType*)nullptr));
+    if((cache_path.size() != 0) && fs::exists(cache_path)){
+        try{
+            for(int idx=0; idx < NUM_SPLITS; idx++){
+                string X_file = (fs::path(cache_path) / fs::path("X_" + SPLITS[idx] + ".npy")).string();
+                string T_file = (fs::path(cache_path) / fs::path("T_" + SPLITS[idx] + ".npy")).string();
+                pMap->put(SPLITS[idx] + "_ds", new MmapNpyDataset<real_t, LType>(X_file, T_file));
+            }
+            return pMap;
+        }
+        catch(runtime_error& e){
+            //damaged entry: drop it and rebuild
+            cerr << e.what() << " Rebuilding " << cache_path << endl;
+            pMap->clear();
+            std::error_code ec;
+            fs::remove_all(cache_path, ec);
+        }
+    }
+    
+    //cache miss: one job per split on m_pPool; the tables are loaded in
+    //parallel, valid/test only wait for the statistics of the train split
+    string tmp_path;
+    if(cache_path.size() != 0){
+        tmp_path = cache_path + ".tmp-" + to_string(getpid());
+        std::error_code ec;
+        fs::create_directories(tmp_path, ec);
+        if(ec) tmp_path = "";
+    }
+    string lazy_splits = m_pConfig->get("lazy_splits", "test");
+    
+    shared_ptr<promise<NormStats>> pStatsPromise = make_shared<promise<NormStats>>();
+    shared_future<NormStats> stats = pStatsPromise->get_future().share();
+    shared_future<Dataset<real_t, LType>*> futures[NUM_SPLITS];
+    for(int idx=0; idx < NUM_SPLITS; idx++){
+        string source_file = source_files[idx], split = SPLITS[idx];
+        bool is_train = (idx == 0);
+        function<Dataset<real_t, LType>*()> job = [=](){
+            xt::xarray<double> table;
+            if(is_train){
+                try{
+                    // tables: the first two columns are data (i.e., x and y) and the last is target
+                    table = xt::load_npy<double>(source_file);
+                    NormStats train_stats;
+                    estimate_params(xt::view(table, xt::all(), xt::range(0,2)), train_stats.mu, train_stats.sigma);
+                    pStatsPromise->set_value(train_stats);
+                }
+                catch(...){
+                    pStatsPromise->set_exception(current_exception());
+                    throw;
+                }
+            }
+            else table = xt::load_npy<double>(source_file);
+            return preprocess_split<LType>(table, stats.get(), nclasses, split, tmp_path);
+        };
+        
+        //the train job is never deferred: every other split waits for its statistics
+        bool deferred = !is_train && (tmp_path.size() == 0) && (lazy_splits.find(split) != string::npos);
+        if(deferred){
+            pMap->put(split + "_ds", new LazyDataset<real_t, LType>(job));
+        }
+        else{
+            futures[idx] = m_pPool->submit(job).share();
+            pMap->put(split + "_ds", new LazyDataset<real_t, LType>(futures[idx]));
+        }
+    }
+    if(tmp_path.size() != 0){
+        m_pPool->submit([=]() mutable { commit_cache(tmp_path, cache_path, futures); });
+    }
     return pMap;
 }
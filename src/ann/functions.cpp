@@ -6,19 +6,65 @@
 
 
 
-xt::xarray<double> softmax(xt::xarray<double> X, int axis){
+xt::xarray<real_t> softmax(xt::xarray<real_t> X, int axis){
     xt::svector<unsigned long> shape = X.shape();
     axis = positive_index(axis, shape.size());
+    if(axis == (int)shape.size() - 1 && X.size() > 0){
+        int ncols = shape[axis];
+        softmax_rows(X.data(), X.data(), X.size()/ncols, ncols);
+        return X;
+    }
     shape[axis] = 1;
     
-    xt::xarray<double> Xmax = xt::amax(X, axis);
-    X = xt::exp(X - Xmax.reshape(shape));
-    xt::xarray<double> SX = xt::sum(X, -1); SX = SX.reshape(shape);
+    xt::xarray<real_t> Xmax = xt::amax(X, axis);
+    X = X - Xmax.reshape(shape);
+    vexp(X.data(), X.data(), X.size());
+    xt::xarray<real_t> SX = xt::sum(X, {axis}); SX = SX.reshape(shape);
     X = X/SX;
     
     return X;
 }
 
+void softmax_rows(const real_t* X, real_t* Y, int nrows, int ncols){
+    parallel_rows(nrows, 4L*nrows*ncols, [=](int begin, int end){
+        for(int r=begin; r < end; r++){
+            const real_t* x = X + (long)r*ncols;
+            real_t* y = Y + (long)r*ncols;
+            real_t xmax = x[0];
+            for(int c=1; c < ncols; c++) xmax = std::max(xmax, x[c]);
+            for(int c=0; c < ncols; c++) y[c] = x[c] - xmax;
+        }
+        //one vexp over the whole block, not one short call per row
+        vexp(Y + (long)begin*ncols, Y + (long)begin*ncols, (long)(end - begin)*ncols);
+        for(int r=begin; r < end; r++){
+            real_t* y = Y + (long)r*ncols;
+            real_t sum = 0;
+            for(int c=0; c < ncols; c++) sum += y[c];
+            real_t inv = 1/sum;
+            for(int c=0; c < ncols; c++) y[c] *= inv;
+        }
+    });
+}
+
+void softmax_backward_rows(const real_t* Y, const real_t* DY, real_t* DX, int nrows, int ncols){
+    parallel_rows(nrows, 4L*nrows*ncols, [=](int begin, int end){
+        for(int r=begin; r < end; r++){
+            const real_t* y = Y + (long)r*ncols;
+            const real_t* dy = DY + (long)r*ncols;
+            real_t* dx = DX + (long)r*ncols;
+            //<dy, y> with four partial sums, so the loop vectorizes
+            real_t acc[4] = {0, 0, 0, 0};
+            int c = 0;
+            for(; c + 4 <= ncols; c += 4){
+                for(int l=0; l < 4; l++) acc[l] += dy[c + l]*y[c + l];
+            }
+            for(; c < ncols; c++) acc[0] += dy[c]*y[c];
+            real_t dot = (acc[0] + acc[1]) + (acc[2] + acc[3]);
+            for(c=0; c < ncols; c++) dx[c] = y[c]*(dy[c] - dot);
+        }
+    });
+}
+
 /*
  */
 double cross_entropy(xt::xarray<double> Ypred, xt::xarray<double> Ygt, bool mean_reduced){
@@ -94,7 +140,7 @@ xt::xarray<double> normalize(xt::xarray<double> X, xt::xarray<double> mu, xt::xa
 }
 
 
-ulong_tensor confusion_matrix(ulong_tensor y_true, ulong_tensor y_pred,  int nclasses){
+ulong_tensor confusion_matrix(const ulong_tensor& y_true, const ulong_tensor& y_pred,  int nclasses){
     //int nclasses = xt::amax(y_true)[0] + 1;
     int nsamples = y_true.shape()[0];
     
@@ -107,12 +153,18 @@ ulong_tensor confusion_matrix(ulong_tensor y_true, ulong_tensor y_pred,  int ncl
     }
     return C;
 }
+ulong_tensor class_indices(const xt::xarray<real_t>& T){
+    return xt::argmax(T, 1);
+}
+const ulong_tensor& class_indices(const ulong_tensor& labels){
+    return labels;
+}
 xt::xarray<ulong> class_count(xt::xarray<ulong> confusion){
     xt::xarray<ulong> count = xt::sum(confusion, -1);
     return count;
 }
 
-double_tensor calc_classifcation_metrics(ulong_tensor y_true, ulong_tensor y_pred,  int nclasses){
+double_tensor calc_classifcation_metrics(const ulong_tensor& y_true, const ulong_tensor& y_pred,  int nclasses){
     double_tensor lookup = xt::zeros<double>({NUM_CLASS_METRICS});
     
     ulong_tensor C = confusion_matrix(y_true, y_pred, nclasses);
@@ -0,0 +1,172 @@
+/*
+ * File:   FCActLayer.cpp
+ * Purpose: an FCLayer fused with the activation that follows it
+ */
+
+#include "layer/FCActLayer.h"
+
+#include <cmath>
+#include <stdexcept>
+
+#include "ann/functions.h"
+#include "sformat/fmt_lib.h"
+using namespace std;
+
+static string act_type_name(LayerType act) {
+  switch (act) {
+    case LayerType::RELU: return "ReLU";
+    case LayerType::SIGMOID: return "Sigmoid";
+    case LayerType::TANH: return "Tanh";
+    default: return "";
+  }
+}
+
+FCActLayer::FCActLayer(int Nin, int Nout, bool use_bias, LayerType act,
+                       string act_name)
+    : FCLayer(Nin, Nout, use_bias) {
+  init_activation(act, act_name);
+}
+
+FCActLayer::FCActLayer(string sParams, string filename_w, string filename_b,
+                       LayerType act, string sName, string act_name)
+    : FCLayer(sParams, filename_w, filename_b, sName) {
+  init_activation(act, act_name);
+}
+
+FCActLayer::FCActLayer(const FCActLayer& orig) : FCLayer(orig) {
+  init_activation(orig.m_eActivation, orig.m_sAct_Name);
+}
+
+FCActLayer::~FCActLayer() {}
+
+void FCActLayer::init_activation(LayerType act, string act_name) {
+  if (!is_fusable(act)) {
+    throw std::invalid_argument(fmt::format(
+        "{:s}: only ReLU, Sigmoid and Tanh can be fused into an FC layer",
+        m_sName));
+  }
+  m_eActivation = act;
+  m_pCached_Y = nullptr;
+  // same numbering as a stand-alone activation layer created after the FC
+  if (trim(act_name).size() != 0)
+    m_sAct_Name = act_name;
+  else
+    m_sAct_Name = act_type_name(act) + "_" + to_string(++m_unLayer_idx);
+}
+
+xt::xarray<real_t> FCActLayer::forward(xt::xarray<real_t> X) {
+  // Z = X*W^T + b, then the activation in place on Z while it is in cache;
+  // act'(Z) goes to a buffer that is only reallocated when the shape changes
+  xt::xarray<real_t> Y = FCLayer::forward(std::move(X));
+  real_t* y = Y.data();
+  size_t size = Y.size();
+  m_output_shape = Y.shape();
+  if (m_eActivation == LayerType::RELU) {
+    relu_forward(y, y, prepare_mask(size), size);
+    return Y;
+  }
+  if (m_aCached_dA.shape() != Y.shape()) m_aCached_dA.resize(Y.shape());
+
+  real_t* dA = m_aCached_dA.data();
+  switch (m_eActivation) {
+    case LayerType::SIGMOID:
+      vsigmoid(y, y, size);
+      for (size_t i = 0; i < size; i++) dA[i] = y[i] * (1 - y[i]);
+      break;
+    case LayerType::TANH:
+      vtanh(y, y, size);
+      for (size_t i = 0; i < size; i++) dA[i] = 1 - y[i] * y[i];
+      break;
+    default:
+      break;
+  }
+  return Y;
+}
+
+xt::xarray<real_t> FCActLayer::backward(xt::xarray<real_t> DY) {
+  // dZ = DY * act'(Z), computed in DY's own storage, then FC's backward
+  if (DY.shape() != m_output_shape) {
+    throw std::invalid_argument(
+        fmt::format("{:s}: gradient of shape {:s} does not match the output {:s}",
+                    m_sName, shape2str(DY.shape()),
+                    shape2str(m_output_shape)));
+  }
+  real_t* dZ = DY.data();
+  if (m_eActivation == LayerType::RELU) {
+    relu_backward(m_aMask.data(), dZ, dZ, DY.size());
+    return FCLayer::backward(std::move(DY));
+  }
+  const real_t* dA = m_aCached_dA.data();
+  for (size_t i = 0; i < DY.size(); i++) dZ[i] *= dA[i];
+  return FCLayer::backward(std::move(DY));
+}
+
+void FCActLayer::forward_into(const real_view& X, real_view& Y) {
+  // as forward, but act'(Z) is not stored: backward_into derives it from Y
+  // (ReLU: from the mask, so Y may be overwritten by an in-place layer)
+  FCLayer::forward_into(X, Y);
+  real_t* y = Y.data();
+  size_t size = Y.size();
+  switch (m_eActivation) {
+    case LayerType::RELU:
+      relu_forward(y, y, prepare_mask(size), size);
+      break;
+    case LayerType::SIGMOID:
+      vsigmoid(y, y, size);
+      break;
+    case LayerType::TANH:
+      vtanh(y, y, size);
+      break;
+    default:
+      break;
+  }
+  m_pCached_Y = y;
+}
+
+void FCActLayer::backward_into(real_view& DY, real_view& DX) {
+  // dZ = DY * act'(Z) in DY's buffer
+  const real_t* y = m_pCached_Y;
+  real_t* dZ = DY.data();
+  size_t size = DY.size();
+  switch (m_eActivation) {
+    case LayerType::RELU:
+      relu_backward(m_aMask.data(), dZ, dZ, size);
+      break;
+    case LayerType::SIGMOID:
+      for (size_t i = 0; i < size; i++) dZ[i] *= y[i] * (1 - y[i]);
+      break;
+    case LayerType::TANH:
+      for (size_t i = 0; i < size; i++) dZ[i] *= 1 - y[i] * y[i];
+      break;
+    default:
+      break;
+  }
+  FCLayer::backward_into(DY, DX);
+}
+
+// the mask only grows: a smaller batch uses its first words
+uint64_t* FCActLayer::prepare_mask(size_t size) {
+  size_t nwords = relu_mask_words(size);
+  if (m_aMask.size() < nwords) m_aMask.resize({nwords});
+  return m_aMask.data();
+}
+
+LayerType FCActLayer::get_type() {
+  switch (m_eActivation) {
+    case LayerType::RELU: return LayerType::FC_RELU;
+    case LayerType::SIGMOID: return LayerType::FC_SIGMOID;
+    default: return LayerType::FC_TANH;
+  }
+}
+
+/*
+ * get_desc:
+ *  two lines, one for the FC layer and one for the activation, exactly as
+ *  the unfused pair would be described; MLPClassifier::load fuses them again.
+ */
+string FCActLayer::get_desc() {
+  string desc = FCLayer::get_desc() + "\n" +
+                fmt::format("{:<10s}, {:<15s}:", act_type_name(m_eActivation),
+                            m_sAct_Name);
+  return desc;
+}
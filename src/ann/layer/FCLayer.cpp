@@ -23,18 +23,25 @@
 namespace fs = std::filesystem;
 using namespace std;
 
-FCLayer::FCLayer(int Nin, int Nout, bool use_bias) {
+FCLayer::FCLayer(int Nin, int Nout, bool use_bias)
+    : m_aWeights(make_view(nullptr, {0})), m_aBias(make_view(nullptr, {0})),
+      m_aGrad_W(make_view(nullptr, {0})), m_aGrad_b(make_view(nullptr, {0})) {
   this->m_nNin = Nin;
   this->m_nNout = Nout;
   this->m_bUse_Bias = use_bias;
+  this->m_nMean_rows = 0;
   m_sName = "FC_" + to_string(++m_unLayer_idx);
   m_unSample_Counter = 0;
+  m_pCached_X = nullptr;
+  init_quantization();
 
   init_weights();
 }
 
 FCLayer::FCLayer(string sParams, string filename_w, string filename_b,
-                 string sName) {
+                 string sName)
+    : m_aWeights(make_view(nullptr, {0})), m_aBias(make_view(nullptr, {0})),
+      m_aGrad_W(make_view(nullptr, {0})), m_aGrad_b(make_view(nullptr, {0})) {
   // update name
   if (trim(sName).size() != 0)
     this->m_sName = sName;
@@ -65,7 +72,11 @@ FCLayer::FCLayer(string sParams, string filename_w, string filename_b,
     this->m_nNin = nparams[0];
     this->m_nNout = nparams[1];
     this->m_bUse_Bias = nparams[2];
+    this->m_nMean_rows = 0;
     this->m_unSample_Counter = 0;
+    this->m_pCached_X = nullptr;
+    init_quantization();
+    allocate_params();
 
     bool weight_file_invalid = !fs::exists(filename_w);
     bool bias_file_invalid = m_bUse_Bias && !fs::exists(filename_b);
@@ -78,11 +89,10 @@ FCLayer::FCLayer(string sParams, string filename_w, string filename_b,
       cout << message << endl;
 
       // initialize
-      this->m_aWeights = xt::random::randn<double>({m_nNout, m_nNin});
-      this->m_aGrad_W = xt::zeros<double>({m_nNout, m_nNin});
+      this->m_aWeights = xt::random::randn<real_t>({m_nNout, m_nNin});
     } else {
       // DO LOADING WEIGHTS when the file are valid
-      double_tensor W = xt::load_npy<double>(filename_w);
+      real_tensor W = load_real_npy(filename_w);
       bool valid = (W.dimension() == 2) && (W.shape()[0] == m_nNout) &&
                    (W.shape()[1] == m_nNin);
       if (!valid) {
@@ -91,8 +101,6 @@ FCLayer::FCLayer(string sParams, string filename_w, string filename_b,
             "specification");
       }
       this->m_aWeights = W;
-      this->m_aGrad_W =
-          xt::zeros<double>({m_nNout, m_nNin});  // initialize gradW
     }
     if (bias_file_invalid) {
       // Bias file is not specified correctly => initialize with 0
@@ -100,13 +108,11 @@ FCLayer::FCLayer(string sParams, string filename_w, string filename_b,
           "{:s}: not exist; so initialize biases with 0", filename_b);
       cout << message << endl;
 
-      // initialize
-      this->m_aBias = xt::zeros<double>({m_nNout});
-      this->m_aGrad_b = xt::zeros<double>({m_nNout});
+      // initialize: allocate_params set the biases to 0
     } else {
       // DO LOADING BIAS when the file are valid
       if (m_bUse_Bias) {
-        double_tensor b = xt::load_npy<double>(filename_b);
+        real_tensor b = load_real_npy(filename_b);
         bool valid = (b.dimension() == 1) && (b.shape()[0] == m_nNout);
         if (!valid)
           throw std::runtime_error(
@@ -115,7 +121,6 @@ FCLayer::FCLayer(string sParams, string filename_w, string filename_b,
 
         // loading
         this->m_aBias = b;
-        this->m_aGrad_b = xt::zeros<double>({m_nNout});  // initialize gradW
       }
     }
   } catch (exception& e) {
@@ -133,52 +138,208 @@ FCLayer::FCLayer(string sParams, string filename_w, string filename_b,
   }
 }
 
-void FCLayer::init_weights() {
-  this->m_aWeights = xt::random::randn<double>({m_nNout, m_nNin});
-  this->m_aGrad_W = xt::zeros<double>({m_nNout, m_nNin});
+void FCLayer::allocate_params() {
+  unsigned long nout = m_nNout, nin = m_nNin, nw = nout * nin;
+  m_aParams_store = xt::zeros<real_t>({2 * (nw + nout)});
+  real_t* data = m_aParams_store.data();
+  //assigning a real_view re-points it
+  m_aWeights = make_view(data, {nout, nin});
+  m_aBias = make_view(data + nw, {nout});
+  m_aGrad_W = make_view(data + nw + nout, {nout, nin});
+  m_aGrad_b = make_view(data + 2 * nw + nout, {nout});
+}
 
-  if (m_bUse_Bias) {
-    // this->m_aBias = xt::random::randn<double>({m_nNout});
-    this->m_aBias = xt::zeros<double>({m_nNout});
-    this->m_aGrad_b = xt::zeros<double>({m_nNout});
-  }
+void FCLayer::init_weights() {
+  allocate_params();
+  this->m_aWeights = xt::random::randn<real_t>({m_nNout, m_nNin});
+  // the biases stay 0
 }
 
-FCLayer::FCLayer(const FCLayer& orig) {
+FCLayer::FCLayer(const FCLayer& orig)
+    : m_aWeights(make_view(nullptr, {0})), m_aBias(make_view(nullptr, {0})),
+      m_aGrad_W(make_view(nullptr, {0})), m_aGrad_b(make_view(nullptr, {0})) {
   m_sName = "FC_" + to_string(++m_unLayer_idx);
+  m_nNin = orig.m_nNin;
+  m_nNout = orig.m_nNout;
+  m_bUse_Bias = orig.m_bUse_Bias;
+  m_nMean_rows = 0;
+  m_unSample_Counter = 0;
+  m_pCached_X = nullptr;
+  init_quantization();
+
+  // same values in tensors of its own; the gradients start at 0
+  allocate_params();
+  std::copy(orig.m_aWeights.data(), orig.m_aWeights.data() + orig.m_aWeights.size(), m_aWeights.data());
+  std::copy(orig.m_aBias.data(), orig.m_aBias.data() + orig.m_aBias.size(), m_aBias.data());
 }
 
 FCLayer::~FCLayer() {}
 
-xt::xarray<double> FCLayer::forward(xt::xarray<double> X) {
+xt::xarray<real_t> FCLayer::forward(xt::xarray<real_t> X) {
     // TODO YOUR CODE IS HERE
-    // Cache the input for use in backpropagation
-    m_aCached_X = X;
-    // Perform the forward pass
-    unsigned long last_dim = X.shape().size() - 1;
-    xt::xarray<double> output = xt::linalg::tensordot(X, xt::transpose(m_aWeights), {last_dim}, {0});
-    if (m_bUse_Bias) {
-        output += m_aBias;
+    // Y = X*W^T (+ b): one GEMM reading W transposed in place; all leading
+    // dimensions of X are treated as samples
+    if (X.dimension() == 0 || X.shape().back() != (unsigned long)m_nNin) {
+        throw std::invalid_argument(fmt::format("{:s}: input of shape {:s} does not end with Nin={:d}",
+                m_sName, shape2str(X.shape()), m_nNin));
     }
+    int nrows = X.size() / m_nNin;
+    xt::svector<unsigned long> out_shape(X.shape().begin(), X.shape().end());
+    out_shape.back() = m_nNout;
+    xt::xarray<real_t> output = xt::xarray<real_t>::from_shape(out_shape);
     
+    // Cache the input for use in backpropagation (X is our own copy)
+    m_aCached_X = std::move(X);
+    compute_forward(m_aCached_X.data(), nrows, output.data());
     return output;
 }
-xt::xarray<double> FCLayer::backward(xt::xarray<double> DY) {
+xt::xarray<real_t> FCLayer::backward(xt::xarray<real_t> DY) {
     // TODO YOUR CODE IS HERE
     // Compute the gradients with respect to weights, biases, and inputs
-    m_unSample_Counter += DY.shape()[0];
+    int nrows = DY.size() / m_nNout;
+    xt::svector<unsigned long> dx_shape(DY.shape().begin(), DY.shape().end());
+    dx_shape.back() = m_nNin;
+    xt::xarray<real_t> dX = xt::xarray<real_t>::from_shape(dx_shape);
+    compute_backward(DY.data(), nrows, dX.data());
+    return dX;
+}
+
+int FCLayer::get_output_size(int nin) {
+    if (nin != m_nNin) {
+        throw std::invalid_argument(fmt::format("{:s}: {:d} input columns, expected Nin={:d}",
+                m_sName, nin, m_nNin));
+    }
+    return m_nNout;
+}
+
+void FCLayer::forward_into(const real_view& X, real_view& Y) {
+    bool valid = (X.dimension() == 2) && (X.shape()[1] == (unsigned long)m_nNin) &&
+                 (Y.dimension() == 2) && (Y.shape()[0] == X.shape()[0]) &&
+                 (Y.shape()[1] == (unsigned long)m_nNout);
+    if (!valid) {
+        throw std::invalid_argument(fmt::format("{:s}: forward_into from {:s} to {:s}, expected (n, {:d}) to (n, {:d})",
+                m_sName, shape2str(X.shape()), shape2str(Y.shape()), m_nNin, m_nNout));
+    }
+    compute_forward(X.data(), X.shape()[0], Y.data());
+}
+
+void FCLayer::backward_into(real_view& DY, real_view& DX) {
+    bool valid = (DY.dimension() == 2) && (DY.shape()[1] == (unsigned long)m_nNout) &&
+                 (DX.dimension() == 2) && (DX.shape()[0] == DY.shape()[0]) &&
+                 (DX.shape()[1] == (unsigned long)m_nNin);
+    if (!valid) {
+        throw std::invalid_argument(fmt::format("{:s}: backward_into from {:s} to {:s}, expected (n, {:d}) to (n, {:d})",
+                m_sName, shape2str(DY.shape()), shape2str(DX.shape()), m_nNout, m_nNin));
+    }
+    compute_backward(DY.data(), DY.shape()[0], DX.data());
+}
+
+void FCLayer::compute_forward(const real_t* X, int nrows, real_t* Y) {
+    if (m_bCalibrating) {
+        const real_t* end = X + (long)nrows * m_nNin;
+        for (const real_t* x = X; x < end; x++) m_in_absmax = max(m_in_absmax, std::abs(*x));
+    }
+    if (m_bQuantized && !m_trainable) {
+        compute_forward_s8(X, nrows, Y);
+        return;
+    }
+    real_t beta = 0;
+    if (m_bUse_Bias) {
+        const real_t* b = m_aBias.data();
+        for (int r = 0; r < nrows; r++) {
+            std::copy(b, b + m_nNout, Y + (long)r * m_nNout);
+        }
+        beta = 1;
+    }
+    gemm(false, true, nrows, m_nNout, m_nNin,
+         1, X, m_nNin, m_aWeights.data(), m_nNin,
+         beta, Y, m_nNout);
+    m_pCached_X = X;
+}
 
-    unsigned long last_dim = DY.shape().size() - 1;
-    m_aGrad_W = xt::linalg::tensordot(xt::transpose(DY), m_aCached_X, {last_dim}, {0});
+void FCLayer::compute_backward(const real_t* DY, int nrows, real_t* DX) {
+    if (m_pCached_X == nullptr) {
+        throw std::runtime_error(m_sName + ": backward called before forward");
+    }
+    m_unSample_Counter += nrows;
+
+    // dW = DY^T*X, written into the registered gradient buffer
+    gemm(true, false, m_nNout, m_nNin, nrows,
+         1, DY, m_nNout, m_pCached_X, m_nNin,
+         0, m_aGrad_W.data(), m_nNin);
     
+    // db = mean of DY over the samples (of the whole batch, see set_mean_rows)
     if (m_bUse_Bias) {
-        m_aGrad_b = xt::mean(DY, {0});
+        real_t* db = m_aGrad_b.data();
+        std::fill(db, db + m_nNout, real_t(0));
+        for (int r = 0; r < nrows; r++) {
+            const real_t* dy = DY + (long)r * m_nNout;
+            for (int c = 0; c < m_nNout; c++) db[c] += dy[c];
+        }
+        int ndiv = (m_nMean_rows > 0) ? m_nMean_rows : nrows;
+        for (int c = 0; c < m_nNout; c++) db[c] /= ndiv;
     }
     
     // Compute the gradient with respect to the input (for backpropagation to the previous layer)
-    xt::xarray<double> dX = xt::linalg::tensordot(DY, m_aWeights, {last_dim}, {0});
-    
-    return dX;
+    gemm(false, false, nrows, m_nNin, m_nNout,
+         1, DY, m_nNout, m_aWeights.data(), m_nNin,
+         0, DX, m_nNin);
+}
+
+void FCLayer::init_quantization() {
+    m_bCalibrating = false;
+    m_bQuantized = false;
+    m_in_absmax = 0;
+    m_in_scale = 1;
+}
+
+void FCLayer::begin_calibration() {
+    dequantize();
+    m_bCalibrating = true;
+    m_in_absmax = 0;
+}
+
+void FCLayer::quantize() {
+    if (!m_bCalibrating) {
+        throw std::runtime_error(m_sName + ": quantize called without begin_calibration");
+    }
+    m_bCalibrating = false;
+    //symmetric ranges; a zero range (e.g., an all-zero row) keeps scale 1
+    m_in_scale = (m_in_absmax > 0) ? m_in_absmax / 127 : 1;
+    xt::xarray<int8_t> W_q = xt::xarray<int8_t>::from_shape({(unsigned long)m_nNout, (unsigned long)m_nNin});
+    m_aOut_scale = xt::xarray<real_t>::from_shape({(unsigned long)m_nNout});
+    for (int r = 0; r < m_nNout; r++) {
+        const real_t* w = m_aWeights.data() + (long)r * m_nNin;
+        real_t absmax = 0;
+        for (int c = 0; c < m_nNin; c++) absmax = max(absmax, std::abs(w[c]));
+        real_t w_scale = (absmax > 0) ? absmax / 127 : 1;
+        quantize_s8(w, W_q.data() + (long)r * m_nNin, m_nNin, w_scale);
+        m_aOut_scale(r) = m_in_scale * w_scale;
+    }
+    m_aWeights_q.resize({(unsigned long)gemm_s8_pack_size(m_nNout, m_nNin)});
+    gemm_s8_pack(m_nNout, m_nNin, W_q.data(), m_nNin, m_aWeights_q.data());
+    m_bQuantized = true;
+}
+
+void FCLayer::dequantize() {
+    m_bQuantized = false;
+    m_bCalibrating = false;
+    m_aWeights_q = xt::xarray<int8_t>();
+    m_aX_q = xt::xarray<int8_t>();
+    m_aAcc = xt::xarray<int32_t>();
+}
+
+// Y = (X_q*W_q^T)*out_scale (+ b): int8 products, exact int32 sums
+void FCLayer::compute_forward_s8(const real_t* X, int nrows, real_t* Y) {
+    size_t nx = (size_t)nrows * m_nNin, ny = (size_t)nrows * m_nNout;
+    if (m_aX_q.size() < nx) m_aX_q.resize({nx});
+    if (m_aAcc.size() < ny) m_aAcc.resize({ny});
+    quantize_s8(X, m_aX_q.data(), nx, m_in_scale);
+    gemm_s8_packed(nrows, m_nNout, m_nNin, m_aX_q.data(), m_nNin,
+                   m_aWeights_q.data(), m_aAcc.data(), m_nNout);
+    dequantize_s32(nrows, m_nNout, m_aAcc.data(), m_nNout, m_aOut_scale.data(),
+                   m_bUse_Bias ? m_aBias.data() : nullptr, Y, m_nNout);
+    m_pCached_X = X;
 }
 
 int FCLayer::register_params(IParamGroup* ptr_group) {
@@ -226,6 +387,7 @@ void FCLayer::save(string model_path) {
  */
 void FCLayer::load(string model_path, string layer_name) {
   layer_name = trim(layer_name);
+  dequantize();
 
   string filename_w, filename_b;
   if (layer_name.size() == 0) {
@@ -239,23 +401,36 @@ void FCLayer::load(string model_path, string layer_name) {
   try {
     if (fs::exists(filename_w)) {
       // DO LOADING from the file
-      m_aWeights = xt::load_npy<double>(filename_w);
-      m_nNin = m_aWeights.shape()[1];
-      m_nNout = m_aWeights.shape()[0];
-      m_aGrad_W = xt::zeros<double>({m_nNout, m_nNin});
+      real_tensor W = load_real_npy(filename_w);
+      if (W.dimension() != 2) {
+        throw std::runtime_error(
+            fmt::format("{:s}: weights must be 2D", filename_w));
+      }
+      // same shape: in place (the layer stays in its ParamBuffer, if any);
+      // else new tensors, to register again (compile)
+      if (W.shape() != m_aWeights.shape()) {
+        m_nNin = W.shape()[1];
+        m_nNout = W.shape()[0];
+        allocate_params();
+      }
+      m_aWeights = W;
+      m_aGrad_W.fill(0);
     } else {
       string message =
           fmt::format("{:s}: weight-file does not exist.", filename_w);
       throw std::runtime_error(message);
     }
     if (fs::exists(filename_b)) {
-      m_aBias = xt::load_npy<double>(filename_b);
-      if (m_aBias.shape()[0] != m_nNout) {
-        throw "Number of values in m_aBias must be the same as Nout.";
+      real_tensor b = load_real_npy(filename_b);
+      if (b.shape() != m_aBias.shape()) {
+        throw std::runtime_error(
+            "Number of values in m_aBias must be the same as Nout.");
       }
-      m_aGrad_b = xt::zeros<double>({m_nNout});
+      m_aBias = b;
+      m_aGrad_b.fill(0);
       m_bUse_Bias = true;
     } else {
+      m_aBias.fill(0);
       m_bUse_Bias = false;
     }
 
@@ -24,3 +24,21 @@ ILayer::~ILayer() {
 
 unsigned long long ILayer::m_unLayer_idx =0;
 
+ILayer* ILayer::replicate(){
+    unsigned long long idx = m_unLayer_idx;
+    ILayer* pCopy = copy();
+    m_unLayer_idx = idx; //the copy constructor took a default name
+    if(pCopy != nullptr){
+        pCopy->m_sName = m_sName;
+        pCopy->set_working_mode(m_trainable);
+    }
+    return pCopy;
+}
+
+void ILayer::forward_into(const real_view& X, real_view& Y){
+    Y = forward(real_tensor(X));
+}
+
+void ILayer::backward_into(real_view& DY, real_view& DX){
+    DX = backward(real_tensor(DY));
+}
@@ -14,28 +14,67 @@
 #include "sformat/fmt_lib.h"
 #include "ann/functions.h"
 
-ReLU::ReLU(string name) {
+ReLU::ReLU(string name, bool in_place) {
     if(trim(name).size() != 0) m_sName = name;
     else m_sName = "ReLU_" + to_string(++m_unLayer_idx);
+    m_bIn_place = in_place;
 }
 
 ReLU::ReLU(const ReLU& orig) {
     m_sName = "ReLU_" + to_string(++m_unLayer_idx);
+    m_bIn_place = orig.m_bIn_place;
 }
 
 ReLU::~ReLU() {
 }
 
-xt::xarray<double> ReLU::forward(xt::xarray<double> X) {
+//the mask only grows: a smaller batch uses its first words
+uint64_t* ReLU::prepare_mask(const xt::svector<unsigned long>& shape, size_t size){
+    size_t nwords = relu_mask_words(size);
+    if(m_aMask.size() < nwords) m_aMask.resize({nwords});
+    m_mask_shape = shape;
+    return m_aMask.data();
+}
+void ReLU::check_mask(const xt::svector<unsigned long>& shape){
+    if(shape != m_mask_shape){
+        throw std::invalid_argument(fmt::format("{:s}: gradient of shape {:s} does not match the output {:s}",
+                m_sName, shape2str(shape), shape2str(m_mask_shape)));
+    }
+}
+
+xt::xarray<real_t> ReLU::forward(xt::xarray<real_t> X) {
     //YOUR CODE IS HERE
-    m_aMask = X >= 0;
-    xt::xarray<double> Y = xt::maximum(xt::cast<double>(m_aMask) * X, 0.0);
+    uint64_t* mask = prepare_mask(X.shape(), X.size());
+    if(m_bIn_place){
+        relu_forward(X.data(), X.data(), mask, X.size());
+        return X;
+    }
+    xt::xarray<real_t> Y = xt::empty<real_t>(X.shape());
+    relu_forward(X.data(), Y.data(), mask, X.size());
     return Y;
 }
-xt::xarray<double> ReLU::backward(xt::xarray<double> DY) {
+xt::xarray<real_t> ReLU::backward(xt::xarray<real_t> DY) {
     //YOUR CODE IS HERE
-    xt::xarray<double> DX = xt::cast<double>(m_aMask) * DY;
-    return DX;
+    check_mask(DY.shape());
+    relu_backward(m_aMask.data(), DY.data(), DY.data(), DY.size());
+    return DY;
+}
+
+void ReLU::forward_into(const real_view& X, real_view& Y) {
+    if (X.shape() != Y.shape()) {
+        throw std::invalid_argument(fmt::format("{:s}: forward_into from {:s} to {:s}",
+                m_sName, shape2str(X.shape()), shape2str(Y.shape())));
+    }
+    uint64_t* mask = prepare_mask(X.shape(), X.size());
+    relu_forward(X.data(), Y.data(), mask, X.size()); //Y may be X (in place)
+}
+void ReLU::backward_into(real_view& DY, real_view& DX) {
+    if (DY.shape() != DX.shape()) {
+        throw std::invalid_argument(fmt::format("{:s}: backward_into from {:s} to {:s}",
+                m_sName, shape2str(DY.shape()), shape2str(DX.shape())));
+    }
+    check_mask(DY.shape());
+    relu_backward(m_aMask.data(), DY.data(), DX.data(), DY.size());
 }
 
 string ReLU::get_desc(){
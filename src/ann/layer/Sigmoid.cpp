@@ -17,25 +17,49 @@
 Sigmoid::Sigmoid(string name) {
     if(trim(name).size() != 0) m_sName = name;
     else m_sName = "Sigmoid_" + to_string(++m_unLayer_idx);
+    m_pCached_Y = nullptr;
 }
 
 Sigmoid::Sigmoid(const Sigmoid& orig) {
     m_sName = "Sigmoid_" + to_string(++m_unLayer_idx);
+    m_pCached_Y = nullptr;
 }
 
 Sigmoid::~Sigmoid() {
 }
-xt::xarray<double> Sigmoid::forward(xt::xarray<double> X) {
+xt::xarray<real_t> Sigmoid::forward(xt::xarray<real_t> X) {
     //YOUR CODE IS HERE
-    m_aCached_Y = 1.0 / (1.0 + xt::exp(-X));
+    m_aCached_Y = xt::xarray<real_t>::from_shape(X.shape());
+    vsigmoid(X.data(), m_aCached_Y.data(), X.size());
     return m_aCached_Y;
 }
-xt::xarray<double> Sigmoid::backward(xt::xarray<double> DY) {
+xt::xarray<real_t> Sigmoid::backward(xt::xarray<real_t> DY) {
     //YOUR CODE IS HERE
-    xt::xarray<double> DX = DY * m_aCached_Y * (1.0 - m_aCached_Y);
+    xt::xarray<real_t> DX = DY * m_aCached_Y * (1.0 - m_aCached_Y);
     return DX;
 }
 
+void Sigmoid::forward_into(const real_view& X, real_view& Y) {
+    if (X.shape() != Y.shape()) {
+        throw std::invalid_argument(fmt::format("{:s}: forward_into from {:s} to {:s}",
+                m_sName, shape2str(X.shape()), shape2str(Y.shape())));
+    }
+    const real_t* x = X.data();
+    real_t* y = Y.data();
+    vsigmoid(x, y, X.size());
+    m_pCached_Y = y;
+}
+void Sigmoid::backward_into(real_view& DY, real_view& DX) {
+    if (DY.shape() != DX.shape()) {
+        throw std::invalid_argument(fmt::format("{:s}: backward_into from {:s} to {:s}",
+                m_sName, shape2str(DY.shape()), shape2str(DX.shape())));
+    }
+    const real_t* y = m_pCached_Y;
+    const real_t* dy = DY.data();
+    real_t* dx = DX.data();
+    for (size_t i = 0; i < DY.size(); i++) dx[i] = dy[i] * y[i] * (1 - y[i]);
+}
+
 string Sigmoid::get_desc(){
     string desc = fmt::format("{:<10s}, {:<15s}:",
                     "Sigmoid", this->getname());
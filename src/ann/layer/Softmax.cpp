@@ -19,25 +19,69 @@ namespace fs = std::filesystem;
 Softmax::Softmax(int axis, string name): m_nAxis(axis) {
     if(trim(name).size() != 0) m_sName = name;
     else m_sName = "Softmax_" + to_string(++m_unLayer_idx);
+    m_pCached_Y = nullptr;
 }
 
-Softmax::Softmax(const Softmax& orig) {
+Softmax::Softmax(const Softmax& orig): m_nAxis(orig.m_nAxis) {
+    m_sName = "Softmax_" + to_string(++m_unLayer_idx);
+    m_pCached_Y = nullptr;
 }
 
 Softmax::~Softmax() {
 }
 
-xt::xarray<double> Softmax::forward(xt::xarray<double> X) {
+xt::xarray<real_t> Softmax::forward(xt::xarray<real_t> X) {
     //YOUR CODE IS HERE
     m_aCached_Y = softmax(X, m_nAxis);
     return m_aCached_Y;
 }
-xt::xarray<double> Softmax::backward(xt::xarray<double> DY) {
+xt::xarray<real_t> Softmax::backward(xt::xarray<real_t> DY) {
     //YOUR CODE IS HERE
-    auto diag_y = xt::diag(m_aCached_Y);
-    auto jacobian = diag_y - xt::linalg::outer(m_aCached_Y, m_aCached_Y);
-    auto DZ = xt::linalg::dot(jacobian, DY);
-    return DZ;
+    // DX = Y*(DY - sum(DY*Y)) along the softmax axis: the Jacobian-vector
+    // product of each row, in O(N*C); no N*C x N*C Jacobian is built
+    if (DY.shape() != m_aCached_Y.shape()) {
+        throw std::invalid_argument(fmt::format("{:s}: gradient of shape {:s} does not match the output {:s}",
+                m_sName, shape2str(DY.shape()), shape2str(m_aCached_Y.shape())));
+    }
+    int axis = positive_index(m_nAxis, DY.dimension());
+    if (axis != (int)DY.dimension() - 1) {
+        xt::xarray<real_t> dot = xt::sum(DY * m_aCached_Y, {axis}, xt::keep_dims);
+        xt::xarray<real_t> DX = m_aCached_Y * (DY - dot);
+        return DX;
+    }
+    int ncols = DY.shape().back();
+    int nrows = DY.size() / ncols;
+    // DY is our own copy: DX is written over it
+    softmax_backward_rows(m_aCached_Y.data(), DY.data(), DY.data(), nrows, ncols);
+    return DY;
+}
+
+/*
+ * forward_into, backward_into: softmax over the last axis of a 2D batch, row
+ * by row; any other axis goes through forward/backward.
+ */
+void Softmax::forward_into(const real_view& X, real_view& Y) {
+    if (X.dimension() != 2 || positive_index(m_nAxis, 2) != 1) {
+        ILayer::forward_into(X, Y);
+        return;
+    }
+    if (X.shape() != Y.shape()) {
+        throw std::invalid_argument(fmt::format("{:s}: forward_into from {:s} to {:s}",
+                m_sName, shape2str(X.shape()), shape2str(Y.shape())));
+    }
+    softmax_rows(X.data(), Y.data(), X.shape()[0], X.shape()[1]);
+    m_pCached_Y = Y.data();
+}
+void Softmax::backward_into(real_view& DY, real_view& DX) {
+    if (DY.dimension() != 2 || positive_index(m_nAxis, 2) != 1) {
+        ILayer::backward_into(DY, DX);
+        return;
+    }
+    if (DY.shape() != DX.shape()) {
+        throw std::invalid_argument(fmt::format("{:s}: backward_into from {:s} to {:s}",
+                m_sName, shape2str(DY.shape()), shape2str(DX.shape())));
+    }
+    softmax_backward_rows(m_pCached_Y, DY.data(), DX.data(), DY.shape()[0], DY.shape()[1]);
 }
 
 string Softmax::get_desc(){
@@ -17,21 +17,21 @@
 Tanh::Tanh(string name) {
     if(trim(name).size() != 0) m_sName = name;
     else m_sName = "Tanh_" + to_string(++m_unLayer_idx);
+    m_pCached_Y = nullptr;
 }
 
 Tanh::Tanh(const Tanh& orig) {
     m_sName = "Tanh_" + to_string(++m_unLayer_idx);
+    m_pCached_Y = nullptr;
 }
 
 Tanh::~Tanh() {
 }
 
-xt::xarray<double> Tanh::forward(xt::xarray<double> X) {
+xt::xarray<real_t> Tanh::forward(xt::xarray<real_t> X) {
     // Apply the tanh activation function: Y = tanh(X)
-    xt::xarray<double> Y = xt::xarray<double>::from_shape(X.shape());
-    for (size_t i = 0; i < X.size(); ++i) {
-        Y.flat(i) = std::tanh(X.flat(i)); // Element-wise tanh calculation
-    }
+    xt::xarray<real_t> Y = xt::xarray<real_t>::from_shape(X.shape());
+    vtanh(X.data(), Y.data(), X.size()); // Element-wise tanh, vectorized
     
     // Cache the result for backward pass
     m_aCached_Y = Y;
@@ -39,18 +39,39 @@ xt::xarray<double> Tanh::forward(xt::xarray<double> X) {
     return Y;
 }
 
-xt::xarray<double> Tanh::backward(xt::xarray<double> DY) {
+xt::xarray<real_t> Tanh::backward(xt::xarray<real_t> DY) {
     // The derivative of tanh: dY/dX = 1 - tanh(X)^2
-    xt::xarray<double> DX = xt::xarray<double>::from_shape(DY.shape());
+    xt::xarray<real_t> DX = xt::xarray<real_t>::from_shape(DY.shape());
     
     for (size_t i = 0; i < m_aCached_Y.size(); ++i) {
-        double tanh_val = m_aCached_Y.flat(i);
+        real_t tanh_val = m_aCached_Y.flat(i);
         DX.flat(i) = DY.flat(i) * (1.0 - tanh_val * tanh_val); // Chain rule: DY * dY/dX
     }
     
     return DX;
 }
 
+void Tanh::forward_into(const real_view& X, real_view& Y) {
+    if (X.shape() != Y.shape()) {
+        throw std::invalid_argument(fmt::format("{:s}: forward_into from {:s} to {:s}",
+                m_sName, shape2str(X.shape()), shape2str(Y.shape())));
+    }
+    const real_t* x = X.data();
+    real_t* y = Y.data();
+    vtanh(x, y, X.size());
+    m_pCached_Y = y;
+}
+void Tanh::backward_into(real_view& DY, real_view& DX) {
+    if (DY.shape() != DX.shape()) {
+        throw std::invalid_argument(fmt::format("{:s}: backward_into from {:s} to {:s}",
+                m_sName, shape2str(DY.shape()), shape2str(DX.shape())));
+    }
+    const real_t* y = m_pCached_Y;
+    const real_t* dy = DY.data();
+    real_t* dx = DX.data();
+    for (size_t i = 0; i < DY.size(); i++) dx[i] = dy[i] * (1 - y[i] * y[i]);
+}
+
 string Tanh::get_desc(){
     string desc = fmt::format("{:<10s}, {:<15s}:",
                     "Tanh", this->getname());
@@ -12,19 +12,21 @@
 
 #include "loss/CrossEntropy.h"
 #include "ann/functions.h"
+#include "sformat/fmt_lib.h"
 
-CrossEntropy::CrossEntropy(LossReduction reduction): ILossLayer(reduction){
+CrossEntropy::CrossEntropy(LossReduction reduction): ILossLayer(reduction),
+    m_pYpred(nullptr), m_pYtarget(nullptr), m_pLabels(nullptr), m_nRows(0), m_nCols(0){
     
 }
 
 CrossEntropy::CrossEntropy(const CrossEntropy& orig):
-ILossLayer(orig){
+ILossLayer(orig), m_pYpred(nullptr), m_pYtarget(nullptr), m_pLabels(nullptr), m_nRows(0), m_nCols(0){
 }
 
 CrossEntropy::~CrossEntropy() {
 }
 
-double CrossEntropy::forward(xt::xarray<double> X, xt::xarray<double> t){
+double CrossEntropy::forward(xt::xarray<real_t> X, xt::xarray<real_t> t){
     //YOUR CODE IS HERE
     m_aCached_Ypred = X; 
     m_aYtarget = t;
@@ -34,10 +36,64 @@ double CrossEntropy::forward(xt::xarray<double> X, xt::xarray<double> t){
     }
     return loss();
 }
-xt::xarray<double> CrossEntropy::backward() {
-    xt::xarray<double> grad = -m_aYtarget / (m_aCached_Ypred + 1e-7);
+xt::xarray<real_t> CrossEntropy::backward() {
+    xt::xarray<real_t> grad = -m_aYtarget / (m_aCached_Ypred + 1e-7);
     if (m_eReduction == REDUCE_MEAN) {
         return grad / m_aCached_Ypred.shape()[0];
     }
     return grad;
-}
\ No newline at end of file
+}
+
+double CrossEntropy::forward_into(const real_view& X, const real_tensor& t){
+    if(X.dimension() != 2 || X.shape() != t.shape()){
+        throw std::invalid_argument(fmt::format("CrossEntropy: prediction {:s} and target {:s} must be the same 2D shape",
+                shape2str(X.shape()), shape2str(t.shape())));
+    }
+    m_pYpred = X.data();
+    m_pYtarget = t.data();
+    m_pLabels = nullptr;
+    m_nRows = X.shape()[0];
+    m_nCols = X.shape()[1];
+    double loss = 0;
+    for(unsigned long i=0; i < X.size(); i++){
+        if(m_pYtarget[i] != 0) loss -= m_pYtarget[i]*std::log(m_pYpred[i] + 1e-7);
+    }
+    if (m_eReduction == REDUCE_MEAN) return loss/m_nRows;
+    return loss;
+}
+
+//sparse targets: only the predicted probability of the true class counts
+double CrossEntropy::forward_into(const real_view& X, const ulong_tensor& labels){
+    check_labels("CrossEntropy", X, labels);
+    m_pYpred = X.data();
+    m_pYtarget = nullptr;
+    m_pLabels = labels.data();
+    m_nRows = X.shape()[0];
+    m_nCols = X.shape()[1];
+    double loss = 0;
+    for(unsigned long r=0; r < m_nRows; r++){
+        loss -= std::log(m_pYpred[r*m_nCols + m_pLabels[r]] + 1e-7);
+    }
+    if (m_eReduction == REDUCE_MEAN) return loss/m_nRows;
+    return loss;
+}
+
+void CrossEntropy::backward_into(real_view& DX){
+    if(DX.size() != m_nRows*m_nCols){
+        throw std::invalid_argument(fmt::format("CrossEntropy: gradient buffer {:s} does not match ({:d}, {:d})",
+                shape2str(DX.shape()), m_nRows, m_nCols));
+    }
+    real_t scale = (m_eReduction == REDUCE_MEAN) ? real_t(1)/m_nRows : real_t(1);
+    real_t* dx = DX.data();
+    if(m_pLabels != nullptr){
+        std::fill(dx, dx + DX.size(), real_t(0));
+        for(unsigned long r=0; r < m_nRows; r++){
+            unsigned long i = r*m_nCols + m_pLabels[r];
+            dx[i] = -scale/(m_pYpred[i] + real_t(1e-7));
+        }
+        return;
+    }
+    for(unsigned long i=0; i < DX.size(); i++){
+        dx[i] = -scale*m_pYtarget[i]/(m_pYpred[i] + real_t(1e-7));
+    }
+}
@@ -11,6 +11,10 @@
  */
 
 #include "loss/ILossLayer.h"
+#include "loss/CrossEntropy.h"
+#include "loss/SoftmaxCrossEntropy.h"
+#include "ann/functions.h"
+#include "sformat/fmt_lib.h"
 
 ILossLayer::ILossLayer(LossReduction reduction):
 m_eReduction(reduction) {
@@ -23,3 +27,38 @@ m_eReduction(orig.m_eReduction){
 ILossLayer::~ILossLayer() {
 }
 
+double ILossLayer::forward_into(const real_view& X, const real_tensor& t){
+    return forward(real_tensor(X), t);
+}
+
+double ILossLayer::forward_into(const real_view& X, const ulong_tensor& labels){
+    check_labels(get_name(), X, labels);
+    m_aSparse_Target = onehot_enc(labels, X.shape()[1]);
+    return forward_into(X, m_aSparse_Target);
+}
+
+void ILossLayer::backward_into(real_view& DX){
+    DX = backward();
+}
+
+void ILossLayer::check_labels(string loss_name, const real_view& X, const ulong_tensor& labels){
+    if(X.dimension() != 2 || labels.dimension() != 1 || labels.shape()[0] != X.shape()[0]){
+        throw std::invalid_argument(fmt::format("{:s}: prediction {:s} and labels {:s} must be (N, C) and (N,)",
+                loss_name, shape2str(X.shape()), shape2str(labels.shape())));
+    }
+    unsigned long ncols = X.shape()[1];
+    const ulong* y = labels.data();
+    for(unsigned long r=0; r < labels.size(); r++){
+        if(y[r] >= ncols){
+            throw std::out_of_range(fmt::format("{:s}: label {:d} of row {:d} is not in [0, {:d})",
+                    loss_name, y[r], r, ncols));
+        }
+    }
+}
+
+ILossLayer* create_loss_layer(string name, LossReduction reduction){
+    name = trim(name);
+    if(name == "CrossEntropy") return new CrossEntropy(reduction);
+    if(name == "SoftmaxCrossEntropy") return new SoftmaxCrossEntropy(reduction);
+    throw std::invalid_argument("create_loss_layer: unknown loss '" + name + "'");
+}
@@ -0,0 +1,124 @@
+/*
+ * File:   SoftmaxCrossEntropy.cpp
+ * Purpose: softmax and cross-entropy fused into one loss on logits
+ */
+
+#include "loss/SoftmaxCrossEntropy.h"
+#include "ann/functions.h"
+#include "sformat/fmt_lib.h"
+#include <cmath>
+
+SoftmaxCrossEntropy::SoftmaxCrossEntropy(LossReduction reduction): ILossLayer(reduction),
+    m_pYtarget(nullptr), m_pLabels(nullptr), m_nRows(0), m_nCols(0){
+}
+
+SoftmaxCrossEntropy::SoftmaxCrossEntropy(const SoftmaxCrossEntropy& orig): ILossLayer(orig),
+    m_pYtarget(nullptr), m_pLabels(nullptr), m_nRows(0), m_nCols(0){
+}
+
+SoftmaxCrossEntropy::~SoftmaxCrossEntropy(){
+}
+
+double SoftmaxCrossEntropy::forward(xt::xarray<real_t> X, xt::xarray<real_t> t){
+    if(X.dimension() != 2 || X.shape() != t.shape()){
+        throw std::invalid_argument(fmt::format("SoftmaxCrossEntropy: logits {:s} and target {:s} must be the same 2D shape",
+                shape2str(X.shape()), shape2str(t.shape())));
+    }
+    m_aYtarget = std::move(t);
+    return compute(X.data(), m_aYtarget.data(), nullptr, X.shape()[0], X.shape()[1]);
+}
+
+xt::xarray<real_t> SoftmaxCrossEntropy::backward(){
+    xt::xarray<real_t> DX = xt::xarray<real_t>::from_shape({m_nRows, m_nCols});
+    gradient(DX.data());
+    return DX;
+}
+
+double SoftmaxCrossEntropy::forward_into(const real_view& X, const real_tensor& t){
+    if(X.dimension() != 2 || X.shape() != t.shape()){
+        throw std::invalid_argument(fmt::format("SoftmaxCrossEntropy: logits {:s} and target {:s} must be the same 2D shape",
+                shape2str(X.shape()), shape2str(t.shape())));
+    }
+    return compute(X.data(), t.data(), nullptr, X.shape()[0], X.shape()[1]);
+}
+
+double SoftmaxCrossEntropy::forward_into(const real_view& X, const ulong_tensor& labels){
+    check_labels("SoftmaxCrossEntropy", X, labels);
+    return compute(X.data(), nullptr, labels.data(), X.shape()[0], X.shape()[1]);
+}
+
+void SoftmaxCrossEntropy::backward_into(real_view& DX){
+    if(DX.size() != m_nRows*m_nCols){
+        throw std::invalid_argument(fmt::format("SoftmaxCrossEntropy: gradient buffer {:s} does not match ({:d}, {:d})",
+                shape2str(DX.shape()), m_nRows, m_nCols));
+    }
+    gradient(DX.data());
+}
+
+/*
+ * compute: exp(x - max) for the whole batch in one vexp (kept as the softmax
+ * for the gradient), then the sums; loss_r = log(sum exp(x - max)) + max*sum(t)
+ * - <t, x>, which is -<t, log softmax(x)> without taking any log of a
+ * probability. For sparse labels, sum(t) = 1 and <t, x> = x[label].
+ */
+double SoftmaxCrossEntropy::compute(const real_t* X, const real_t* t, const ulong* labels,
+        unsigned long nrows, unsigned long ncols){
+    m_pYtarget = t;
+    m_pLabels = labels;
+    m_nRows = nrows;
+    m_nCols = ncols;
+    if(m_aProb.size() < nrows*ncols) m_aProb.resize({nrows*ncols});
+    real_t* P = m_aProb.data();
+
+    //P = exp(X - rowmax(X)) with one vexp over the batch
+    for(unsigned long r=0; r < nrows; r++){
+        const real_t* x = X + r*ncols;
+        real_t* p = P + r*ncols;
+        real_t xmax = x[0];
+        for(unsigned long c=1; c < ncols; c++) xmax = std::max(xmax, x[c]);
+        for(unsigned long c=0; c < ncols; c++) p[c] = x[c] - xmax;
+    }
+    vexp(P, P, nrows*ncols);
+    
+    double loss = 0;
+    for(unsigned long r=0; r < nrows; r++){
+        const real_t* x = X + r*ncols;
+        real_t* p = P + r*ncols;
+        real_t xmax = x[0];
+        for(unsigned long c=1; c < ncols; c++) xmax = std::max(xmax, x[c]);
+        real_t sum = 0, tsum = 0, tx = 0;
+        for(unsigned long c=0; c < ncols; c++) sum += p[c];
+        if(t != nullptr){
+            const real_t* tr = t + r*ncols;
+            for(unsigned long c=0; c < ncols; c++){
+                tsum += tr[c];
+                tx += tr[c]*x[c];
+            }
+        }
+        else{
+            tsum = 1;
+            tx = x[labels[r]];
+        }
+        real_t inv = 1/sum;
+        for(unsigned long c=0; c < ncols; c++) p[c] *= inv;
+        loss += double(tsum)*(std::log(double(sum)) + xmax) - tx;
+    }
+    if(m_eReduction == REDUCE_MEAN) return loss/nrows;
+    return loss;
+}
+
+void SoftmaxCrossEntropy::gradient(real_t* DX){
+    if(m_pYtarget == nullptr && m_pLabels == nullptr){
+        throw std::runtime_error("SoftmaxCrossEntropy: backward called before forward");
+    }
+    real_t scale = (m_eReduction == REDUCE_MEAN) ? real_t(1)/m_nRows : real_t(1);
+    const real_t* P = m_aProb.data();
+    if(m_pLabels != nullptr){
+        for(unsigned long i=0; i < m_nRows*m_nCols; i++) DX[i] = scale*P[i];
+        for(unsigned long r=0; r < m_nRows; r++) DX[r*m_nCols + m_pLabels[r]] -= scale;
+        return;
+    }
+    for(unsigned long i=0; i < m_nRows*m_nCols; i++){
+        DX[i] = scale*(P[i] - m_pYtarget[i]);
+    }
+}
@@ -33,4 +33,7 @@ void ClassMetrics::reset_metrics(){
 }
 double_tensor ClassMetrics::calculate_metrics(double_tensor y_true, double_tensor y_pred){
     return calc_classifcation_metrics(y_true, y_pred, m_nOutputs);
+}
+double_tensor ClassMetrics::calculate_metrics(const ulong_tensor& y_true, const ulong_tensor& y_pred){
+    return calc_classifcation_metrics(y_true, y_pred, m_nOutputs);
 }
\ No newline at end of file
@@ -33,3 +33,15 @@ void IMetrics::accumulate(double_tensor y_true, double_tensor y_pred){
     //cout << "bcc: " << calc_metrics(y_true, y_pred) << endl;
     //cout << "acc: " << m_train_metrics << endl;
 }
+
+void IMetrics::accumulate(const ulong_tensor& y_true, const ulong_tensor& y_pred){
+    ulong prev_nsamples = m_sample_counter;
+    ulong batch_size = y_true.shape()[0];
+    m_sample_counter += batch_size;
+    m_metrics = prev_nsamples*m_metrics + batch_size*calculate_metrics(y_true, y_pred);
+    m_metrics = m_metrics/m_sample_counter;
+}
+
+double_tensor IMetrics::calculate_metrics(const ulong_tensor& y_true, const ulong_tensor& y_pred){
+    return calculate_metrics(double_tensor(xt::cast<double>(y_true)), double_tensor(xt::cast<double>(y_pred)));
+}
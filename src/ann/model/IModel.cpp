@@ -5,10 +5,19 @@
 
 #include "model/IModel.h"
 #include "config/Config.h"
+#include "ann/functions.h"
 #include "sformat/fmt_lib.h"
+#include "optim/SGD.h"
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <vector>
 
 IModel::IModel(string cfg_filename, string sModelName): 
-    m_cfg_filename(cfg_filename), m_sModelName(sModelName){
+    m_trainable(false), m_sModelName(sModelName), m_cfg_filename(cfg_filename),
+    m_pOptimizer(nullptr), m_pLossLayer(nullptr), m_pMetricLayer(nullptr),
+    m_pTrainLoader(nullptr), m_pValidLoader(nullptr),
+    m_pSparseTrainLoader(nullptr), m_pSparseValidLoader(nullptr){
     //Create configuration object
     m_pConfig = new Config(cfg_filename);
 }
@@ -17,8 +26,23 @@ IModel::~IModel(){
     if(m_pConfig != nullptr) delete m_pConfig;
 }
 
-void IModel::fit(DataLoader<double, double>* pTrainLoader,
-         DataLoader<double, double>* pValidLoader,
+void IModel::fit(DataLoader<real_t, real_t>* pTrainLoader,
+         DataLoader<real_t, real_t>* pValidLoader,
+         unsigned int nepoch,
+         unsigned int verbose){
+    fit_loop(pTrainLoader, pValidLoader, nepoch, verbose);
+}
+
+void IModel::fit(DataLoader<real_t, ulong>* pTrainLoader,
+         DataLoader<real_t, ulong>* pValidLoader,
+         unsigned int nepoch,
+         unsigned int verbose){
+    fit_loop(pTrainLoader, pValidLoader, nepoch, verbose);
+}
+
+template<typename LType>
+void IModel::fit_loop(DataLoader<real_t, LType>* pTrainLoader,
+         DataLoader<real_t, LType>* pValidLoader,
          unsigned int nepoch,
          unsigned int verbose){
     //
@@ -27,29 +51,30 @@ void IModel::fit(DataLoader<double, double>* pTrainLoader,
     for(int epoch=1; epoch <= nepoch; epoch++){
         on_begin_epoch();
         m_pMetricLayer->reset_metrics();
+        pTrainLoader->set_epoch(epoch); //new order of samples, if it has a sampler
         
-        for(auto batch: *pTrainLoader){
-            double_tensor X = batch.getData();
-            double_tensor t = batch.getLabel();
+        for(auto& batch: *pTrainLoader){
+            //references into the loader's batch: no copy of the input data
+            real_tensor& X = batch.getData();
+            xt::xarray<LType>& t = batch.getLabel();
             on_begin_step(X.shape()[0]);
             
             //(0) Set gradient buffer to zeros
             m_pOptimizer->zero_grad();
 
-            //(1) FORWARD-Pass
-            double_tensor Y = forward(X);
+            //(1) FORWARD-Pass: Y is a view into the model's workspace
+            real_view Y = forward_into(X);
 
             //(2) BACKWARD-Pass
-            double batch_loss = m_pLossLayer->forward(Y, t);
-            backward();
+            double batch_loss = m_pLossLayer->forward_into(Y, t);
+            backward_into();
 
             //(3) UPDATE learnable parameters
             m_pOptimizer->step();
             
             //Record the performance for each batch
-            ulong_tensor y_true = xt::argmax(t, 1);
             ulong_tensor y_pred = xt::argmax(Y, 1);
-            m_pMetricLayer->accumulate(y_true, y_pred);
+            m_pMetricLayer->accumulate(class_indices(t), y_pred);
             
             on_end_step(batch_loss);
         }//for-each batch: end
@@ -58,14 +83,101 @@ void IModel::fit(DataLoader<double, double>* pTrainLoader,
     on_end_training();
 }
 
+void IModel::fit_async(DataLoader<real_t, real_t>* pTrainLoader,
+         DataLoader<real_t, real_t>* pValidLoader,
+         unsigned int nepoch,
+         int nthreads,
+         unsigned int verbose){
+    fit_async_loop(pTrainLoader, pValidLoader, nepoch, nthreads, verbose);
+}
+
+void IModel::fit_async(DataLoader<real_t, ulong>* pTrainLoader,
+         DataLoader<real_t, ulong>* pValidLoader,
+         unsigned int nepoch,
+         int nthreads,
+         unsigned int verbose){
+    fit_async_loop(pTrainLoader, pValidLoader, nepoch, nthreads, verbose);
+}
+
+template<typename LType>
+void IModel::fit_async_loop(DataLoader<real_t, LType>* pTrainLoader,
+         DataLoader<real_t, LType>* pValidLoader,
+         unsigned int nepoch,
+         int nthreads,
+         unsigned int verbose){
+    if(dynamic_cast<SGD*>(m_pOptimizer) == nullptr){
+        throw std::invalid_argument(m_sModelName + ": fit_async: compile the model with an SGD optimizer");
+    }
+    if(nthreads <= 0) nthreads = max(1, (int)thread::hardware_concurrency());
+    double lr = m_pOptimizer->get_learning_rate();
+    on_begin_training(pTrainLoader, pValidLoader, nepoch, verbose);
+    begin_async(nthreads);
+    
+    mutex loader_mutex; //the loader's iterator; the weights take no lock
+    mutex stats_mutex; //metrics and logging
+    exception_ptr error = nullptr;
+    atomic<bool> failed(false);
+    for(int epoch=1; epoch <= nepoch; epoch++){
+        on_begin_epoch();
+        m_pMetricLayer->reset_metrics();
+        pTrainLoader->set_epoch(epoch);
+        auto it = pTrainLoader->begin(), end = pTrainLoader->end();
+        
+        vector<thread> workers;
+        for(int worker=0; worker < nthreads; worker++){
+            workers.push_back(thread([&, worker](){
+                real_tensor X;
+                xt::xarray<LType> t;
+                ulong_tensor y_pred;
+                try{
+                    //the worker is one of nthreads: its products run on it alone
+                    run_serial([&](){
+                        while(!failed){
+                            {
+                                //own copies: the loader may reuse its batch
+                                lock_guard<mutex> lock(loader_mutex);
+                                if(!(it != end)) break;
+                                X = (*it).getData();
+                                t = (*it).getLabel();
+                                ++it;
+                            }
+                            double batch_loss = async_step(worker, X, t, lr, y_pred);
+                            
+                            lock_guard<mutex> lock(stats_mutex);
+                            on_begin_step(X.shape()[0]);
+                            m_pMetricLayer->accumulate(class_indices(t), y_pred);
+                            on_end_step(batch_loss);
+                        }
+                    });
+                }
+                catch(...){
+                    lock_guard<mutex> lock(stats_mutex);
+                    if(!failed) error = current_exception();
+                    failed = true;
+                }
+            }));
+        }
+        for(auto& worker: workers) worker.join();
+        if(failed){
+            end_async();
+            rethrow_exception(error);
+        }
+        on_end_epoch();
+    }//for-epoch: end
+    end_async();
+    on_end_training();
+}
+
 //Method for doing the logging
 void IModel::on_begin_training(
-            DataLoader<double, double>* pTrainLoader,
-            DataLoader<double, double>* pValidLoader,
+            DataLoader<real_t, real_t>* pTrainLoader,
+            DataLoader<real_t, real_t>* pValidLoader,
             unsigned int nepoch,
             int verbose){
     this->m_pTrainLoader = pTrainLoader;
     this->m_pValidLoader = pValidLoader;
+    this->m_pSparseTrainLoader = nullptr;
+    this->m_pSparseValidLoader = nullptr;
     this->m_nepoches = nepoch;
     this->m_verbose = verbose;
     
@@ -73,6 +185,15 @@ void IModel::on_begin_training(
     set_working_mode(true); //to training mode
     cout << "Start the training ..." << endl;
 }
+void IModel::on_begin_training(
+            DataLoader<real_t, ulong>* pTrainLoader,
+            DataLoader<real_t, ulong>* pValidLoader,
+            unsigned int nepoch,
+            int verbose){
+    on_begin_training((DataLoader<real_t, real_t>*)nullptr, nullptr, nepoch, verbose);
+    this->m_pSparseTrainLoader = pTrainLoader;
+    this->m_pSparseValidLoader = pValidLoader;
+}
 void IModel::on_end_training(){
     set_working_mode(false); //to inference mode
     cout << "End the training ..." << endl;
@@ -84,8 +205,10 @@ void IModel::on_begin_epoch(){
     this->m_sample_counter = 0; //reset
 }
 void IModel::on_end_epoch(){
+    if(m_verbose == 0) return;
     cout << "Validation results: " << endl;
-    cout << this->evaluate(m_pValidLoader) << endl;
+    if(m_pSparseValidLoader != nullptr) cout << this->evaluate(m_pSparseValidLoader) << endl;
+    else cout << this->evaluate(m_pValidLoader) << endl;
 }
 void IModel::on_begin_step(int batch_size){
     this->m_current_batch += 1; //the first batch: 1
@@ -95,6 +218,7 @@ void IModel::on_begin_step(int batch_size){
 }
 void IModel::on_end_step(double batch_loss){
     this->m_epoch_loss += m_curent_batch_size * batch_loss;
+    if(m_verbose == 0) return;
     const double_tensor train_metrics = m_pMetricLayer->get_metrics();
     
     string message = fmt::format("{:3d}/{:3d}|{:4d}| {:6.2f} {:6.2f} | {:6.2f}",
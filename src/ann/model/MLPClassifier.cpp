@@ -12,6 +12,7 @@
 
 #include "model/MLPClassifier.h"
 #include "optim/IParamGroup.h"
+#include "optim/SGDParamGroup.h"
 #include "tensor/xtensor_lib.h"
 #include "sformat/fmt_lib.h"
 #include <filesystem> //require C++17
@@ -20,6 +21,7 @@ namespace fs = std::filesystem;
 #include <sstream>
 #include "ann/functions.h"
 #include "layer/FCLayer.h"
+#include "layer/FCActLayer.h"
 #include "layer/ReLU.h"
 #include "layer/Sigmoid.h"
 #include "layer/Tanh.h"
@@ -31,28 +33,38 @@ namespace fs = std::filesystem;
 
 //Constructors and Destructors
 MLPClassifier::MLPClassifier(string cfg_filename, string sModelName):
-    IModel(cfg_filename, sModelName){
+    IModel(cfg_filename, sModelName),
+    m_nWorkspace_nin(0), m_nMax_batch(0), m_nBatch_rows(0), m_pOwned_Loss(nullptr),
+    m_nReplicas(1), m_nSlices(1){
 }
 MLPClassifier::MLPClassifier(
     string cfg_filename, string sModelName,
     ILayer** seq, int size): 
-    IModel(cfg_filename, sModelName){
+    IModel(cfg_filename, sModelName),
+    m_nWorkspace_nin(0), m_nMax_batch(0), m_nBatch_rows(0), m_pOwned_Loss(nullptr),
+    m_nReplicas(1), m_nSlices(1){
     //layer to m_layers:
     for(int idx=0; idx < size; idx++) m_layers.add(seq[idx]);
 }
 
 MLPClassifier::MLPClassifier(const MLPClassifier& orig):
-    IModel(orig.m_cfg_filename, orig.m_sModelName){
+    IModel(orig.m_cfg_filename, orig.m_sModelName),
+    m_nWorkspace_nin(0), m_nMax_batch(orig.m_nMax_batch), m_nBatch_rows(0),
+    m_sLoss_name(orig.m_sLoss_name), m_pOwned_Loss(nullptr),
+    m_nReplicas(orig.m_nReplicas), m_nSlices(1){
     //copy list (in the assignment operator of DLinkedList)
     m_layers = orig.m_layers; 
 }
 
 MLPClassifier::~MLPClassifier() {
+    clear_replicas();
+    end_async();
     for(auto ptr_layer: m_layers) delete ptr_layer;
+    if(m_pOwned_Loss != nullptr) delete m_pOwned_Loss;
 }
 
 //for the inference mode: begin
-double_tensor MLPClassifier::predict(double_tensor X, bool make_decision){
+real_tensor MLPClassifier::predict(real_tensor X, bool make_decision){
     //SWITCH to inference mode
     bool old_mode = this->m_trainable;
     this->set_working_mode(false);
@@ -60,7 +72,7 @@ double_tensor MLPClassifier::predict(double_tensor X, bool make_decision){
     //DO the inference
     
     //YOUR CODE IS HERE
-    double_tensor Y = forward(X);
+    real_tensor Y = forward(X);
     
     //RESTORE the previous mode
     this->set_working_mode(old_mode);
@@ -70,14 +82,35 @@ double_tensor MLPClassifier::predict(double_tensor X, bool make_decision){
     else return xt::argmax(Y, -1);
 }
 
-double_tensor MLPClassifier::predict(
-    DataLoader<double, double>* pLoader,
+real_tensor MLPClassifier::predict(
+    DataLoader<real_t, real_t>* pLoader,
+    bool make_decision){
+    return predict_loader(pLoader, make_decision);
+}
+
+real_tensor MLPClassifier::predict(
+    DataLoader<real_t, ulong>* pLoader,
+    bool make_decision){
+    return predict_loader(pLoader, make_decision);
+}
+
+double_tensor MLPClassifier::evaluate(DataLoader<real_t, real_t>* pLoader){
+    return evaluate_loader(pLoader);
+}
+
+double_tensor MLPClassifier::evaluate(DataLoader<real_t, ulong>* pLoader){
+    return evaluate_loader(pLoader);
+}
+
+template<typename LType>
+real_tensor MLPClassifier::predict_loader(
+    DataLoader<real_t, LType>* pLoader,
     bool make_decision){
 
     bool old_mode = this->m_trainable;
     this->set_working_mode(false);
     
-    double_tensor results;
+    real_tensor results;
     bool first_batch = true;
     
     cout << "Prediction: Started" << endl;
@@ -88,10 +121,10 @@ double_tensor MLPClassifier::predict(
     int total_batch = pLoader->get_total_batch(); 
     int batch_idx = 1;
     unsigned long long nsamples = 0;
-    for(auto batch: *pLoader){
+    for(auto& batch: *pLoader){
         //YOUR CODE IS HERE
-        double_tensor X = batch.getData();
-        double_tensor Y = forward(X);
+        real_tensor& X = batch.getData();
+        real_tensor Y = forward(X);
         if (first_batch) {
             results = Y; // Initialize results with the first batch
             first_batch = false;
@@ -112,7 +145,8 @@ double_tensor MLPClassifier::predict(
 }
 
 
-double_tensor MLPClassifier::evaluate(DataLoader<double, double>* pLoader){
+template<typename LType>
+double_tensor MLPClassifier::evaluate_loader(DataLoader<real_t, LType>* pLoader){
     bool old_mode = this->m_trainable;
     this->set_working_mode(false);
     
@@ -122,14 +156,13 @@ double_tensor MLPClassifier::evaluate(DataLoader<double, double>* pLoader){
     //YOUR CODE IS HERE
     double_tensor metrics;
 
-    for (auto batch : *pLoader) {
-        double_tensor X = batch.getData();
-        double_tensor t = batch.getLabel();
-        double_tensor Y = forward(X);
+    for (auto& batch : *pLoader) {
+        real_tensor& X = batch.getData();
+        xt::xarray<LType>& t = batch.getLabel();
+        real_view Y = forward_into(X);
         
-        ulong_tensor y_true = xt::argmax(t, 1);
         ulong_tensor y_pred = xt::argmax(Y, 1);
-        meter.accumulate(y_true, y_pred);
+        meter.accumulate(class_indices(t), y_pred);
     }
     
     metrics = meter.get_metrics(); // Get metrics after evaluation
@@ -138,6 +171,60 @@ double_tensor MLPClassifier::evaluate(DataLoader<double, double>* pLoader){
     this->set_working_mode(old_mode);
     return metrics;
 }
+
+void MLPClassifier::quantize(DataLoader<real_t, real_t>* pCalib_loader, int nbatches){
+    quantize_loader(pCalib_loader, nbatches);
+}
+
+void MLPClassifier::quantize(DataLoader<real_t, ulong>* pCalib_loader, int nbatches){
+    quantize_loader(pCalib_loader, nbatches);
+}
+
+template<typename LType>
+void MLPClassifier::quantize_loader(DataLoader<real_t, LType>* pLoader, int nbatches){
+    XArrayList<FCLayer*> fc = fc_layers();
+    if(fc.size() == 0){
+        throw std::runtime_error(m_sModelName + ": quantize: the model has no FC layer");
+    }
+    bool old_mode = this->m_trainable;
+    this->set_working_mode(false);
+    for(auto pLayer: fc) pLayer->begin_calibration();
+    
+    int batch_idx = 0;
+    for(auto& batch: *pLoader){
+        if((nbatches > 0) && (batch_idx == nbatches)) break;
+        forward_into(batch.getData());
+        batch_idx++;
+    }
+    if(batch_idx == 0){
+        for(auto pLayer: fc) pLayer->dequantize();
+        this->set_working_mode(old_mode);
+        throw std::invalid_argument(m_sModelName + ": quantize: empty calibration loader");
+    }
+    for(auto pLayer: fc) pLayer->quantize();
+    this->set_working_mode(old_mode);
+}
+
+void MLPClassifier::dequantize(){
+    for(auto pLayer: fc_layers()) pLayer->dequantize();
+}
+
+bool MLPClassifier::is_quantized(){
+    XArrayList<FCLayer*> fc = fc_layers();
+    for(auto pLayer: fc){
+        if(!pLayer->is_quantized()) return false;
+    }
+    return fc.size() > 0;
+}
+
+XArrayList<FCLayer*> MLPClassifier::fc_layers(){
+    XArrayList<FCLayer*> fc;
+    for(auto pLayer: m_layers){
+        FCLayer* pFC = dynamic_cast<FCLayer*>(pLayer);
+        if(pFC != nullptr) fc.add(pFC);
+    }
+    return fc;
+}
 //for the inference mode:end
 
 
@@ -146,11 +233,22 @@ double_tensor MLPClassifier::evaluate(DataLoader<double, double>* pLoader){
 void MLPClassifier::compile(
                 IOptimizer* pOptimizer,
                 ILossLayer* pLossLayer, 
-                IMetrics* pMetricLayer){
+                IMetrics* pMetricLayer,
+                int max_batch_size){
+    if(pLossLayer == nullptr){
+        if(m_pOwned_Loss != nullptr) delete m_pOwned_Loss;
+        m_pOwned_Loss = create_loss_layer(m_sLoss_name.size() > 0 ? m_sLoss_name : "CrossEntropy");
+        pLossLayer = m_pOwned_Loss;
+    }
     this->m_pOptimizer = pOptimizer;
     this->m_pLossLayer = pLossLayer;
     this->m_pMetricLayer = pMetricLayer;
+    this->m_sLoss_name = pLossLayer->get_name();
     
+    //all learnable tensors in m_params, one group per layer
+    clear_replicas(); //they read the old m_params
+    m_params.clear();
+    pOptimizer->bind(&m_params);
     for(auto pLayer: m_layers){
         if(pLayer->has_learnable_param()){
             string name = pLayer->getname();
@@ -158,6 +256,14 @@ void MLPClassifier::compile(
             pLayer->register_params(pGroup);
         }
     }
+    m_params.allocate();
+    
+    //size the workspace now if the input width is known (first layer: FC)
+    m_nMax_batch = max_batch_size;
+    FCLayer* pFirst = (m_layers.size() > 0) ? dynamic_cast<FCLayer*>(m_layers.get(0)) : nullptr;
+    if((max_batch_size > 0) && (pFirst != nullptr)){
+        prepare_workspace(pFirst->getNin(), max_batch_size);
+    }
 }
     
 void MLPClassifier::set_working_mode(bool trainable){
@@ -165,24 +271,281 @@ void MLPClassifier::set_working_mode(bool trainable){
     for(auto pLayer: m_layers){
         pLayer->set_working_mode(trainable);
     }
+    for(auto pReplica: m_replicas) pReplica->set_working_mode(trainable);
+}
+
+void MLPClassifier::set_num_replicas(int nreplicas){
+    if(nreplicas < 1){
+        throw std::invalid_argument(fmt::format("{:s}: set_num_replicas({:d}): expected at least 1",
+                m_sModelName, nreplicas));
+    }
+    if(nreplicas != m_nReplicas) clear_replicas();
+    m_nReplicas = nreplicas;
 }
 
 //protected: for the training mode: begin
-double_tensor MLPClassifier::forward(double_tensor X){
+real_tensor MLPClassifier::forward(const real_tensor& X){
     //YOUR CODE IS HERE
-    double_tensor output = X;
+    real_tensor output = X;
+    int nlayers = num_train_layers(), idx = 0;
     for (auto layer : m_layers) {
-        output = layer->forward(output);
+        if (idx++ == nlayers) break;
+        output = layer->forward(std::move(output));
     }
     return output;
 }
 void MLPClassifier::backward(){
     //YOUR CODE IS HERE
-    double_tensor dY = m_pLossLayer->backward();
+    real_tensor dY = m_pLossLayer->backward();
+    int nskip = m_layers.size() - num_train_layers();
     for (auto it = m_layers.bbegin(); it != m_layers.bend(); ++it) {
+        if (nskip > 0) { nskip--; continue; }
         dY = (*it)->backward(dY);
     }
 }
+
+int MLPClassifier::num_train_layers(){
+    int nlayers = m_layers.size();
+    bool logits_loss = m_trainable && (m_pLossLayer != nullptr) && m_pLossLayer->takes_logits();
+    if(logits_loss && (nlayers > 0) && (m_layers.get(nlayers - 1)->get_type() == LayerType::SOFTMAX)){
+        return nlayers - 1;
+    }
+    return nlayers;
+}
+
+void MLPClassifier::prepare_workspace(int nin, int nrows){
+    if((nin != m_nWorkspace_nin) || (m_act_slots.size() != m_layers.size())){
+        m_workspace.clear();
+        m_act_slots.clear();
+        int ncols = nin, max_cols = nin;
+        ILayer* pPrev = nullptr;
+        for(auto pLayer: m_layers){
+            ncols = pLayer->get_output_size(ncols);
+            //an in-place layer overwrites its input, unless its producer reads it back
+            bool share = (pPrev != nullptr) && pLayer->in_place() && !pPrev->keeps_output();
+            if(share) m_act_slots.add(m_act_slots.get(m_act_slots.size() - 1));
+            else m_act_slots.add(m_workspace.reserve(ncols));
+            max_cols = max(max_cols, ncols);
+            pPrev = pLayer;
+        }
+        m_grad_slots[0] = m_workspace.reserve(max_cols);
+        m_grad_slots[1] = m_workspace.reserve(max_cols);
+        m_nWorkspace_nin = nin;
+    }
+    //grow only: a smaller batch uses the first rows of each slot
+    int max_rows = max(max(nrows, m_nMax_batch), m_workspace.get_max_rows());
+    m_workspace.allocate(max_rows);
+}
+
+real_view MLPClassifier::forward_into(const real_tensor& X){
+    if((X.dimension() != 2) || (m_layers.size() == 0)){
+        throw std::invalid_argument(fmt::format(
+            "MLPClassifier::forward_into: expected a 2D batch and at least one layer, got {:s}",
+            shape2str(X.shape())));
+    }
+    int nrows = X.shape()[0], nin = X.shape()[1];
+    m_nBatch_rows = nrows;
+    m_nSlices = m_trainable ? max(1, min(m_nReplicas, nrows)) : 1; //a row per slice at least
+    if(m_nSlices == 1) return forward_rows(X.data(), nrows, nin);
+    
+    //data parallel: the outputs of all slices go to the model's output slot
+    prepare_replicas();
+    prepare_workspace(nin, nrows);
+    int out_slot = m_act_slots.get(num_train_layers() - 1);
+    int out_cols = m_workspace.get_cols(out_slot);
+    real_t* Y = m_workspace.view(out_slot, nrows).data();
+    const real_t* data = X.data();
+    parallel_rows(m_nSlices, (long)nrows*m_params.size(), [&](int begin, int end){
+        for(int slice=begin; slice < end; slice++){
+            int first = slice_begin(slice), last = slice_begin(slice + 1);
+            real_view out = slice_model(slice)->forward_rows(data + (long)first*nin, last - first, nin);
+            if(slice > 0) std::copy(out.data(), out.data() + out.size(), Y + (long)first*out_cols);
+        }
+    });
+    return m_workspace.view(out_slot, nrows);
+}
+
+real_view MLPClassifier::forward_rows(const real_t* X, int nrows, int nin){
+    prepare_workspace(nin, nrows);
+    
+    //each layer reads the previous layer's slot and writes its own
+    real_t* in_data = const_cast<real_t*>(X); //read only
+    int in_cols = nin;
+    int nlayers = num_train_layers(), idx = 0;
+    for(auto pLayer: m_layers){
+        if(idx == nlayers) break;
+        real_view input = make_view(in_data, {(unsigned long)nrows, (unsigned long)in_cols});
+        real_view output = m_workspace.view(m_act_slots.get(idx), nrows);
+        pLayer->forward_into(input, output);
+        in_data = output.data();
+        in_cols = output.shape()[1];
+        idx++;
+    }
+    return m_workspace.view(m_act_slots.get(idx - 1), nrows);
+}
+
+void MLPClassifier::backward_into(){
+    int nrows = m_nBatch_rows;
+    int out_cols = m_workspace.get_cols(m_act_slots.get(num_train_layers() - 1));
+    real_view dY = m_workspace.view(m_grad_slots[0], nrows, out_cols);
+    m_pLossLayer->backward_into(dY);
+    if(m_nSlices == 1){
+        backward_rows(nrows);
+        return;
+    }
+    
+    //data parallel: the rows of DY to the replicas, before slice 0 overwrites them
+    for(int slice=1; slice < m_nSlices; slice++){
+        MLPClassifier* pReplica = slice_model(slice);
+        int first = slice_begin(slice), last = slice_begin(slice + 1);
+        real_view DY = pReplica->m_workspace.view(pReplica->m_grad_slots[0], last - first, out_cols);
+        std::copy(dY.data() + (long)first*out_cols, dY.data() + (long)last*out_cols, DY.data());
+    }
+    parallel_rows(m_nSlices, (long)nrows*m_params.size(), [&](int begin, int end){
+        for(int slice=begin; slice < end; slice++){
+            MLPClassifier* pModel = slice_model(slice);
+            XArrayList<FCLayer*> fc = pModel->fc_layers();
+            if(slice > 0) pModel->m_params.zero_grad(); //the model's: by fit
+            for(auto pLayer: fc) pLayer->set_mean_rows(nrows);
+            pModel->backward_rows(slice_begin(slice + 1) - slice_begin(slice));
+            for(auto pLayer: fc) pLayer->set_mean_rows(0);
+        }
+    });
+    reduce_grads();
+}
+
+void MLPClassifier::backward_rows(int nrows){
+    int idx = num_train_layers() - 1;
+    int nskip = m_layers.size() - 1 - idx; //layers after the last one trained
+    int current = 0; //gradient slot holding DY
+    int out_cols = m_workspace.get_cols(m_act_slots.get(idx));
+    
+    for(auto it = m_layers.bbegin(); it != m_layers.bend(); ++it){
+        if(nskip > 0){
+            nskip--;
+            continue;
+        }
+        int in_cols = (idx > 0) ? m_workspace.get_cols(m_act_slots.get(idx - 1)) : m_nWorkspace_nin;
+        real_view DY = m_workspace.view(m_grad_slots[current], nrows, out_cols);
+        real_view DX = m_workspace.view(m_grad_slots[1 - current], nrows, in_cols);
+        (*it)->backward_into(DY, DX);
+        current = 1 - current;
+        out_cols = in_cols;
+        idx--;
+    }
+}
+
+/* reduce_grads:
+ *  pairwise sums, log2(m_nSlices) levels: after the level of stride s, the
+ *  gradients of slice i (i a multiple of 2s) hold the sum over slices
+ *  [i, i + 2s); slice 0's are the model's. Each level runs its additions
+ *  (one per pair and chunk of the buffer) in parallel.
+ */
+void MLPClassifier::reduce_grads(){
+    const long chunk = 1 << 14;
+    long size = m_params.size();
+    long nchunks = (size + chunk - 1)/chunk;
+    for(int stride=1; stride < m_nSlices; stride *= 2){
+        int npairs = (m_nSlices - stride - 1)/(2*stride) + 1;
+        parallel_rows(npairs*nchunks, 3*npairs*size, [&](int begin, int end){
+            for(int job=begin; job < end; job++){
+                int dst = 2*stride*(job/nchunks);
+                long first = (job % nchunks)*chunk;
+                real_t* to = slice_model(dst)->m_params.grads();
+                const real_t* from = slice_model(dst + stride)->m_params.grads();
+                vaxpy(min(chunk, size - first), real_t(1), from + first, to + first);
+            }
+        });
+    }
+}
+
+void MLPClassifier::prepare_replicas(){
+    if(m_replicas.size() == m_nReplicas - 1) return;
+    clear_replicas();
+    for(int idx=1; idx < m_nReplicas; idx++) m_replicas.add(new_replica());
+}
+
+MLPClassifier* MLPClassifier::new_replica(){
+    if(!m_params.is_allocated()){
+        throw std::runtime_error(m_sModelName + ": replicas of the layers: compile the model first");
+    }
+    MLPClassifier* pReplica = new MLPClassifier(m_cfg_filename, m_sModelName);
+    try{
+        for(auto pLayer: m_layers){
+            ILayer* pCopy = pLayer->replicate();
+            if(pCopy == nullptr){
+                throw std::runtime_error(fmt::format("{:s}: layer {:s} can not be replicated",
+                        m_sModelName, pLayer->getname()));
+            }
+            pReplica->m_layers.add(pCopy);
+        }
+        pReplica->m_pLossLayer = m_pLossLayer; //not owned; for num_train_layers
+        pReplica->m_sLoss_name = m_sLoss_name;
+        pReplica->set_working_mode(m_trainable);
+        
+        //same layout as m_params (see compile), then the model's weights
+        SGDParamGroup group;
+        group.bind(&pReplica->m_params);
+        for(auto pLayer: pReplica->m_layers){
+            if(pLayer->has_learnable_param()) pLayer->register_params(&group);
+        }
+        pReplica->m_params.share_params(m_params);
+    }
+    catch(...){
+        delete pReplica;
+        throw;
+    }
+    return pReplica;
+}
+
+void MLPClassifier::clear_replicas(){
+    for(auto pReplica: m_replicas) delete pReplica;
+    m_replicas.clear();
+}
+
+void MLPClassifier::begin_async(int nworkers){
+    end_async();
+    for(int worker=0; worker < nworkers; worker++){
+        MLPClassifier* pWorker = new_replica();
+        m_workers.add(pWorker);
+        //a loss of its own: the loss keeps its input until backward
+        pWorker->m_pOwned_Loss = create_loss_layer(m_sLoss_name);
+        pWorker->m_pLossLayer = pWorker->m_pOwned_Loss;
+        pWorker->m_nMax_batch = m_nMax_batch;
+    }
+}
+
+double MLPClassifier::async_step(int worker, const real_tensor& X, const real_tensor& t,
+                                 double lr, ulong_tensor& y_pred){
+    return async_step_batch(worker, X, t, lr, y_pred);
+}
+
+double MLPClassifier::async_step(int worker, const real_tensor& X, const ulong_tensor& t,
+                                 double lr, ulong_tensor& y_pred){
+    return async_step_batch(worker, X, t, lr, y_pred);
+}
+
+template<typename LType>
+double MLPClassifier::async_step_batch(int worker, const real_tensor& X, const xt::xarray<LType>& t,
+                                       double lr, ulong_tensor& y_pred){
+    MLPClassifier* pWorker = m_workers.get(worker);
+    pWorker->m_params.zero_grad();
+    real_view Y = pWorker->forward_into(X);
+    double batch_loss = pWorker->m_pLossLayer->forward_into(Y, t);
+    pWorker->backward_into();
+    
+    //P -= lr*grad_P straight on the shared weights: no lock (Hogwild)
+    SGDParamGroup update;
+    update.bind(&pWorker->m_params, true);
+    update.step(lr);
+    y_pred = xt::argmax(Y, 1);
+    return batch_loss;
+}
+
+void MLPClassifier::end_async(){
+    for(auto pWorker: m_workers) delete pWorker;
+    m_workers.clear();
+}
 //protected: for the training mode: end
 
 
@@ -218,6 +581,7 @@ bool MLPClassifier::save(string model_path){
         //write header
         //write data
         datastream << "model name: " << this->m_sModelName << endl;
+        if(m_sLoss_name.size() > 0) datastream << "loss: " << m_sLoss_name << endl;
         for(auto pLayer: m_layers){
             string desc = pLayer->get_desc();
             datastream << desc << endl;
@@ -238,6 +602,7 @@ bool MLPClassifier::save(string model_path){
 }
 
 bool MLPClassifier::load(string model_path,  bool use_name_in_file){
+    clear_replicas(); //copies of the layers before the load
     try{
         //verify the existing of model_path
         if(!fs::exists(model_path)){
@@ -258,6 +623,8 @@ bool MLPClassifier::load(string model_path,  bool use_name_in_file){
 
         //read and parse lines
         string line;
+        bool has_pending_fc = false;
+        string fc_params, fc_w_file, fc_b_file, fc_name;
         while(getline(datastream, line)){
             //skip empty and comment line (started with #)
             line = trim(line);
@@ -284,11 +651,31 @@ bool MLPClassifier::load(string model_path,  bool use_name_in_file){
             if(use_name_in_file) new_name = layer_name;
             else new_name = "";
 
+            //an FC followed by ReLU/Sigmoid/Tanh becomes one FCActLayer:
+            //the FC line is kept pending until the next layer is known
+            LayerType act = LayerType::NUM_LAYERS;
+            if(layer_type.compare("ReLU") == 0) act = LayerType::RELU;
+            if(layer_type.compare("Sigmoid") == 0) act = LayerType::SIGMOID;
+            if(layer_type.compare("Tanh") == 0) act = LayerType::TANH;
+            if(has_pending_fc){
+                has_pending_fc = false;
+                if(FCActLayer::is_fusable(act)){
+                    m_layers.add(new FCActLayer(fc_params, fc_w_file, fc_b_file, act, fc_name, new_name));
+                    continue;
+                }
+                m_layers.add(new FCLayer(fc_params, fc_w_file, fc_b_file, fc_name));
+            }
+
+            if(layer_type.compare("loss") == 0){
+                m_sLoss_name = trim(second);
+            }
             if(layer_type.compare("FC") == 0){
-                string w_file = model_path + "/" + layer_name + "_W.npy";
-                string b_file = model_path + "/" + layer_name + "_b.npy";
                 //note:: b_file: may not be used in FCLayer
-                 m_layers.add(new FCLayer(trim(second), w_file, b_file, new_name));
+                fc_params = trim(second);
+                fc_w_file = model_path + "/" + layer_name + "_W.npy";
+                fc_b_file = model_path + "/" + layer_name + "_b.npy";
+                fc_name = new_name;
+                has_pending_fc = true;
             }
             if(layer_type.compare("ReLU") == 0){
                 m_layers.add(new ReLU(new_name) );
@@ -314,6 +701,9 @@ bool MLPClassifier::load(string model_path,  bool use_name_in_file){
                 m_layers.add(new Softmax(nAxis, new_name) );
             }
         }
+        if(has_pending_fc){
+            m_layers.add(new FCLayer(fc_params, fc_w_file, fc_b_file, fc_name));
+        }
         
         //close stream
         datastream.close();
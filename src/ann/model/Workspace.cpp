@@ -0,0 +1,73 @@
+/*
+ * File:   Workspace.cpp
+ * Purpose: one contiguous block of real_t sliced into per-batch buffers
+ */
+
+#include "model/Workspace.h"
+#include "sformat/fmt_lib.h"
+#include <stdexcept>
+
+Workspace::Workspace(): m_nMax_rows(0), m_bAllocated(false){
+}
+
+Workspace::~Workspace(){
+}
+
+int Workspace::reserve(int ncols){
+    if(ncols <= 0){
+        throw std::invalid_argument(fmt::format("Workspace::reserve: ncols={:d} must be positive", ncols));
+    }
+    m_slot_cols.add(ncols);
+    m_bAllocated = false; //layout changed
+    return m_slot_cols.size() - 1;
+}
+
+void Workspace::allocate(int max_rows){
+    if(max_rows <= 0){
+        throw std::invalid_argument(fmt::format("Workspace::allocate: max_rows={:d} must be positive", max_rows));
+    }
+    if(m_bAllocated && (max_rows == m_nMax_rows)) return;
+
+    //slots are laid out back to back; every slot starts on a 64-byte line
+    const unsigned long long align = 64/sizeof(real_t);
+    m_slot_offsets.clear();
+    unsigned long long total = 0;
+    for(int slot=0; slot < m_slot_cols.size(); slot++){
+        m_slot_offsets.add(total);
+        unsigned long long nvalues = (unsigned long long)max_rows*m_slot_cols.get(slot);
+        total += (nvalues + align - 1)/align*align;
+    }
+    m_aBlock = xt::xarray<real_t>::from_shape({total + align});
+    m_nMax_rows = max_rows;
+    m_bAllocated = true;
+}
+
+real_view Workspace::view(int slot, int nrows, int ncols){
+    if(!m_bAllocated){
+        throw std::runtime_error("Workspace::view: allocate() must be called after the last reserve()");
+    }
+    if((slot < 0) || (slot >= m_slot_cols.size())){
+        throw std::out_of_range(fmt::format("Workspace::view: slot={:d} not in [0, {:d})", slot, m_slot_cols.size()));
+    }
+    if((nrows < 0) || (nrows > m_nMax_rows)){
+        throw std::out_of_range(fmt::format("Workspace::view: nrows={:d} not in [0, {:d}]", nrows, m_nMax_rows));
+    }
+    if(ncols < 0) ncols = m_slot_cols.get(slot);
+    if(ncols > m_slot_cols.get(slot)){
+        throw std::out_of_range(fmt::format("Workspace::view: ncols={:d} > {:d}", ncols, m_slot_cols.get(slot)));
+    }
+    //first 64-byte boundary of the block, then the slot's offset
+    real_t* base = m_aBlock.data();
+    unsigned long long misalign = (reinterpret_cast<unsigned long long>(base)%64)/sizeof(real_t);
+    if(misalign != 0) base += 64/sizeof(real_t) - misalign;
+    real_t* data = base + m_slot_offsets.get(slot);
+    return make_view(data, {(unsigned long)nrows, (unsigned long)ncols});
+}
+
+void Workspace::clear(){
+    m_slot_cols.clear();
+    m_slot_offsets.clear();
+    m_aBlock = real_tensor();
+    m_nMax_rows = 0;
+    m_bAllocated = false;
+}
@@ -23,9 +23,7 @@ Adagrad::Adagrad(const Adagrad& orig) {
 Adagrad::~Adagrad() {
 }
 
-IParamGroup* Adagrad::create_group(string name){
-    //YOUR CODE IS HERE
-    m_pGroupMap->put(name, new AdaParamGroup(m_decay));
-    return m_pGroupMap->get(name);
+IParamGroup* Adagrad::new_group(){
+    return new AdaParamGroup(m_decay);
 }
 
@@ -18,15 +18,13 @@ Adam::Adam(double lr, double beta_1, double beta_2):
 }
 
 Adam::Adam(const Adam& orig):
-    IOptimizer(orig.m_learning_rate), m_beta_1(orig.m_beta_1), m_beta_2(orig.m_beta_2){
+    IOptimizer(orig), m_beta_1(orig.m_beta_1), m_beta_2(orig.m_beta_2){
 }
 
 Adam::~Adam() {
 }
 
-IParamGroup* Adam::create_group(string name){
-    //YOUR CODE IS HERE
-    m_pGroupMap->put(name, new AdamParamGroup(m_beta_1, m_beta_2));
-    return m_pGroupMap->get(name);
+IParamGroup* Adam::new_group(){
+    return new AdamParamGroup(m_beta_1, m_beta_2);
 }
 
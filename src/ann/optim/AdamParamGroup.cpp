@@ -14,86 +14,35 @@
 
 AdamParamGroup::AdamParamGroup(double beta1, double beta2):
     m_beta1(beta1), m_beta2(beta2){
-    //Create some maps:
-    m_pParams = new xmap<string, xt::xarray<double>*>(&stringHash);
-    m_pGrads = new xmap<string, xt::xarray<double>*>(&stringHash);
-    m_pFirstMomment = new xmap<string, xt::xarray<double>*>(
-            &stringHash,
-            0.75,
-            0,
-            xmap<string, xt::xarray<double>*>::freeValue);
-    m_pSecondMomment = new xmap<string, xt::xarray<double>*>(
-            &stringHash,
-            0.75,
-            0,
-            xmap<string, xt::xarray<double>*>::freeValue);
-    //
     m_step_idx = 1;
     m_beta1_t = m_beta1;
     m_beta2_t = m_beta2;
 }
 
 AdamParamGroup::AdamParamGroup(const AdamParamGroup& orig):
+    IParamGroup(orig),
+    m_aFirstMoment(orig.m_aFirstMoment), m_aSecondMoment(orig.m_aSecondMoment),
     m_beta1(orig.m_beta1), m_beta2(orig.m_beta2){
-    m_pParams = new xmap<string, xt::xarray<double>*>(&stringHash);
-    m_pGrads = new xmap<string, xt::xarray<double>*>(&stringHash);
-    m_pFirstMomment = new xmap<string, xt::xarray<double>*>(
-            &stringHash,
-            0.75,
-            0,
-            xmap<string, xt::xarray<double>*>::freeValue);
-    m_pSecondMomment = new xmap<string, xt::xarray<double>*>(
-            &stringHash,
-            0.75,
-            0,
-            xmap<string, xt::xarray<double>*>::freeValue);
-    //copy:
-    *m_pParams = *orig.m_pParams;
-    *m_pGrads = *orig.m_pGrads;
-    *m_pFirstMomment = *orig.m_pFirstMomment;
-    *m_pSecondMomment = *orig.m_pSecondMomment;
-    //
-    m_step_idx = 1;
-    m_beta1_t = m_beta1;
-    m_beta2_t = m_beta2;
+    m_step_idx = orig.m_step_idx;
+    m_beta1_t = orig.m_beta1_t;
+    m_beta2_t = orig.m_beta2_t;
 }
 
 AdamParamGroup::~AdamParamGroup() {
-    if(m_pFirstMomment != nullptr) delete m_pFirstMomment;
-    if(m_pSecondMomment != nullptr) delete m_pSecondMomment;
-}
-
-void AdamParamGroup::register_param(string param_name, 
-        xt::xarray<double>* ptr_param,
-        xt::xarray<double>* ptr_grad){
-    //YOUR CODE IS HERE
-}
-void AdamParamGroup::register_sample_count(unsigned long long* pCounter){
-    m_pCounter = pCounter;
-}
-
-void AdamParamGroup::zero_grad(){
-    //YOUR CODE IS HERE
-    auto keys = m_pGrads->keys();
-    for (auto it = keys.begin(); it != keys.end(); ++it) {
-        auto& grad = *(m_pGrads->get(*it));
-        grad.fill(0.0);
-    }
 }
 
 void AdamParamGroup::step(double lr){
-    //YOUR CODE IS HERE
-    double lr_t = lr * sqrt(1 - m_beta2_t) / (1 - m_beta1_t);
-    auto keys = m_pParams->keys();
-    for (auto it = keys.begin(); it != keys.end(); ++it) {
-        auto& param = *(m_pParams->get(*it));
-        auto& grad = *(m_pGrads->get(*it));
-        auto& first_moment = *(m_pFirstMomment->get(*it));
-        auto& second_moment = *(m_pSecondMomment->get(*it));
-        first_moment = m_beta1 * first_moment + (1 - m_beta1) * grad;
-        second_moment = m_beta2 * second_moment + (1 - m_beta2) * grad * grad;
-        param -= lr_t * first_moment / (xt::sqrt(second_moment) + 1e-8);
+    unsigned long long first = begin(), n = end() - first;
+    //the moments start at 0 (padding included)
+    if(m_aFirstMoment.size() != n){
+        m_aFirstMoment = xt::zeros<real_t>({n});
+        m_aSecondMoment = xt::zeros<real_t>({n});
     }
+    real_t lr_t = lr * sqrt(1 - m_beta2_t) / (1 - m_beta1_t);
+    //one pass over param, grad and both moments
+    adam_update(n, m_pBuffer->params() + first, m_pBuffer->grads() + first,
+            m_aFirstMoment.data(), m_aSecondMoment.data(),
+            (real_t)m_beta1, (real_t)m_beta2, lr_t, (real_t)1e-8);
 
     //UPDATE step_idx:
     m_step_idx += 1;
@@ -12,11 +12,13 @@
 
 #include "optim/IOptimizer.h"
 #include "list/DLinkedList.h"
+#include "sformat/fmt_lib.h"
+#include <stdexcept>
 #include <string>
 using namespace std;
 
 IOptimizer::IOptimizer(double learning_rate):
-m_fLearningRate(learning_rate){
+m_fLearningRate(learning_rate), m_pBuffer(nullptr), m_pAll(nullptr){
     m_pGroupMap = new xmap<string, IParamGroup*>(&stringHash,
             0.75,
             nullptr,
@@ -24,24 +26,53 @@ m_fLearningRate(learning_rate){
 }
 
 IOptimizer::IOptimizer(const IOptimizer& orig):
-m_fLearningRate(orig.m_fLearningRate){
+m_fLearningRate(orig.m_fLearningRate), m_pBuffer(nullptr), m_pAll(nullptr){
+    m_pGroupMap = new xmap<string, IParamGroup*>(&stringHash,
+            0.75,
+            nullptr,
+            &xmap<string, IParamGroup*>::freeValue);
 }
 
 IOptimizer::~IOptimizer() {
     if(m_pGroupMap != nullptr) delete m_pGroupMap;
+    if(m_pAll != nullptr) delete m_pAll;
+}
+
+void IOptimizer::clear_groups(){
+    m_pGroupMap->clear(); //deletes the groups
+    m_groups.clear();
+    if(m_pAll != nullptr) delete m_pAll;
+    m_pAll = nullptr;
+}
+
+void IOptimizer::bind(ParamBuffer* pBuffer){
+    clear_groups();
+    m_pBuffer = pBuffer;
+}
+
+IParamGroup* IOptimizer::create_group(string name){
+    if(m_pGroupMap->containsKey(name)){
+        throw std::invalid_argument(fmt::format("IOptimizer::create_group: group \"{:s}\" exists", name));
+    }
+    IParamGroup* pGroup = new_group();
+    pGroup->bind(m_pBuffer);
+    m_pGroupMap->put(name, pGroup);
+    m_groups.add(pGroup);
+    return pGroup;
 }
 
 void IOptimizer::step(){
-    DLinkedList<string> gkeys = m_pGroupMap->keys();
-    for(auto key: gkeys){
-        IParamGroup* pGroup = m_pGroupMap->get(key);
-        pGroup->step(m_fLearningRate);
+    if(m_groups.size() == 0) return; //nothing to learn
+    if(!m_pBuffer->is_allocated()){
+        throw std::runtime_error("IOptimizer::step: the ParamBuffer must be allocated after the last create_group");
+    }
+    if(m_pAll == nullptr){
+        m_pAll = new_group();
+        m_pAll->bind(m_pBuffer, true);
     }
+    m_pAll->step(m_fLearningRate);
 }
 void IOptimizer::zero_grad(){
-    DLinkedList<string> keys = m_pGroupMap->keys();
-    for(auto key: keys){
-        IParamGroup* pGroup = m_pGroupMap->get(key);
-        pGroup->zero_grad();
-    }
-};
\ No newline at end of file
+    if(m_pBuffer != nullptr) m_pBuffer->zero_grad();
+    for(auto pGroup: m_groups) pGroup->reset_sample_count();
+};
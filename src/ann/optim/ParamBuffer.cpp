@@ -0,0 +1,115 @@
+/*
+ * File:   ParamBuffer.cpp
+ * Purpose: the learnable tensors of a model laid out in one block
+ */
+
+#include "optim/ParamBuffer.h"
+#include "sformat/fmt_lib.h"
+#include <stdexcept>
+#include <cstring>
+#include <algorithm>
+
+ParamBuffer::ParamBuffer():
+    m_pParams(nullptr), m_pGrads(nullptr), m_nSize(0), m_bAllocated(false){
+}
+
+ParamBuffer::~ParamBuffer(){
+}
+
+int ParamBuffer::reserve(real_view* ptr_param, real_view* ptr_grad){
+    if((ptr_param == nullptr) || (ptr_grad == nullptr)){
+        throw std::invalid_argument("ParamBuffer::reserve: param and grad must not be nullptr");
+    }
+    if(ptr_param->size() != ptr_grad->size()){
+        throw std::invalid_argument(fmt::format("ParamBuffer::reserve: param has {:d} values, grad {:d}",
+                ptr_param->size(), ptr_grad->size()));
+    }
+    m_params.add(ptr_param);
+    m_grads.add(ptr_grad);
+    m_bAllocated = false; //layout changed
+    return m_params.size() - 1;
+}
+
+void ParamBuffer::allocate(){
+    if(m_bAllocated) return;
+
+    //tensors are laid out back to back; every tensor starts on a 64-byte line
+    const unsigned long long align = 64/sizeof(real_t);
+    m_offsets.clear();
+    unsigned long long total = 0;
+    for(int id=0; id < m_params.size(); id++){
+        m_offsets.add(total);
+        total += (m_params.get(id)->size() + align - 1)/align*align;
+    }
+    //params, then grads; zeros: the padding must stay 0 for the kernels
+    real_tensor block = xt::zeros<real_t>({2*total + align});
+    real_t* base = block.data();
+    unsigned long long misalign = (reinterpret_cast<unsigned long long>(base)%64)/sizeof(real_t);
+    if(misalign != 0) base += align - misalign;
+
+    //copy the values from where the views point now (maybe the old block)
+    for(int id=0; id < m_params.size(); id++){
+        real_view* pParam = m_params.get(id);
+        real_view* pGrad = m_grads.get(id);
+        real_t* param = base + m_offsets.get(id);
+        std::copy(pParam->data(), pParam->data() + pParam->size(), param);
+        //assigning a real_view re-points it
+        *pParam = make_view(param, pParam->shape());
+        *pGrad = make_view(base + total + m_offsets.get(id), pGrad->shape());
+    }
+    m_aBlock = std::move(block);
+    m_pParams = base;
+    m_pGrads = base + total;
+    m_nSize = total;
+    m_bAllocated = true;
+}
+
+void ParamBuffer::zero_grad(){
+    if(!m_bAllocated || (m_nSize == 0)) return;
+    //one memset, split across gemm's threads when the buffer is large
+    const long chunk = 1 << 16;
+    long nchunks = (m_nSize + chunk - 1)/chunk;
+    real_t* grads = m_pGrads;
+    long size = m_nSize;
+    parallel_rows((int)nchunks, size, [=](int begin, int end){
+        long first = begin*chunk;
+        long last = std::min(size, end*chunk);
+        memset(grads + first, 0, (last - first)*sizeof(real_t));
+    });
+}
+
+unsigned long long ParamBuffer::offset(int id){
+    if(!m_bAllocated){
+        throw std::runtime_error("ParamBuffer::offset: allocate() must be called after the last reserve()");
+    }
+    if((id < 0) || (id > m_params.size())){
+        throw std::out_of_range(fmt::format("ParamBuffer::offset: id={:d} not in [0, {:d}]", id, m_params.size()));
+    }
+    return (id == m_params.size()) ? m_nSize : m_offsets.get(id);
+}
+
+void ParamBuffer::clear(){
+    m_params.clear();
+    m_grads.clear();
+    m_offsets.clear();
+    //m_aBlock stays: the views point into it until the next allocate()
+    m_bAllocated = false;
+}
+
+void ParamBuffer::share_params(ParamBuffer& source){
+    allocate();
+    if(!source.is_allocated() || (source.num_tensors() != num_tensors()) || (source.size() != m_nSize)){
+        throw std::invalid_argument(fmt::format(
+                "ParamBuffer::share_params: {:d} tensors in {:d} values, source: {:d} tensors in {:d} values",
+                num_tensors(), (long)m_nSize, source.num_tensors(), (long)source.size()));
+    }
+    for(int id=0; id < m_params.size(); id++){
+        real_view* pParam = m_params.get(id);
+        if((source.offset(id) != m_offsets.get(id)) || (source.m_params.get(id)->size() != pParam->size())){
+            throw std::invalid_argument(fmt::format(
+                    "ParamBuffer::share_params: tensor {:d} differs from the source's", id));
+        }
+        *pParam = make_view(source.params() + m_offsets.get(id), pParam->shape());
+    }
+    m_pParams = source.params();
+}
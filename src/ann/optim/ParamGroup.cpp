@@ -0,0 +1,59 @@
+/*
+ * File:   ParamGroup.cpp
+ * Purpose: the part of IParamGroup shared by all optimizers: the group's
+ *          tensors in a ParamBuffer
+ */
+
+#include "optim/IParamGroup.h"
+#include "sformat/fmt_lib.h"
+#include <stdexcept>
+#include <cstring>
+
+IParamGroup::IParamGroup():
+    m_pBuffer(nullptr), m_bWhole(false), m_first_id(-1), m_last_id(-1), m_pCounter(nullptr){
+}
+
+IParamGroup::IParamGroup(const IParamGroup& orig):
+    m_pBuffer(orig.m_pBuffer), m_bWhole(orig.m_bWhole),
+    m_first_id(orig.m_first_id), m_last_id(orig.m_last_id), m_pCounter(orig.m_pCounter){
+}
+
+void IParamGroup::bind(ParamBuffer* pBuffer, bool whole){
+    m_pBuffer = pBuffer;
+    m_bWhole = whole;
+    m_first_id = m_last_id = -1;
+}
+
+void IParamGroup::register_param(string param_name, real_view* ptr_param, real_view* ptr_grad){
+    if(m_pBuffer == nullptr){
+        throw std::runtime_error(fmt::format(
+                "IParamGroup::register_param({:s}): the group has no ParamBuffer (see IOptimizer::bind)", param_name));
+    }
+    int id = m_pBuffer->reserve(ptr_param, ptr_grad);
+    if(m_first_id < 0) m_first_id = id;
+    else if(id != m_last_id){
+        throw std::runtime_error(fmt::format(
+                "IParamGroup::register_param({:s}): the tensors of a group must be registered one after another", param_name));
+    }
+    m_last_id = id + 1;
+}
+
+void IParamGroup::register_sample_count(unsigned long long* pCounter){
+    m_pCounter = pCounter;
+}
+
+unsigned long long IParamGroup::begin(){
+    if(m_bWhole) return 0;
+    return (m_first_id < 0) ? 0 : m_pBuffer->offset(m_first_id);
+}
+
+unsigned long long IParamGroup::end(){
+    if(m_bWhole) return m_pBuffer->size();
+    return (m_first_id < 0) ? 0 : m_pBuffer->offset(m_last_id);
+}
+
+void IParamGroup::zero_grad(){
+    unsigned long long first = begin(), last = end();
+    if(last > first) memset(m_pBuffer->grads() + first, 0, (last - first)*sizeof(real_t));
+    reset_sample_count();
+}
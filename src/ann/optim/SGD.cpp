@@ -25,10 +25,8 @@ SGD::SGD(const SGD& orig) {
 SGD::~SGD() {
 }
 
-IParamGroup* SGD::create_group(string name){
-    IParamGroup* pGroup = new SGDParamGroup();
-    m_pGroupMap->put(name, pGroup);
-    return pGroup;
+IParamGroup* SGD::new_group(){
+    return new SGDParamGroup();
 }
 
 
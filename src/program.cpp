@@ -19,17 +19,22 @@ namespace fs = std::filesystem;
 #include "optim/Adam.h"
 #include "modelzoo/twoclasses.h"
 #include "modelzoo/threeclasses.h"
+#include "loader/DataLoaderBench.h"
+#include "ann/model/MLPBench.h"
+#include "ann/layer/FCLayerBench.h"
+#include "tensor/VMathBench.h"
+#include "ann/optim/OptimizerBench.h"
 
 void mlpDemo1() {
     xt::random::seed(42);
     DSFactory factory("./config.txt");
-    xmap<string, TensorDataset<double, double>*>* pMap = factory.get_datasets_2cc();
-    TensorDataset<double, double>* train_ds = pMap->get("train_ds");
-    TensorDataset<double, double>* valid_ds = pMap->get("valid_ds");
-    TensorDataset<double, double>* test_ds = pMap->get("test_ds");
-    DataLoader<double, double> train_loader(train_ds, 50, true, false);
-    DataLoader<double, double> valid_loader(valid_ds, 50, false, false);
-    DataLoader<double, double> test_loader(test_ds, 50, false, false);
+    xmap<string, Dataset<real_t, real_t>*>* pMap = factory.get_datasets_2cc();
+    Dataset<real_t, real_t>* train_ds = pMap->get("train_ds");
+    Dataset<real_t, real_t>* valid_ds = pMap->get("valid_ds");
+    Dataset<real_t, real_t>* test_ds = pMap->get("test_ds");
+    DataLoader<real_t, real_t> train_loader(train_ds, 50, true, false);
+    DataLoader<real_t, real_t> valid_loader(valid_ds, 50, false, false);
+    DataLoader<real_t, real_t> test_loader(test_ds, 50, false, false);
 
     cout << "Train dataset: " << train_ds->len() << endl;
     cout << "Valid dataset: " << valid_ds->len() << endl;
@@ -61,13 +66,13 @@ void mlpDemo1() {
 void mlpDemo2() {
     xt::random::seed(42);
     DSFactory factory("./config.txt");
-    xmap<string, TensorDataset<double, double>*>* pMap = factory.get_datasets_2cc();
-    TensorDataset<double, double>* train_ds = pMap->get("train_ds");
-    TensorDataset<double, double>* valid_ds = pMap->get("valid_ds");
-    TensorDataset<double, double>* test_ds = pMap->get("test_ds");
-    DataLoader<double, double> train_loader(train_ds, 50, true, false);
-    DataLoader<double, double> valid_loader(valid_ds, 50, false, false);
-    DataLoader<double, double> test_loader(test_ds, 50, false, false);
+    xmap<string, Dataset<real_t, real_t>*>* pMap = factory.get_datasets_2cc();
+    Dataset<real_t, real_t>* train_ds = pMap->get("train_ds");
+    Dataset<real_t, real_t>* valid_ds = pMap->get("valid_ds");
+    Dataset<real_t, real_t>* test_ds = pMap->get("test_ds");
+    DataLoader<real_t, real_t> train_loader(train_ds, 50, true, false);
+    DataLoader<real_t, real_t> valid_loader(valid_ds, 50, false, false);
+    DataLoader<real_t, real_t> test_loader(test_ds, 50, false, false);
 
     int nClasses = 2;
     ILayer* layers[] = {
@@ -94,13 +99,13 @@ void mlpDemo2() {
 void mlpDemo3() {
     xt::random::seed(42);
     DSFactory factory("./config.txt");
-    xmap<string, TensorDataset<double, double>*>* pMap = factory.get_datasets_2cc();
-    TensorDataset<double, double>* train_ds = pMap->get("train_ds");
-    TensorDataset<double, double>* valid_ds = pMap->get("valid_ds");
-    TensorDataset<double, double>* test_ds = pMap->get("test_ds");
-    DataLoader<double, double> train_loader(train_ds, 50, true, false);
-    DataLoader<double, double> valid_loader(valid_ds, 50, false, false);
-    DataLoader<double, double> test_loader(test_ds, 50, false, false);
+    xmap<string, Dataset<real_t, real_t>*>* pMap = factory.get_datasets_2cc();
+    Dataset<real_t, real_t>* train_ds = pMap->get("train_ds");
+    Dataset<real_t, real_t>* valid_ds = pMap->get("valid_ds");
+    Dataset<real_t, real_t>* test_ds = pMap->get("test_ds");
+    DataLoader<real_t, real_t> train_loader(train_ds, 50, true, false);
+    DataLoader<real_t, real_t> valid_loader(valid_ds, 50, false, false);
+    DataLoader<real_t, real_t> test_loader(test_ds, 50, false, false);
 
     int nClasses = 2;
     ILayer* layers[] = {
@@ -132,6 +137,19 @@ int main(int argc, char** argv) {
         case 1: mlpDemo1(); break;
         case 2: mlpDemo2(); break;
         case 3: mlpDemo3(); break;
+        case 4: bench_dataloader_prefetch(); break;
+        case 5: bench_dataloader_iteration(); break;
+        case 6: bench_mlp_throughput(); break;
+        case 7: bench_fc_gemm(); break;
+        case 8: bench_mlp_throughput(20, 50, false); break;
+        case 9: bench_mlp_throughput(20, 50, true, "CrossEntropy"); break;
+        case 10: bench_vmath(); break;
+        case 11: bench_int8_inference(2); break;
+        case 12: bench_int8_inference(3); break;
+        case 13: bench_optimizer_step(); break;
+        case 14: bench_optimizer_threads(); break;
+        case 15: bench_data_parallel(); break;
+        case 16: bench_hogwild(); break;
     }
  
     return 0;
@@ -0,0 +1,435 @@
+/*
+ * File:   gemm.cpp
+ * Purpose: the in-tree GEMM behind gemm() (see xtensor_lib.h); no external
+ *          BLAS is needed.
+ *  + op(A) and op(B) are packed into cache-sized panels (KC x MC, KC x NC);
+ *      transposes are resolved while packing
+ *  + a register-blocked micro-kernel computes one MR x NR tile of C per call;
+ *      it is picked at run time: AVX-512, AVX2+FMA, or portable C++
+ *  + large products are split into blocks of output tiles that run on a
+ *      thread pool, the calling thread taking the first block
+ *  + tiny products (e.g., 2 -> 50 layers) skip packing altogether
+ *  + parallel_rows shares the same pool for row-wise (non-GEMM) kernels
+ */
+
+#include "tensor/xtensor_lib.h"
+#include "util/ThreadPool.h"
+#include <immintrin.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#define GEMM_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define GEMM_TARGET_AVX512 __attribute__((target("avx512f")))
+
+static const int GEMM_KC = 256;             //depth of the packed panels
+static const int GEMM_MC_TILES = 16;        //MC = 16*MR rows of A per panel
+static const int GEMM_NC_TILES = 128;       //NC = 128*NR columns of B per panel
+static const long GEMM_SMALL_FLOPS = 32768; //m*n*k up to this: no packing
+static const long GEMM_FLOPS_PER_THREAD = 1 << 21;
+static const int GEMM_MAX_TILE = 512;       //>= MR*NR of every kernel
+static const long ROWS_WORK_PER_THREAD = 1 << 15; //parallel_rows: min work per thread
+
+//////////////////////////////////////////////////////////////////////
+// Micro-kernels: C[MR x NR] += alpha * Ap * Bp, where Ap holds kc columns
+// of MR values and Bp holds kc rows of NR values (see pack_A, pack_B)
+//////////////////////////////////////////////////////////////////////
+template<typename T>
+struct GemmKernel{
+    const char* name;
+    int MR, NR;
+    void (*run)(int kc, const T* Ap, const T* Bp, T* C, int ldc, T alpha);
+};
+
+template<typename T, int MR, int NR>
+static void kernel_scalar(int kc, const T* Ap, const T* Bp, T* C, int ldc, T alpha){
+    T acc[MR][NR] = {};
+    for(int p=0; p < kc; p++){
+        for(int i=0; i < MR; i++){
+            for(int j=0; j < NR; j++) acc[i][j] += Ap[i]*Bp[j];
+        }
+        Ap += MR;
+        Bp += NR;
+    }
+    for(int i=0; i < MR; i++){
+        for(int j=0; j < NR; j++) C[i*ldc + j] += alpha*acc[i][j];
+    }
+}
+
+//SIMD registers: NR = 2*L (two vectors per row of the tile)
+struct Avx2Double{
+    typedef double T; typedef __m256d V; static const int L = 4;
+    GEMM_TARGET_AVX2 static V zero(){ return _mm256_setzero_pd(); }
+    GEMM_TARGET_AVX2 static V load(const T* p){ return _mm256_loadu_pd(p); }
+    GEMM_TARGET_AVX2 static V set1(T a){ return _mm256_set1_pd(a); }
+    GEMM_TARGET_AVX2 static V fma(V a, V b, V c){ return _mm256_fmadd_pd(a, b, c); }
+    GEMM_TARGET_AVX2 static void store(T* p, V v){ _mm256_storeu_pd(p, v); }
+};
+struct Avx2Float{
+    typedef float T; typedef __m256 V; static const int L = 8;
+    GEMM_TARGET_AVX2 static V zero(){ return _mm256_setzero_ps(); }
+    GEMM_TARGET_AVX2 static V load(const T* p){ return _mm256_loadu_ps(p); }
+    GEMM_TARGET_AVX2 static V set1(T a){ return _mm256_set1_ps(a); }
+    GEMM_TARGET_AVX2 static V fma(V a, V b, V c){ return _mm256_fmadd_ps(a, b, c); }
+    GEMM_TARGET_AVX2 static void store(T* p, V v){ _mm256_storeu_ps(p, v); }
+};
+struct Avx512Double{
+    typedef double T; typedef __m512d V; static const int L = 8;
+    GEMM_TARGET_AVX512 static V zero(){ return _mm512_setzero_pd(); }
+    GEMM_TARGET_AVX512 static V load(const T* p){ return _mm512_loadu_pd(p); }
+    GEMM_TARGET_AVX512 static V set1(T a){ return _mm512_set1_pd(a); }
+    GEMM_TARGET_AVX512 static V fma(V a, V b, V c){ return _mm512_fmadd_pd(a, b, c); }
+    GEMM_TARGET_AVX512 static void store(T* p, V v){ _mm512_storeu_pd(p, v); }
+};
+struct Avx512Float{
+    typedef float T; typedef __m512 V; static const int L = 16;
+    GEMM_TARGET_AVX512 static V zero(){ return _mm512_setzero_ps(); }
+    GEMM_TARGET_AVX512 static V load(const T* p){ return _mm512_loadu_ps(p); }
+    GEMM_TARGET_AVX512 static V set1(T a){ return _mm512_set1_ps(a); }
+    GEMM_TARGET_AVX512 static V fma(V a, V b, V c){ return _mm512_fmadd_ps(a, b, c); }
+    GEMM_TARGET_AVX512 static void store(T* p, V v){ _mm512_storeu_ps(p, v); }
+};
+
+/* The SIMD kernel body is shared by both instruction sets; it is stamped
+ * out once per target so that the intrinsics of S inline into it.
+ */
+#define GEMM_DEFINE_SIMD_KERNEL(NAME, TARGET)                                      \
+template<typename S, int MR>                                                       \
+TARGET static void NAME(int kc, const typename S::T* Ap, const typename S::T* Bp,  \
+        typename S::T* C, int ldc, typename S::T alpha){                           \
+    typename S::V c0[MR], c1[MR];                                                  \
+    _Pragma("GCC unroll 16")                                                       \
+    for(int i=0; i < MR; i++){ c0[i] = S::zero(); c1[i] = S::zero(); }             \
+    for(int p=0; p < kc; p++){                                                     \
+        typename S::V b0 = S::load(Bp), b1 = S::load(Bp + S::L);                   \
+        _Pragma("GCC unroll 16")                                                   \
+        for(int i=0; i < MR; i++){                                                 \
+            typename S::V a = S::set1(Ap[i]);                                      \
+            c0[i] = S::fma(a, b0, c0[i]);                                          \
+            c1[i] = S::fma(a, b1, c1[i]);                                          \
+        }                                                                          \
+        Ap += MR;                                                                  \
+        Bp += 2*S::L;                                                              \
+    }                                                                              \
+    typename S::V va = S::set1(alpha);                                             \
+    _Pragma("GCC unroll 16")                                                       \
+    for(int i=0; i < MR; i++){                                                     \
+        typename S::T* row = C + i*ldc;                                            \
+        S::store(row, S::fma(va, c0[i], S::load(row)));                            \
+        S::store(row + S::L, S::fma(va, c1[i], S::load(row + S::L)));              \
+    }                                                                              \
+}
+GEMM_DEFINE_SIMD_KERNEL(kernel_avx2, GEMM_TARGET_AVX2)
+GEMM_DEFINE_SIMD_KERNEL(kernel_avx512, GEMM_TARGET_AVX512)
+
+//in order of preference; gemm uses the first one the CPU supports
+static const GemmKernel<double> DOUBLE_KERNELS[] = {
+    {"avx512", 12, 16, kernel_avx512<Avx512Double, 12>},
+    {"avx2", 6, 8, kernel_avx2<Avx2Double, 6>},
+    {"scalar", 4, 8, kernel_scalar<double, 4, 8>}
+};
+static const GemmKernel<float> FLOAT_KERNELS[] = {
+    {"avx512", 12, 32, kernel_avx512<Avx512Float, 12>},
+    {"avx2", 6, 16, kernel_avx2<Avx2Float, 6>},
+    {"scalar", 4, 8, kernel_scalar<float, 4, 8>}
+};
+static const int NUM_KERNELS = 3;
+
+static bool kernel_supported(int idx){
+    __builtin_cpu_init();
+    if(idx == 0) return __builtin_cpu_supports("avx512f");
+    if(idx == 1) return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    return true;
+}
+
+static atomic<int> g_kernel_idx(-1);
+static atomic<int> g_num_threads(0);
+
+static int kernel_index(){
+    int idx = g_kernel_idx.load();
+    if(idx < 0){
+        idx = 0;
+        while(!kernel_supported(idx)) idx++;
+        g_kernel_idx.store(idx);
+    }
+    return idx;
+}
+static const GemmKernel<double>& select_kernel(const double*){ return DOUBLE_KERNELS[kernel_index()]; }
+static const GemmKernel<float>& select_kernel(const float*){ return FLOAT_KERNELS[kernel_index()]; }
+
+string gemm_kernel(){
+    return DOUBLE_KERNELS[kernel_index()].name;
+}
+bool gemm_set_kernel(string name){
+    for(int idx=0; idx < NUM_KERNELS; idx++){
+        if(name == DOUBLE_KERNELS[idx].name){
+            if(!kernel_supported(idx)) return false;
+            g_kernel_idx.store(idx);
+            return true;
+        }
+    }
+    return false;
+}
+void gemm_set_num_threads(int num_threads){
+    g_num_threads.store(num_threads);
+}
+int gemm_get_num_threads(){
+    int num_threads = g_num_threads.load();
+    //hardware_concurrency reads /sys on each call: once is enough
+    static const int hw_threads = max(1, int(thread::hardware_concurrency()));
+    if(num_threads <= 0) num_threads = hw_threads;
+    return num_threads;
+}
+
+//workers for the blocks other than the first one (run by the caller)
+static ThreadPool& gemm_pool(){
+    static ThreadPool pool(max(1, int(thread::hardware_concurrency()) - 1));
+    return pool;
+}
+//set while a thread (a pool worker, or the caller for block 0) runs a block:
+//nested calls then stay on that thread, so a block never waits on jobs
+//queued behind it
+static thread_local bool t_in_block = false;
+
+/* run_blocks:
+ *  block(0) .. block(nblocks-1): the caller runs block 0, the pool the rest;
+ *  returns when all are done, rethrowing the first exception
+ */
+static void run_blocks(int nblocks, const function<void(int)>& block){
+    vector<future<void>> pending;
+    for(int idx=1; idx < nblocks; idx++){
+        pending.push_back(gemm_pool().submit([&block, idx](){
+            t_in_block = true;
+            try{
+                block(idx);
+            }
+            catch(...){
+                t_in_block = false;
+                throw;
+            }
+            t_in_block = false;
+        }));
+    }
+    exception_ptr error = nullptr;
+    bool was_in_block = t_in_block;
+    t_in_block = true;
+    try{
+        block(0);
+    }
+    catch(...){
+        error = current_exception();
+    }
+    t_in_block = was_in_block;
+    for(auto& job: pending) job.wait(); //the caller's data must outlive the jobs
+    if(error) rethrow_exception(error);
+    for(auto& job: pending) job.get();
+}
+
+void run_serial(const function<void()>& body){
+    bool was_in_block = t_in_block;
+    t_in_block = true;
+    try{
+        body();
+    }
+    catch(...){
+        t_in_block = was_in_block;
+        throw;
+    }
+    t_in_block = was_in_block;
+}
+
+void parallel_rows(int nrows, long work, const function<void(int, int)>& body){
+    int nthreads = (int)min<long>(gemm_get_num_threads(), max<long>(1, work/ROWS_WORK_PER_THREAD));
+    nthreads = min(nthreads, nrows);
+    if(nthreads <= 1 || t_in_block){
+        if(nrows > 0) body(0, nrows);
+        return;
+    }
+    int per_block = (nrows + nthreads - 1)/nthreads;
+    int nblocks = (nrows + per_block - 1)/per_block;
+    run_blocks(nblocks, [&](int idx){
+        body(idx*per_block, min(nrows, (idx + 1)*per_block));
+    });
+}
+
+//////////////////////////////////////////////////////////////////////
+// Packing: op(A)(i, p) and op(B)(p, j) into the layouts of the kernels,
+// padded with zeros up to a multiple of MR (resp. NR)
+//////////////////////////////////////////////////////////////////////
+template<typename T>
+static void pack_A(bool trans, const T* A, int lda, int mc, int kc, int MR, T* Ap){
+    for(int ir=0; ir < mc; ir += MR){
+        int mr = min(MR, mc - ir);
+        for(int p=0; p < kc; p++){
+            int i = 0;
+            if(trans){
+                const T* src = A + p*lda + ir;
+                for(; i < mr; i++) Ap[i] = src[i];
+            }
+            else{
+                const T* src = A + ir*lda + p;
+                for(; i < mr; i++) Ap[i] = src[i*lda];
+            }
+            for(; i < MR; i++) Ap[i] = 0;
+            Ap += MR;
+        }
+    }
+}
+template<typename T>
+static void pack_B(bool trans, const T* B, int ldb, int kc, int nc, int NR, T* Bp){
+    for(int jr=0; jr < nc; jr += NR){
+        int nr = min(NR, nc - jr);
+        for(int p=0; p < kc; p++){
+            int j = 0;
+            if(trans){
+                const T* src = B + jr*ldb + p;
+                for(; j < nr; j++) Bp[j] = src[j*ldb];
+            }
+            else{
+                const T* src = B + p*ldb + jr;
+                for(; j < nr; j++) Bp[j] = src[j];
+            }
+            for(; j < NR; j++) Bp[j] = 0;
+            Bp += NR;
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+// Drivers; C has already been scaled by beta
+//////////////////////////////////////////////////////////////////////
+/* gemm_small:
+ *  straight loops for products too small to amortize packing
+ */
+template<typename T>
+static void gemm_small(bool ta, bool tb, int m, int n, int k, T alpha,
+        const T* A, int lda, const T* B, int ldb, T* C, int ldc){
+    for(int i=0; i < m; i++){
+        T* c = C + i*ldc;
+        if(tb){
+            //row i of op(A) against rows of B: dot products
+            for(int j=0; j < n; j++){
+                const T* b = B + j*ldb;
+                T sum = 0;
+                if(ta) for(int p=0; p < k; p++) sum += A[p*lda + i]*b[p];
+                else   for(int p=0; p < k; p++) sum += A[i*lda + p]*b[p];
+                c[j] += alpha*sum;
+            }
+        }
+        else{
+            //c += op(A)(i, p) * row p of B
+            for(int p=0; p < k; p++){
+                T a = alpha*(ta ? A[p*lda + i] : A[i*lda + p]);
+                const T* b = B + p*ldb;
+                for(int j=0; j < n; j++) c[j] += a*b[j];
+            }
+        }
+    }
+}
+
+/* gemm_blocked:
+ *  C(m x n) += alpha*op(A)*op(B) on one thread, panel by panel
+ */
+template<typename T>
+static void gemm_blocked(const GemmKernel<T>& kernel, bool ta, bool tb, int m, int n, int k, T alpha,
+        const T* A, int lda, const T* B, int ldb, T* C, int ldc){
+    const int MR = kernel.MR, NR = kernel.NR;
+    const int MC = GEMM_MC_TILES*MR, NC = GEMM_NC_TILES*NR, KC = GEMM_KC;
+    thread_local vector<T> bufA, bufB;
+    bufA.resize((size_t)MC*KC);
+    bufB.resize((size_t)NC*KC);
+    T tile[GEMM_MAX_TILE];
+
+    for(int jc=0; jc < n; jc += NC){
+        int nc = min(NC, n - jc);
+        for(int pc=0; pc < k; pc += KC){
+            int kc = min(KC, k - pc);
+            pack_B(tb, tb ? B + jc*ldb + pc : B + pc*ldb + jc, ldb, kc, nc, NR, bufB.data());
+            for(int ic=0; ic < m; ic += MC){
+                int mc = min(MC, m - ic);
+                pack_A(ta, ta ? A + pc*lda + ic : A + ic*lda + pc, lda, mc, kc, MR, bufA.data());
+                for(int jr=0; jr < nc; jr += NR){
+                    int nr = min(NR, nc - jr);
+                    for(int ir=0; ir < mc; ir += MR){
+                        int mr = min(MR, mc - ir);
+                        const T* Ap = bufA.data() + ir*kc;
+                        const T* Bp = bufB.data() + jr*kc;
+                        T* Cij = C + (ic + ir)*ldc + jc + jr;
+                        if(mr == MR && nr == NR){
+                            kernel.run(kc, Ap, Bp, Cij, ldc, alpha);
+                            continue;
+                        }
+                        //edge tile: compute a full tile aside, add the valid part
+                        std::fill(tile, tile + MR*NR, T(0));
+                        kernel.run(kc, Ap, Bp, tile, NR, alpha);
+                        for(int i=0; i < mr; i++){
+                            for(int j=0; j < nr; j++) Cij[i*ldc + j] += tile[i*NR + j];
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+template<typename T>
+static void gemm_impl(bool ta, bool tb, int m, int n, int k,
+        T alpha, const T* A, int lda, const T* B, int ldb,
+        T beta, T* C, int ldc){
+    if(m <= 0 || n <= 0) return;
+    if(beta != T(1)){
+        for(int i=0; i < m; i++){
+            T* c = C + i*ldc;
+            if(beta == T(0)) std::fill(c, c + n, T(0));
+            else for(int j=0; j < n; j++) c[j] *= beta;
+        }
+    }
+    if(k <= 0 || alpha == T(0)) return;
+
+    long flops = (long)m*n*k;
+    if(flops <= GEMM_SMALL_FLOPS){
+        gemm_small(ta, tb, m, n, k, alpha, A, lda, B, ldb, C, ldc);
+        return;
+    }
+    const GemmKernel<T>& kernel = select_kernel(A);
+    int nthreads = (int)min<long>(gemm_get_num_threads(), max<long>(1, flops/GEMM_FLOPS_PER_THREAD));
+    if(nthreads <= 1 || t_in_block){
+        gemm_blocked(kernel, ta, tb, m, n, k, alpha, A, lda, B, ldb, C, ldc);
+        return;
+    }
+
+    //split the output along its longer side (in whole tiles) into nthreads blocks
+    int mtiles = (m + kernel.MR - 1)/kernel.MR;
+    int ntiles = (n + kernel.NR - 1)/kernel.NR;
+    bool split_n = ntiles >= mtiles;
+    int tiles = split_n ? ntiles : mtiles;
+    int tile_size = split_n ? kernel.NR : kernel.MR;
+    int extent = split_n ? n : m;
+    nthreads = min(nthreads, tiles);
+    int per_block = (tiles + nthreads - 1)/nthreads * tile_size;
+    int nblocks = (extent + per_block - 1)/per_block;
+
+    run_blocks(nblocks, [=, &kernel](int idx){
+        int start = idx*per_block;
+        int len = min(per_block, extent - start);
+        if(split_n){
+            const T* Bs = tb ? B + start*ldb : B + start;
+            gemm_blocked(kernel, ta, tb, m, len, k, alpha, A, lda, Bs, ldb, C + start, ldc);
+        }
+        else{
+            const T* As = ta ? A + start : A + start*lda;
+            gemm_blocked(kernel, ta, tb, len, n, k, alpha, As, lda, B, ldb, C + start*ldc, ldc);
+        }
+    });
+}
+
+void gemm(bool trans_a, bool trans_b, int m, int n, int k,
+        double alpha, const double* A, int lda, const double* B, int ldb,
+        double beta, double* C, int ldc){
+    gemm_impl(trans_a, trans_b, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+void gemm(bool trans_a, bool trans_b, int m, int n, int k,
+        float alpha, const float* A, int lda, const float* B, int ldb,
+        float beta, float* C, int ldc){
+    gemm_impl(trans_a, trans_b, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc);
+}
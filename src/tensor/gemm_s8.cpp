@@ -0,0 +1,378 @@
+/*
+ * File:   gemm_s8.cpp
+ * Purpose: gemm_s8, quantize_s8 and dequantize_s32 (see xtensor_lib.h), the
+ *          int8 kernels of quantized inference.
+ *  + C = A*B^T: A (activations) and B (weights) are both read along k; B is
+ *      packed into the column panels of the kernel, once for weights
+ *      (gemm_s8_pack) or on each gemm_s8 call
+ *  + AVX-512 VNNI: vpdpbusd multiplies unsigned by signed bytes (4 per
+ *      int32 lane), so A is shifted to A + 128 and the shift taken back off
+ *  + AVX2: bytes are widened to int16 and summed in pairs (vpmaddwd)
+ *  + rows of A are shared out on gemm's threads (parallel_rows)
+ */
+
+#include "tensor/xtensor_lib.h"
+#include <immintrin.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include "sformat/fmt_lib.h"
+
+#define QGEMM_TARGET_AVX2 __attribute__((target("avx2")))
+#define QGEMM_TARGET_VNNI __attribute__((target("avx512f,avx512bw,avx512vl,avx512vnni")))
+
+static const int QGEMM_MR = 4;            //rows of A per kernel call (4 accumulators)
+static const long QGEMM_WORK_PER_MAC = 8; //parallel_rows: MACs per value touched
+static const long QGEMM_HEADER = 64;      //packed B: kernel, n, k, then the panels
+
+//////////////////////////////////////////////////////////////////////
+// Packing: B (n x k) into panels of NR columns, k split in groups of G
+// values stored side by side per column ([panel][group][column][G]),
+// zero-padded up to a multiple of NR columns and G values.
+// Packed layouts (after the header):
+//  + scalar: B as is, n x k
+//  + avx2: int16 panels, NR = 8, G = 2
+//  + avx512vnni: offset(j) = 128*sum_k B(j, k) as int32 (padded to a
+//      multiple of 16 columns), then int8 panels, NR = 16, G = 4
+//////////////////////////////////////////////////////////////////////
+static long panels_size(int n, int k, int NR, int G){
+    return long((n + NR - 1)/NR)*((k + G - 1)/G)*G*NR;
+}
+template<typename P, int NR, int G>
+static void pack_panels(int n, int k, const int8_t* B, int ldb, P* Bp){
+    int ngroups = (k + G - 1)/G;
+    std::fill(Bp, Bp + panels_size(n, k, NR, G), P(0));
+    for(int j=0; j < n; j++){
+        P* panel = Bp + (size_t)(j/NR)*ngroups*G*NR + (j%NR)*G;
+        const int8_t* b = B + long(j)*ldb;
+        for(int p=0; p < k; p++) panel[(p/G)*G*NR + p%G] = b[p];
+    }
+}
+
+static long pack_size_scalar(int n, int k){ return long(n)*k; }
+static void pack_scalar(int n, int k, const int8_t* B, int ldb, int8_t* packed){
+    for(int j=0; j < n; j++) std::copy(B + long(j)*ldb, B + long(j)*ldb + k, packed + long(j)*k);
+}
+static long pack_size_avx2(int n, int k){ return panels_size(n, k, 8, 2)*sizeof(int16_t); }
+static void pack_avx2(int n, int k, const int8_t* B, int ldb, int8_t* packed){
+    pack_panels<int16_t, 8, 2>(n, k, B, ldb, (int16_t*)packed);
+}
+static long pack_size_vnni(int n, int k){
+    return long((n + 15)/16*16)*sizeof(int32_t) + panels_size(n, k, 16, 4);
+}
+static void pack_vnni(int n, int k, const int8_t* B, int ldb, int8_t* packed){
+    int32_t* offset = (int32_t*)packed;
+    std::fill(offset, offset + (n + 15)/16*16, 0);
+    for(int j=0; j < n; j++){
+        int32_t sum = 0;
+        for(int p=0; p < k; p++) sum += B[long(j)*ldb + p];
+        offset[j] = 128*sum;
+    }
+    pack_panels<int8_t, 16, 4>(n, k, B, ldb, packed + (n + 15)/16*16*sizeof(int32_t));
+}
+
+//////////////////////////////////////////////////////////////////////
+// Row blocks: C(i, :) for i in [begin, end), QGEMM_MR rows at a time
+// against every panel of B
+//////////////////////////////////////////////////////////////////////
+static void rows_scalar(int begin, int end, int n, int k,
+        const int8_t* A, int lda, const int8_t* packed, int32_t* C, int ldc){
+    for(int i=begin; i < end; i++){
+        const int8_t* a = A + long(i)*lda;
+        for(int j=0; j < n; j++){
+            const int8_t* b = packed + long(j)*k;
+            int32_t sum = 0;
+            for(int p=0; p < k; p++) sum += int32_t(a[p])*int32_t(b[p]);
+            C[long(i)*ldc + j] = sum;
+        }
+    }
+}
+/* group_s16, group_u8:
+ *  the g-th group of row a as one int32 to broadcast: two values widened to
+ *  int16 (AVX2), or four bytes shifted to unsigned (VNNI); past k: zeros
+ *  (before the shift). Built once per block of rows, for all panels.
+ */
+static inline int32_t group_s16(const int8_t* a, int g, int k){
+    int p = 2*g;
+    int16_t lo = a[p], hi = (p + 1 < k) ? a[p + 1] : 0;
+    return int32_t(uint16_t(lo)) | (int32_t(uint16_t(hi)) << 16);
+}
+static inline int32_t group_u8(const int8_t* a, int g, int k){
+    uint8_t bytes[4] = {0, 0, 0, 0};
+    int p = 4*g;
+    if(p + 4 <= k) memcpy(bytes, a + p, 4);
+    else for(int t=0; p + t < k; t++) bytes[t] = a[p + t];
+    int32_t quad;
+    memcpy(&quad, bytes, 4);
+    return quad ^ int32_t(0x80808080);
+}
+QGEMM_TARGET_AVX2 static void rows_avx2(int begin, int end, int n, int k,
+        const int8_t* A, int lda, const int8_t* packed, int32_t* C, int ldc){
+    const int NR = 8;
+    const int16_t* Bp = (const int16_t*)packed;
+    int ngroups = (k + 1)/2;
+    int npanels = (n + NR - 1)/NR;
+    static thread_local vector<int32_t> groups; //[group][row]
+    if(groups.size() < (size_t)ngroups*QGEMM_MR) groups.resize((size_t)ngroups*QGEMM_MR);
+    for(int i0=begin; i0 < end; i0 += QGEMM_MR){
+        int mr = min(QGEMM_MR, end - i0);
+        //rows past end repeat the last one (not stored)
+        for(int r=0; r < QGEMM_MR; r++){
+            const int8_t* a = A + long(i0 + min(r, mr - 1))*lda;
+            for(int g=0; g < ngroups; g++) groups[(size_t)g*QGEMM_MR + r] = group_s16(a, g, k);
+        }
+        for(int jp=0; jp < npanels; jp++){
+            const int16_t* panel = Bp + (size_t)jp*ngroups*2*NR;
+            __m256i acc0 = _mm256_setzero_si256(), acc1 = _mm256_setzero_si256();
+            __m256i acc2 = _mm256_setzero_si256(), acc3 = _mm256_setzero_si256();
+            for(int g=0; g < ngroups; g++){
+                __m256i b = _mm256_loadu_si256((const __m256i*)(panel + (size_t)g*2*NR));
+                const int32_t* group = groups.data() + (size_t)g*QGEMM_MR;
+                acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(_mm256_set1_epi32(group[0]), b));
+                acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(_mm256_set1_epi32(group[1]), b));
+                acc2 = _mm256_add_epi32(acc2, _mm256_madd_epi16(_mm256_set1_epi32(group[2]), b));
+                acc3 = _mm256_add_epi32(acc3, _mm256_madd_epi16(_mm256_set1_epi32(group[3]), b));
+            }
+            __m256i acc[QGEMM_MR] = {acc0, acc1, acc2, acc3};
+            int nc = min(NR, n - jp*NR);
+            for(int r=0; r < mr; r++){
+                int32_t* c = C + long(i0 + r)*ldc + jp*NR;
+                if(nc == NR) _mm256_storeu_si256((__m256i*)c, acc[r]);
+                else{
+                    int32_t tile[NR];
+                    _mm256_storeu_si256((__m256i*)tile, acc[r]);
+                    std::copy(tile, tile + nc, c);
+                }
+            }
+        }
+    }
+}
+QGEMM_TARGET_VNNI static void rows_vnni(int begin, int end, int n, int k,
+        const int8_t* A, int lda, const int8_t* packed, int32_t* C, int ldc){
+    const int NR = 16;
+    const int32_t* offset = (const int32_t*)packed;
+    const int8_t* Bp = packed + (n + 15)/16*16*sizeof(int32_t);
+    int ngroups = (k + 3)/4;
+    int npanels = (n + NR - 1)/NR;
+    static thread_local vector<int32_t> groups; //[group][row]
+    if(groups.size() < (size_t)ngroups*QGEMM_MR) groups.resize((size_t)ngroups*QGEMM_MR);
+    for(int i0=begin; i0 < end; i0 += QGEMM_MR){
+        int mr = min(QGEMM_MR, end - i0);
+        //rows past end repeat the last one (not stored)
+        for(int r=0; r < QGEMM_MR; r++){
+            const int8_t* a = A + long(i0 + min(r, mr - 1))*lda;
+            for(int g=0; g < ngroups; g++) groups[(size_t)g*QGEMM_MR + r] = group_u8(a, g, k);
+        }
+        for(int jp=0; jp < npanels; jp++){
+            const int8_t* panel = Bp + (size_t)jp*ngroups*4*NR;
+            __m512i acc0 = _mm512_setzero_si512(), acc1 = _mm512_setzero_si512();
+            __m512i acc2 = _mm512_setzero_si512(), acc3 = _mm512_setzero_si512();
+            for(int g=0; g < ngroups; g++){
+                __m512i b = _mm512_loadu_si512((const void*)(panel + (size_t)g*4*NR));
+                const int32_t* group = groups.data() + (size_t)g*QGEMM_MR;
+                acc0 = _mm512_dpbusd_epi32(acc0, _mm512_set1_epi32(group[0]), b);
+                acc1 = _mm512_dpbusd_epi32(acc1, _mm512_set1_epi32(group[1]), b);
+                acc2 = _mm512_dpbusd_epi32(acc2, _mm512_set1_epi32(group[2]), b);
+                acc3 = _mm512_dpbusd_epi32(acc3, _mm512_set1_epi32(group[3]), b);
+            }
+            __m512i off = _mm512_loadu_si512((const void*)(offset + jp*NR));
+            __m512i acc[QGEMM_MR] = {acc0, acc1, acc2, acc3};
+            int nc = min(NR, n - jp*NR);
+            __mmask16 store_mask = (__mmask16)((1u << nc) - 1);
+            for(int r=0; r < mr; r++){
+                int32_t* c = C + long(i0 + r)*ldc + jp*NR;
+                _mm512_mask_storeu_epi32(c, store_mask, _mm512_sub_epi32(acc[r], off));
+            }
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+// quantize_s8: q = clamp(round(x/scale), -127, 127)
+//////////////////////////////////////////////////////////////////////
+template<typename T>
+static void quantize_scalar(const T* X, int8_t* Q, long n, T inv_scale){
+    for(long i=0; i < n; i++){
+        T q = std::nearbyint(X[i]*inv_scale);
+        Q[i] = int8_t(std::min(T(127), std::max(T(-127), q)));
+    }
+}
+QGEMM_TARGET_VNNI static void quantize_avx512(const double* X, int8_t* Q, long n, double inv_scale){
+    __m512d s = _mm512_set1_pd(inv_scale), lo = _mm512_set1_pd(-127), hi = _mm512_set1_pd(127);
+    long i = 0;
+    for(; i + 8 <= n; i += 8){
+        __m512d x = _mm512_min_pd(_mm512_max_pd(_mm512_mul_pd(_mm512_loadu_pd(X + i), s), lo), hi);
+        _mm_storel_epi64((__m128i*)(Q + i), _mm512_cvtepi32_epi8(_mm512_castsi256_si512(_mm512_cvtpd_epi32(x))));
+    }
+    quantize_scalar(X + i, Q + i, n - i, inv_scale);
+}
+QGEMM_TARGET_VNNI static void quantize_avx512(const float* X, int8_t* Q, long n, float inv_scale){
+    __m512 s = _mm512_set1_ps(inv_scale), lo = _mm512_set1_ps(-127), hi = _mm512_set1_ps(127);
+    long i = 0;
+    for(; i + 16 <= n; i += 16){
+        __m512 x = _mm512_min_ps(_mm512_max_ps(_mm512_mul_ps(_mm512_loadu_ps(X + i), s), lo), hi);
+        _mm_storeu_si128((__m128i*)(Q + i), _mm512_cvtepi32_epi8(_mm512_cvtps_epi32(x)));
+    }
+    quantize_scalar(X + i, Q + i, n - i, inv_scale);
+}
+
+//////////////////////////////////////////////////////////////////////
+// dequantize_s32: Y(i, j) = C(i, j)*scale(j) + bias(j)
+//////////////////////////////////////////////////////////////////////
+template<typename T>
+static void dequantize_scalar(int m, int n, const int32_t* C, int ldc,
+        const T* scale, const T* bias, T* Y, int ldy){
+    for(int i=0; i < m; i++){
+        const int32_t* c = C + long(i)*ldc;
+        T* y = Y + long(i)*ldy;
+        if(bias != nullptr) for(int j=0; j < n; j++) y[j] = c[j]*scale[j] + bias[j];
+        else for(int j=0; j < n; j++) y[j] = c[j]*scale[j];
+    }
+}
+QGEMM_TARGET_VNNI static void dequantize_avx512(int m, int n, const int32_t* C, int ldc,
+        const double* scale, const double* bias, double* Y, int ldy){
+    for(int i=0; i < m; i++){
+        const int32_t* c = C + long(i)*ldc;
+        double* y = Y + long(i)*ldy;
+        for(int j=0; j < n; j += 8){
+            __mmask8 mask = (__mmask8)((n - j >= 8) ? 0xFF : ((1u << (n - j)) - 1));
+            __m512d v = _mm512_cvtepi32_pd(_mm256_maskz_loadu_epi32(mask, c + j));
+            __m512d b = (bias != nullptr) ? _mm512_maskz_loadu_pd(mask, bias + j) : _mm512_setzero_pd();
+            _mm512_mask_storeu_pd(y + j, mask, _mm512_fmadd_pd(v, _mm512_maskz_loadu_pd(mask, scale + j), b));
+        }
+    }
+}
+QGEMM_TARGET_VNNI static void dequantize_avx512(int m, int n, const int32_t* C, int ldc,
+        const float* scale, const float* bias, float* Y, int ldy){
+    for(int i=0; i < m; i++){
+        const int32_t* c = C + long(i)*ldc;
+        float* y = Y + long(i)*ldy;
+        for(int j=0; j < n; j += 16){
+            __mmask16 mask = (__mmask16)((n - j >= 16) ? 0xFFFF : ((1u << (n - j)) - 1));
+            __m512 v = _mm512_cvtepi32_ps(_mm512_maskz_loadu_epi32(mask, c + j));
+            __m512 b = (bias != nullptr) ? _mm512_maskz_loadu_ps(mask, bias + j) : _mm512_setzero_ps();
+            _mm512_mask_storeu_ps(y + j, mask, _mm512_fmadd_ps(v, _mm512_maskz_loadu_ps(mask, scale + j), b));
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+// Kernel selection, as in gemm.cpp
+//////////////////////////////////////////////////////////////////////
+struct QGemmKernel{
+    const char* name;
+    long (*pack_size)(int n, int k);
+    void (*pack)(int n, int k, const int8_t* B, int ldb, int8_t* packed);
+    void (*rows)(int begin, int end, int n, int k,
+                 const int8_t* A, int lda, const int8_t* packed, int32_t* C, int ldc);
+};
+//in order of preference; gemm_s8 uses the first one the CPU supports
+static const QGemmKernel QGEMM_KERNELS[] = {
+    {"avx512vnni", pack_size_vnni, pack_vnni, rows_vnni},
+    {"avx2", pack_size_avx2, pack_avx2, rows_avx2},
+    {"scalar", pack_size_scalar, pack_scalar, rows_scalar}
+};
+static const int NUM_KERNELS = 3;
+
+static bool kernel_supported(int idx){
+    __builtin_cpu_init();
+    if(idx == 0){
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+               __builtin_cpu_supports("avx512vnni");
+    }
+    if(idx == 1) return __builtin_cpu_supports("avx2");
+    return true;
+}
+
+static atomic<int> g_kernel_idx(-1);
+
+static int kernel_index(){
+    int idx = g_kernel_idx.load();
+    if(idx < 0){
+        idx = 0;
+        while(!kernel_supported(idx)) idx++;
+        g_kernel_idx.store(idx);
+    }
+    return idx;
+}
+
+string gemm_s8_kernel(){
+    return QGEMM_KERNELS[kernel_index()].name;
+}
+bool gemm_s8_set_kernel(string name){
+    for(int idx=0; idx < NUM_KERNELS; idx++){
+        if(name == QGEMM_KERNELS[idx].name){
+            if(!kernel_supported(idx)) return false;
+            g_kernel_idx.store(idx);
+            return true;
+        }
+    }
+    return false;
+}
+
+long gemm_s8_pack_size(int n, int k){
+    return QGEMM_HEADER + QGEMM_KERNELS[kernel_index()].pack_size(n, k);
+}
+void gemm_s8_pack(int n, int k, const int8_t* B, int ldb, int8_t* packed){
+    int32_t header[3] = {kernel_index(), n, k};
+    std::fill(packed, packed + QGEMM_HEADER, int8_t(0));
+    memcpy(packed, header, sizeof(header));
+    QGEMM_KERNELS[header[0]].pack(n, k, B, ldb, packed + QGEMM_HEADER);
+}
+void gemm_s8_packed(int m, int n, int k, const int8_t* A, int lda,
+        const int8_t* packed, int32_t* C, int ldc){
+    int32_t header[3];
+    memcpy(header, packed, sizeof(header));
+    if((header[1] != n) || (header[2] != k) || (header[0] < 0) || (header[0] >= NUM_KERNELS)){
+        throw std::invalid_argument(fmt::format(
+            "gemm_s8_packed: B was packed as {:d} x {:d}, used as {:d} x {:d}",
+            header[1], header[2], n, k));
+    }
+    if(m <= 0 || n <= 0) return;
+    if(k <= 0){
+        for(int i=0; i < m; i++) std::fill(C + long(i)*ldc, C + long(i)*ldc + n, 0);
+        return;
+    }
+    //the kernel B was packed for (the current one may have changed since)
+    auto rows = QGEMM_KERNELS[header[0]].rows;
+    const int8_t* Bp = packed + QGEMM_HEADER;
+    parallel_rows(m, long(m)*n*k/QGEMM_WORK_PER_MAC, [=](int begin, int end){
+        rows(begin, end, n, k, A, lda, Bp, C, ldc);
+    });
+}
+void gemm_s8(int m, int n, int k, const int8_t* A, int lda,
+        const int8_t* B, int ldb, int32_t* C, int ldc){
+    static thread_local vector<int8_t> packed;
+    packed.resize(gemm_s8_pack_size(n, k));
+    gemm_s8_pack(n, k, B, ldb, packed.data());
+    gemm_s8_packed(m, n, k, A, lda, packed.data(), C, ldc);
+}
+
+template<typename T>
+static void quantize_impl(const T* X, int8_t* Q, long n, T scale){
+    static const bool use_avx512 = kernel_supported(0);
+    T inv_scale = T(1)/scale;
+    if(use_avx512) quantize_avx512(X, Q, n, inv_scale);
+    else quantize_scalar(X, Q, n, inv_scale);
+}
+void quantize_s8(const double* X, int8_t* Q, long n, double scale){ quantize_impl(X, Q, n, scale); }
+void quantize_s8(const float* X, int8_t* Q, long n, float scale){ quantize_impl(X, Q, n, scale); }
+
+template<typename T>
+static void dequantize_impl(int m, int n, const int32_t* C, int ldc,
+        const T* scale, const T* bias, T* Y, int ldy){
+    static const bool use_avx512 = kernel_supported(0);
+    if(use_avx512) dequantize_avx512(m, n, C, ldc, scale, bias, Y, ldy);
+    else dequantize_scalar(m, n, C, ldc, scale, bias, Y, ldy);
+}
+void dequantize_s32(int m, int n, const int32_t* C, int ldc,
+        const double* scale, const double* bias, double* Y, int ldy){
+    dequantize_impl(m, n, C, ldc, scale, bias, Y, ldy);
+}
+void dequantize_s32(int m, int n, const int32_t* C, int ldc,
+        const float* scale, const float* bias, float* Y, int ldy){
+    dequantize_impl(m, n, C, ldc, scale, bias, Y, ldy);
+}
@@ -0,0 +1,596 @@
+/*
+ * File:   vmath.cpp
+ * Purpose: vexp, vtanh, vsigmoid and the packed-mask ReLU over arrays
+ *          (see xtensor_lib.h)
+ *  + each function is written once over a few vector operations (the
+ *      Vm* structs) and compiled for AVX-512, AVX2+FMA and portable C++
+ *      (one value per "vector"); the instruction set is picked at run time
+ *  + exp(x) = 2^n * exp(r), n = round(x/ln2), |r| <= ln2/2, where exp(r)
+ *      is its Taylor polynomial; exact and fast modes differ only in the
+ *      degree (VmConst::EXACT_DEGREE, VmConst::FAST_DEGREE)
+ *  + tanh(|x|) = u/(u + 2) with u = expm1(2|x|), and sigmoid goes through
+ *      exp(-|x|): neither overflows nor cancels
+ *  + relu_forward/relu_backward keep the ReLU mask packed, one bit per
+ *      value, and apply it with a masked move (blend)
+ *  + long arrays are cut into chunks that run on gemm's threads
+ */
+
+#include "tensor/xtensor_lib.h"
+#include <immintrin.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+#define VMATH_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define VMATH_TARGET_AVX512 __attribute__((target("avx512f")))
+#define VMATH_TARGET_NONE
+
+static const long VMATH_CHUNK = 4096;        //values per parallel_rows row
+static const long VMATH_WORK_PER_VALUE = 16; //cost of one value for parallel_rows
+
+//////////////////////////////////////////////////////////////////////
+// Constants: range reduction, clamping and 1/k! for the polynomials
+//////////////////////////////////////////////////////////////////////
+template<typename T>
+struct VmConst;
+
+template<>
+struct VmConst<double>{
+    typedef uint64_t U;
+    static const int EXACT_DEGREE = 13, FAST_DEGREE = 7;
+    static const int MANT_BITS = 52, BIAS = 1023;
+    static constexpr double MAGIC = 6755399441055744.0;  //1.5*2^52: x + MAGIC rounds x to an integer
+    static constexpr double LOG2E = 1.4426950408889634;
+    static constexpr double LN2_HI = 0.693147180369123816490; //LN2_HI + LN2_LO = ln2
+    static constexpr double LN2_LO = 1.90821492927058770002e-10;
+    static constexpr double EXP_LO = -746.0, EXP_HI = 710.0; //exp is 0 (resp. inf) beyond
+    static constexpr double TANH_HI = 20.0;                  //tanh rounds to 1 beyond
+};
+
+template<>
+struct VmConst<float>{
+    typedef uint32_t U;
+    static const int EXACT_DEGREE = 7, FAST_DEGREE = 5;
+    static const int MANT_BITS = 23, BIAS = 127;
+    static constexpr float MAGIC = 12582912.0f; //1.5*2^23
+    static constexpr float LOG2E = 1.44269504f;
+    static constexpr float LN2_HI = 0.693359375f;
+    static constexpr float LN2_LO = -2.12194440e-4f;
+    static constexpr float EXP_LO = -104.0f, EXP_HI = 89.0f;
+    static constexpr float TANH_HI = 10.0f;
+};
+
+//1/k!, k = 0 .. 13
+static const double INV_FACT[14] = {
+    1.0, 1.0, 1.0/2, 1.0/6, 1.0/24, 1.0/120, 1.0/720, 1.0/5040, 1.0/40320,
+    1.0/362880, 1.0/3628800, 1.0/39916800, 1.0/479001600, 1.0/6227020800.0
+};
+
+//////////////////////////////////////////////////////////////////////
+// Vector operations. pow2i(n): 2^n for integral n in the normal range,
+// built in the exponent field (n + MAGIC holds n in its low bits).
+// ge0_bits(x): bit l set iff lane l of x is >= 0 (not NaN);
+// keep_bits(bits, v): lane l of v where bit l is set, 0 elsewhere
+//////////////////////////////////////////////////////////////////////
+template<typename T_>
+struct VmScalar{
+    typedef T_ T; typedef T_ V; static const int L = 1;
+    typedef typename VmConst<T>::U U;
+    static V load(const T* p){ return *p; }
+    static void store(T* p, V v){ *p = v; }
+    static V set1(T a){ return a; }
+    static V add(V a, V b){ return a + b; }
+    static V sub(V a, V b){ return a - b; }
+    static V mul(V a, V b){ return a*b; }
+    static V div(V a, V b){ return a/b; }
+    static V fma(V a, V b, V c){ return a*b + c; }
+    static V sqrt(V a){ return std::sqrt(a); }
+    static V min(V a, V b){ return a < b ? a : b; }
+    static V max(V a, V b){ return a > b ? a : b; }
+    static V abs(V a){ return std::fabs(a); }
+    static V copysign(V mag, V sgn){ return std::copysign(mag, sgn); }
+    static V select_neg(V x, V a, V b){ return std::signbit(x) ? a : b; }
+    static V fix_nan(V r, V x){ return (x != x) ? x : r; }
+    static V pow2i(V n){
+        V t = n + VmConst<T>::MAGIC;
+        U bits;
+        memcpy(&bits, &t, sizeof(bits));
+        bits = (bits + VmConst<T>::BIAS) << VmConst<T>::MANT_BITS;
+        memcpy(&t, &bits, sizeof(bits));
+        return t;
+    }
+    static unsigned ge0_bits(V x){ return x >= 0; }
+    static V keep_bits(unsigned bits, V v){ return (bits & 1) ? v : V(0); }
+};
+
+struct VmAvx2Double{
+    typedef double T; typedef __m256d V; static const int L = 4;
+    VMATH_TARGET_AVX2 static V load(const T* p){ return _mm256_loadu_pd(p); }
+    VMATH_TARGET_AVX2 static void store(T* p, V v){ _mm256_storeu_pd(p, v); }
+    VMATH_TARGET_AVX2 static V set1(T a){ return _mm256_set1_pd(a); }
+    VMATH_TARGET_AVX2 static V add(V a, V b){ return _mm256_add_pd(a, b); }
+    VMATH_TARGET_AVX2 static V sub(V a, V b){ return _mm256_sub_pd(a, b); }
+    VMATH_TARGET_AVX2 static V mul(V a, V b){ return _mm256_mul_pd(a, b); }
+    VMATH_TARGET_AVX2 static V div(V a, V b){ return _mm256_div_pd(a, b); }
+    VMATH_TARGET_AVX2 static V fma(V a, V b, V c){ return _mm256_fmadd_pd(a, b, c); }
+    VMATH_TARGET_AVX2 static V sqrt(V a){ return _mm256_sqrt_pd(a); }
+    VMATH_TARGET_AVX2 static V min(V a, V b){ return _mm256_min_pd(a, b); }
+    VMATH_TARGET_AVX2 static V max(V a, V b){ return _mm256_max_pd(a, b); }
+    VMATH_TARGET_AVX2 static V abs(V a){ return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+    VMATH_TARGET_AVX2 static V copysign(V mag, V sgn){
+        return _mm256_or_pd(mag, _mm256_and_pd(sgn, _mm256_set1_pd(-0.0)));
+    }
+    VMATH_TARGET_AVX2 static V select_neg(V x, V a, V b){ return _mm256_blendv_pd(b, a, x); }
+    VMATH_TARGET_AVX2 static V fix_nan(V r, V x){
+        return _mm256_blendv_pd(r, x, _mm256_cmp_pd(x, x, _CMP_UNORD_Q));
+    }
+    VMATH_TARGET_AVX2 static V pow2i(V n){
+        __m256i bits = _mm256_castpd_si256(_mm256_add_pd(n, _mm256_set1_pd(VmConst<T>::MAGIC)));
+        bits = _mm256_slli_epi64(_mm256_add_epi64(bits, _mm256_set1_epi64x(VmConst<T>::BIAS)), VmConst<T>::MANT_BITS);
+        return _mm256_castsi256_pd(bits);
+    }
+    VMATH_TARGET_AVX2 static unsigned ge0_bits(V x){
+        return _mm256_movemask_pd(_mm256_cmp_pd(x, _mm256_setzero_pd(), _CMP_GE_OQ));
+    }
+    VMATH_TARGET_AVX2 static V keep_bits(unsigned bits, V v){
+        __m256i lanes = _mm256_setr_epi64x(1, 2, 4, 8);
+        __m256i keep = _mm256_cmpeq_epi64(_mm256_and_si256(_mm256_set1_epi64x(bits), lanes), lanes);
+        return _mm256_and_pd(_mm256_castsi256_pd(keep), v);
+    }
+};
+
+struct VmAvx2Float{
+    typedef float T; typedef __m256 V; static const int L = 8;
+    VMATH_TARGET_AVX2 static V load(const T* p){ return _mm256_loadu_ps(p); }
+    VMATH_TARGET_AVX2 static void store(T* p, V v){ _mm256_storeu_ps(p, v); }
+    VMATH_TARGET_AVX2 static V set1(T a){ return _mm256_set1_ps(a); }
+    VMATH_TARGET_AVX2 static V add(V a, V b){ return _mm256_add_ps(a, b); }
+    VMATH_TARGET_AVX2 static V sub(V a, V b){ return _mm256_sub_ps(a, b); }
+    VMATH_TARGET_AVX2 static V mul(V a, V b){ return _mm256_mul_ps(a, b); }
+    VMATH_TARGET_AVX2 static V div(V a, V b){ return _mm256_div_ps(a, b); }
+    VMATH_TARGET_AVX2 static V fma(V a, V b, V c){ return _mm256_fmadd_ps(a, b, c); }
+    VMATH_TARGET_AVX2 static V sqrt(V a){ return _mm256_sqrt_ps(a); }
+    VMATH_TARGET_AVX2 static V min(V a, V b){ return _mm256_min_ps(a, b); }
+    VMATH_TARGET_AVX2 static V max(V a, V b){ return _mm256_max_ps(a, b); }
+    VMATH_TARGET_AVX2 static V abs(V a){ return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+    VMATH_TARGET_AVX2 static V copysign(V mag, V sgn){
+        return _mm256_or_ps(mag, _mm256_and_ps(sgn, _mm256_set1_ps(-0.0f)));
+    }
+    VMATH_TARGET_AVX2 static V select_neg(V x, V a, V b){ return _mm256_blendv_ps(b, a, x); }
+    VMATH_TARGET_AVX2 static V fix_nan(V r, V x){
+        return _mm256_blendv_ps(r, x, _mm256_cmp_ps(x, x, _CMP_UNORD_Q));
+    }
+    VMATH_TARGET_AVX2 static V pow2i(V n){
+        __m256i bits = _mm256_castps_si256(_mm256_add_ps(n, _mm256_set1_ps(VmConst<T>::MAGIC)));
+        bits = _mm256_slli_epi32(_mm256_add_epi32(bits, _mm256_set1_epi32(VmConst<T>::BIAS)), VmConst<T>::MANT_BITS);
+        return _mm256_castsi256_ps(bits);
+    }
+    VMATH_TARGET_AVX2 static unsigned ge0_bits(V x){
+        return _mm256_movemask_ps(_mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_GE_OQ));
+    }
+    VMATH_TARGET_AVX2 static V keep_bits(unsigned bits, V v){
+        __m256i lanes = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+        __m256i keep = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(bits), lanes), lanes);
+        return _mm256_and_ps(_mm256_castsi256_ps(keep), v);
+    }
+};
+
+struct VmAvx512Double{
+    typedef double T; typedef __m512d V; static const int L = 8;
+    VMATH_TARGET_AVX512 static V load(const T* p){ return _mm512_loadu_pd(p); }
+    VMATH_TARGET_AVX512 static void store(T* p, V v){ _mm512_storeu_pd(p, v); }
+    VMATH_TARGET_AVX512 static V set1(T a){ return _mm512_set1_pd(a); }
+    VMATH_TARGET_AVX512 static V add(V a, V b){ return _mm512_add_pd(a, b); }
+    VMATH_TARGET_AVX512 static V sub(V a, V b){ return _mm512_sub_pd(a, b); }
+    VMATH_TARGET_AVX512 static V mul(V a, V b){ return _mm512_mul_pd(a, b); }
+    VMATH_TARGET_AVX512 static V div(V a, V b){ return _mm512_div_pd(a, b); }
+    VMATH_TARGET_AVX512 static V fma(V a, V b, V c){ return _mm512_fmadd_pd(a, b, c); }
+    VMATH_TARGET_AVX512 static V sqrt(V a){ return _mm512_sqrt_pd(a); }
+    VMATH_TARGET_AVX512 static V min(V a, V b){ return _mm512_min_pd(a, b); }
+    VMATH_TARGET_AVX512 static V max(V a, V b){ return _mm512_max_pd(a, b); }
+    VMATH_TARGET_AVX512 static V abs(V a){ return _mm512_abs_pd(a); }
+    VMATH_TARGET_AVX512 static V copysign(V mag, V sgn){
+        __m512i sign = _mm512_and_si512(_mm512_castpd_si512(sgn), _mm512_set1_epi64(INT64_MIN));
+        return _mm512_castsi512_pd(_mm512_or_si512(_mm512_castpd_si512(mag), sign));
+    }
+    VMATH_TARGET_AVX512 static V select_neg(V x, V a, V b){
+        __mmask8 neg = _mm512_cmplt_epi64_mask(_mm512_castpd_si512(x), _mm512_setzero_si512());
+        return _mm512_mask_blend_pd(neg, b, a);
+    }
+    VMATH_TARGET_AVX512 static V fix_nan(V r, V x){
+        return _mm512_mask_blend_pd(_mm512_cmp_pd_mask(x, x, _CMP_UNORD_Q), r, x);
+    }
+    VMATH_TARGET_AVX512 static V pow2i(V n){
+        __m512i bits = _mm512_castpd_si512(_mm512_add_pd(n, _mm512_set1_pd(VmConst<T>::MAGIC)));
+        bits = _mm512_slli_epi64(_mm512_add_epi64(bits, _mm512_set1_epi64(VmConst<T>::BIAS)), VmConst<T>::MANT_BITS);
+        return _mm512_castsi512_pd(bits);
+    }
+    VMATH_TARGET_AVX512 static unsigned ge0_bits(V x){
+        return _mm512_cmp_pd_mask(x, _mm512_setzero_pd(), _CMP_GE_OQ);
+    }
+    VMATH_TARGET_AVX512 static V keep_bits(unsigned bits, V v){ return _mm512_maskz_mov_pd((__mmask8)bits, v); }
+};
+
+struct VmAvx512Float{
+    typedef float T; typedef __m512 V; static const int L = 16;
+    VMATH_TARGET_AVX512 static V load(const T* p){ return _mm512_loadu_ps(p); }
+    VMATH_TARGET_AVX512 static void store(T* p, V v){ _mm512_storeu_ps(p, v); }
+    VMATH_TARGET_AVX512 static V set1(T a){ return _mm512_set1_ps(a); }
+    VMATH_TARGET_AVX512 static V add(V a, V b){ return _mm512_add_ps(a, b); }
+    VMATH_TARGET_AVX512 static V sub(V a, V b){ return _mm512_sub_ps(a, b); }
+    VMATH_TARGET_AVX512 static V mul(V a, V b){ return _mm512_mul_ps(a, b); }
+    VMATH_TARGET_AVX512 static V div(V a, V b){ return _mm512_div_ps(a, b); }
+    VMATH_TARGET_AVX512 static V fma(V a, V b, V c){ return _mm512_fmadd_ps(a, b, c); }
+    VMATH_TARGET_AVX512 static V sqrt(V a){ return _mm512_sqrt_ps(a); }
+    VMATH_TARGET_AVX512 static V min(V a, V b){ return _mm512_min_ps(a, b); }
+    VMATH_TARGET_AVX512 static V max(V a, V b){ return _mm512_max_ps(a, b); }
+    VMATH_TARGET_AVX512 static V abs(V a){ return _mm512_abs_ps(a); }
+    VMATH_TARGET_AVX512 static V copysign(V mag, V sgn){
+        __m512i sign = _mm512_and_si512(_mm512_castps_si512(sgn), _mm512_set1_epi32(INT32_MIN));
+        return _mm512_castsi512_ps(_mm512_or_si512(_mm512_castps_si512(mag), sign));
+    }
+    VMATH_TARGET_AVX512 static V select_neg(V x, V a, V b){
+        __mmask16 neg = _mm512_cmplt_epi32_mask(_mm512_castps_si512(x), _mm512_setzero_si512());
+        return _mm512_mask_blend_ps(neg, b, a);
+    }
+    VMATH_TARGET_AVX512 static V fix_nan(V r, V x){
+        return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, x, _CMP_UNORD_Q), r, x);
+    }
+    VMATH_TARGET_AVX512 static V pow2i(V n){
+        __m512i bits = _mm512_castps_si512(_mm512_add_ps(n, _mm512_set1_ps(VmConst<T>::MAGIC)));
+        bits = _mm512_slli_epi32(_mm512_add_epi32(bits, _mm512_set1_epi32(VmConst<T>::BIAS)), VmConst<T>::MANT_BITS);
+        return _mm512_castsi512_ps(bits);
+    }
+    VMATH_TARGET_AVX512 static unsigned ge0_bits(V x){
+        return _mm512_cmp_ps_mask(x, _mm512_setzero_ps(), _CMP_GE_OQ);
+    }
+    VMATH_TARGET_AVX512 static V keep_bits(unsigned bits, V v){ return _mm512_maskz_mov_ps((__mmask16)bits, v); }
+};
+
+//////////////////////////////////////////////////////////////////////
+// The functions, written once and laid out per target (like gemm's
+// micro-kernels) so that the operations of S inline into them
+// (prefix_relu_forward, prefix_relu_backward: see relu_forward; prefix_axpy,
+// prefix_adam, prefix_adagrad: see vaxpy, adam_update, adagrad_update):
+//  + prefix_expm1_q: q(r) with expm1(r) = r*q(r), i.e., exp(r) = 1 + r*q(r)
+//  + prefix_exp_v, prefix_tanh_v, prefix_sigmoid_v: one vector
+//  + prefix_apply: Y[0..n) = F(X[0..n)); the tail goes through a padded
+//      vector, so every value takes the same path
+//////////////////////////////////////////////////////////////////////
+#define VMATH_DEFINE_KERNELS(prefix, TARGET)                                   \
+template<typename S, int DEG>                                                  \
+TARGET static inline typename S::V prefix##_expm1_q(typename S::V r){          \
+    typedef typename S::T T;                                                   \
+    typename S::V q = S::set1(T(INV_FACT[DEG]));                               \
+    for(int k=DEG-1; k >= 1; k--) q = S::fma(q, r, S::set1(T(INV_FACT[k])));   \
+    return q;                                                                  \
+}                                                                              \
+template<typename S, int DEG>                                                  \
+TARGET static inline typename S::V prefix##_exp_v(typename S::V x){            \
+    typedef typename S::T T; typedef VmConst<T> C;                             \
+    typename S::V magic = S::set1(C::MAGIC);                                   \
+    typename S::V y = S::min(S::max(x, S::set1(C::EXP_LO)), S::set1(C::EXP_HI)); \
+    typename S::V n = S::sub(S::fma(y, S::set1(C::LOG2E), magic), magic);      \
+    typename S::V r = S::fma(n, S::set1(-C::LN2_HI), y);                       \
+    r = S::fma(n, S::set1(-C::LN2_LO), r);                                     \
+    typename S::V e = S::fma(prefix##_expm1_q<S, DEG>(r), r, S::set1(T(1)));   \
+    /* 2^n as 2^h * 2^(n-h): each factor stays a normal number */             \
+    typename S::V h = S::sub(S::fma(n, S::set1(T(0.5)), magic), magic);        \
+    e = S::mul(S::mul(e, S::pow2i(h)), S::pow2i(S::sub(n, h)));                \
+    return S::fix_nan(e, x);                                                   \
+}                                                                              \
+template<typename S, int DEG>                                                  \
+TARGET static inline typename S::V prefix##_tanh_v(typename S::V x){           \
+    typedef typename S::T T; typedef VmConst<T> C;                             \
+    typename S::V magic = S::set1(C::MAGIC), one = S::set1(T(1));              \
+    typename S::V a = S::min(S::abs(x), S::set1(C::TANH_HI));                  \
+    typename S::V y = S::add(a, a);                                            \
+    typename S::V n = S::sub(S::fma(y, S::set1(C::LOG2E), magic), magic);      \
+    typename S::V r = S::fma(n, S::set1(-C::LN2_HI), y);                       \
+    r = S::fma(n, S::set1(-C::LN2_LO), r);                                     \
+    typename S::V s = S::pow2i(n);                                             \
+    /* u = expm1(y) = 2^n*expm1(r) + (2^n - 1) */                             \
+    typename S::V u = S::fma(s, S::mul(prefix##_expm1_q<S, DEG>(r), r), S::sub(s, one)); \
+    typename S::V t = S::div(u, S::add(u, S::set1(T(2))));                     \
+    return S::fix_nan(S::copysign(t, x), x);                                   \
+}                                                                              \
+template<typename S, int DEG>                                                  \
+TARGET static inline typename S::V prefix##_sigmoid_v(typename S::V x){        \
+    typedef typename S::T T;                                                   \
+    typename S::V e = prefix##_exp_v<S, DEG>(S::sub(S::set1(T(0)), S::abs(x))); \
+    typename S::V d = S::add(S::set1(T(1)), e);                                \
+    typename S::V y = S::select_neg(x, S::div(e, d), S::div(S::set1(T(1)), d)); \
+    return S::fix_nan(y, x);                                                   \
+}                                                                              \
+template<typename S, int FUNC, int DEG>                                        \
+TARGET static inline typename S::V prefix##_eval(typename S::V x){             \
+    if(FUNC == VM_EXP) return prefix##_exp_v<S, DEG>(x);                       \
+    if(FUNC == VM_TANH) return prefix##_tanh_v<S, DEG>(x);                     \
+    return prefix##_sigmoid_v<S, DEG>(x);                                      \
+}                                                                              \
+template<typename S, int FUNC, int DEG>                                        \
+TARGET static void prefix##_apply(const typename S::T* X, typename S::T* Y, long n){ \
+    typedef typename S::T T;                                                   \
+    long i = 0;                                                                \
+    for(; i + S::L <= n; i += S::L) S::store(Y + i, prefix##_eval<S, FUNC, DEG>(S::load(X + i))); \
+    if(i < n){                                                                 \
+        T buffer[S::L] = {};                                                   \
+        std::copy(X + i, X + n, buffer);                                       \
+        S::store(buffer, prefix##_eval<S, FUNC, DEG>(S::load(buffer)));        \
+        std::copy(buffer, buffer + (n - i), Y + i);                            \
+    }                                                                          \
+}                                                                              \
+template<typename S>                                                           \
+TARGET static void prefix##_relu_forward(const typename S::T* X, typename S::T* Y, uint64_t* mask, long n){ \
+    typedef typename S::T T;                                                   \
+    long nwords = n/64;                                                        \
+    for(long w=0; w < nwords; w++){                                            \
+        uint64_t word = 0;                                                     \
+        for(int j=0; j < 64; j += S::L){                                       \
+            typename S::V x = S::load(X + w*64 + j);                           \
+            unsigned bits = S::ge0_bits(x);                                    \
+            S::store(Y + w*64 + j, S::keep_bits(bits, x));                     \
+            word |= uint64_t(bits) << j;                                       \
+        }                                                                      \
+        mask[w] = word;                                                        \
+    }                                                                          \
+    if(nwords*64 < n){                                                         \
+        uint64_t word = 0;                                                     \
+        for(long i=nwords*64; i < n; i++){                                     \
+            bool keep = X[i] >= 0;                                             \
+            Y[i] = keep ? X[i] : T(0);                                         \
+            word |= uint64_t(keep) << (i - nwords*64);                         \
+        }                                                                      \
+        mask[nwords] = word;                                                   \
+    }                                                                          \
+}                                                                              \
+template<typename S>                                                           \
+TARGET static void prefix##_relu_backward(const uint64_t* mask, const typename S::T* DY, typename S::T* DX, long n){ \
+    typedef typename S::T T;                                                   \
+    const unsigned lane_bits = (S::L == 32) ? ~0u : ((1u << S::L) - 1);        \
+    long nwords = n/64;                                                        \
+    for(long w=0; w < nwords; w++){                                            \
+        uint64_t word = mask[w];                                               \
+        for(int j=0; j < 64; j += S::L){                                       \
+            unsigned bits = unsigned(word >> j) & lane_bits;                   \
+            S::store(DX + w*64 + j, S::keep_bits(bits, S::load(DY + w*64 + j))); \
+        }                                                                      \
+    }                                                                          \
+    for(long i=nwords*64; i < n; i++){                                         \
+        DX[i] = ((mask[nwords] >> (i - nwords*64)) & 1) ? DY[i] : T(0);        \
+    }                                                                          \
+}                                                                              \
+template<typename S>                                                           \
+TARGET static void prefix##_axpy(typename S::T alpha, const typename S::T* X, typename S::T* Y, long n){ \
+    typename S::V a = S::set1(alpha);                                          \
+    long i = 0;                                                                \
+    for(; i + S::L <= n; i += S::L) S::store(Y + i, S::fma(a, S::load(X + i), S::load(Y + i))); \
+    for(; i < n; i++) Y[i] += alpha*X[i];                                      \
+}                                                                              \
+template<typename S>                                                           \
+TARGET static void prefix##_adam(typename S::T* P, const typename S::T* G, typename S::T* M, typename S::T* V, \
+        long n, typename S::T beta1, typename S::T beta2, typename S::T lr_t, typename S::T eps){ \
+    typedef typename S::T T;                                                   \
+    typename S::V b1 = S::set1(beta1), c1 = S::set1(1 - beta1);                \
+    typename S::V b2 = S::set1(beta2), c2 = S::set1(1 - beta2);                \
+    typename S::V neg_lr = S::set1(-lr_t), e = S::set1(eps);                   \
+    long i = 0;                                                                \
+    for(; i + S::L <= n; i += S::L){                                           \
+        typename S::V g = S::load(G + i);                                      \
+        typename S::V m = S::fma(c1, g, S::mul(b1, S::load(M + i)));           \
+        typename S::V v = S::fma(S::mul(c2, g), g, S::mul(b2, S::load(V + i))); \
+        S::store(M + i, m);                                                    \
+        S::store(V + i, v);                                                    \
+        S::store(P + i, S::fma(neg_lr, S::div(m, S::add(S::sqrt(v), e)), S::load(P + i))); \
+    }                                                                          \
+    for(; i < n; i++){                                                         \
+        T g = G[i];                                                            \
+        M[i] = (1 - beta1)*g + beta1*M[i];                                     \
+        V[i] = (1 - beta2)*g*g + beta2*V[i];                                   \
+        P[i] -= lr_t*M[i]/(std::sqrt(V[i]) + eps);                             \
+    }                                                                          \
+}                                                                              \
+template<typename S>                                                           \
+TARGET static void prefix##_adagrad(typename S::T* P, const typename S::T* G, typename S::T* Sq, \
+        long n, typename S::T decay, typename S::T lr, typename S::T eps){     \
+    typedef typename S::T T;                                                   \
+    typename S::V d = S::set1(decay), c = S::set1(1 - decay);                  \
+    typename S::V neg_lr = S::set1(-lr), e = S::set1(eps);                     \
+    long i = 0;                                                                \
+    for(; i + S::L <= n; i += S::L){                                           \
+        typename S::V g = S::load(G + i);                                      \
+        typename S::V sq = S::fma(S::mul(c, g), g, S::mul(d, S::load(Sq + i))); \
+        S::store(Sq + i, sq);                                                  \
+        S::store(P + i, S::fma(neg_lr, S::div(g, S::add(S::sqrt(sq), e)), S::load(P + i))); \
+    }                                                                          \
+    for(; i < n; i++){                                                         \
+        T g = G[i];                                                            \
+        Sq[i] = (1 - decay)*g*g + decay*Sq[i];                                 \
+        P[i] -= lr*g/(std::sqrt(Sq[i]) + eps);                                 \
+    }                                                                          \
+}
+
+enum VmFunc{ VM_EXP = 0, VM_TANH, VM_SIGMOID, VM_NUM_FUNCS };
+VMATH_DEFINE_KERNELS(vm_avx512, VMATH_TARGET_AVX512)
+VMATH_DEFINE_KERNELS(vm_avx2, VMATH_TARGET_AVX2)
+VMATH_DEFINE_KERNELS(vm_scalar, VMATH_TARGET_NONE)
+
+template<typename T>
+struct VmKernel{
+    const char* name;
+    void (*run[VM_NUM_FUNCS][2])(const T* X, T* Y, long n); //[function][fast]
+    void (*relu_forward)(const T* X, T* Y, uint64_t* mask, long n);
+    void (*relu_backward)(const uint64_t* mask, const T* DY, T* DX, long n);
+    void (*axpy)(T alpha, const T* X, T* Y, long n);
+    void (*adam)(T* P, const T* G, T* M, T* V, long n, T beta1, T beta2, T lr_t, T eps);
+    void (*adagrad)(T* P, const T* G, T* Sq, long n, T decay, T lr, T eps);
+};
+
+#define VMATH_KERNEL(name, prefix, S)                                          \
+    {name, {{prefix##_apply<S, VM_EXP, VmConst<S::T>::EXACT_DEGREE>,            \
+             prefix##_apply<S, VM_EXP, VmConst<S::T>::FAST_DEGREE>},            \
+            {prefix##_apply<S, VM_TANH, VmConst<S::T>::EXACT_DEGREE>,           \
+             prefix##_apply<S, VM_TANH, VmConst<S::T>::FAST_DEGREE>},           \
+            {prefix##_apply<S, VM_SIGMOID, VmConst<S::T>::EXACT_DEGREE>,        \
+             prefix##_apply<S, VM_SIGMOID, VmConst<S::T>::FAST_DEGREE>}},          \
+     prefix##_relu_forward<S>, prefix##_relu_backward<S>, prefix##_axpy<S>, \
+     prefix##_adam<S>, prefix##_adagrad<S>}
+
+//in order of preference, as gemm's micro-kernels
+static const VmKernel<double> DOUBLE_KERNELS[] = {
+    VMATH_KERNEL("avx512", vm_avx512, VmAvx512Double),
+    VMATH_KERNEL("avx2", vm_avx2, VmAvx2Double),
+    VMATH_KERNEL("scalar", vm_scalar, VmScalar<double>)
+};
+static const VmKernel<float> FLOAT_KERNELS[] = {
+    VMATH_KERNEL("avx512", vm_avx512, VmAvx512Float),
+    VMATH_KERNEL("avx2", vm_avx2, VmAvx2Float),
+    VMATH_KERNEL("scalar", vm_scalar, VmScalar<float>)
+};
+static const int NUM_KERNELS = 3;
+
+static bool kernel_supported(int idx){
+    __builtin_cpu_init();
+    if(idx == 0) return __builtin_cpu_supports("avx512f");
+    if(idx == 1) return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    return true;
+}
+
+static atomic<int> g_kernel_idx(-1);
+static atomic<int> g_mode(VMATH_EXACT);
+
+static int kernel_index(){
+    int idx = g_kernel_idx.load();
+    if(idx < 0){
+        idx = 0;
+        while(!kernel_supported(idx)) idx++;
+        g_kernel_idx.store(idx);
+    }
+    return idx;
+}
+static const VmKernel<double>& select_kernel(const double*){ return DOUBLE_KERNELS[kernel_index()]; }
+static const VmKernel<float>& select_kernel(const float*){ return FLOAT_KERNELS[kernel_index()]; }
+
+string vmath_kernel(){
+    return DOUBLE_KERNELS[kernel_index()].name;
+}
+bool vmath_set_kernel(string name){
+    for(int idx=0; idx < NUM_KERNELS; idx++){
+        if(name == DOUBLE_KERNELS[idx].name){
+            if(!kernel_supported(idx)) return false;
+            g_kernel_idx.store(idx);
+            return true;
+        }
+    }
+    return false;
+}
+void vmath_set_mode(VMathMode mode){
+    if(mode != VMATH_DEFAULT) g_mode.store(mode);
+}
+VMathMode vmath_get_mode(){
+    return (VMathMode)g_mode.load();
+}
+
+template<typename T>
+static void vmath_apply(int func, const T* X, T* Y, long n, VMathMode mode){
+    if(n <= 0) return;
+    if(mode == VMATH_DEFAULT) mode = vmath_get_mode();
+    auto run = select_kernel(X).run[func][mode == VMATH_FAST];
+    long nchunks = (n + VMATH_CHUNK - 1)/VMATH_CHUNK;
+    parallel_rows((int)nchunks, n*VMATH_WORK_PER_VALUE, [=](int begin, int end){
+        long first = begin*VMATH_CHUNK;
+        long last = min(n, end*VMATH_CHUNK);
+        run(X + first, Y + first, last - first);
+    });
+}
+
+void vexp(const double* X, double* Y, long n, VMathMode mode){ vmath_apply(VM_EXP, X, Y, n, mode); }
+void vexp(const float* X, float* Y, long n, VMathMode mode){ vmath_apply(VM_EXP, X, Y, n, mode); }
+void vtanh(const double* X, double* Y, long n, VMathMode mode){ vmath_apply(VM_TANH, X, Y, n, mode); }
+void vtanh(const float* X, float* Y, long n, VMathMode mode){ vmath_apply(VM_TANH, X, Y, n, mode); }
+void vsigmoid(const double* X, double* Y, long n, VMathMode mode){ vmath_apply(VM_SIGMOID, X, Y, n, mode); }
+void vsigmoid(const float* X, float* Y, long n, VMathMode mode){ vmath_apply(VM_SIGMOID, X, Y, n, mode); }
+
+//chunks are multiples of 64 values: each mask word belongs to one chunk
+template<typename T>
+static void relu_forward_impl(const T* X, T* Y, uint64_t* mask, long n){
+    if(n <= 0) return;
+    auto run = select_kernel(X).relu_forward;
+    long nchunks = (n + VMATH_CHUNK - 1)/VMATH_CHUNK;
+    parallel_rows((int)nchunks, 2*n, [=](int begin, int end){
+        long first = begin*VMATH_CHUNK;
+        long last = min(n, end*VMATH_CHUNK);
+        run(X + first, Y + first, mask + first/64, last - first);
+    });
+}
+template<typename T>
+static void relu_backward_impl(const uint64_t* mask, const T* DY, T* DX, long n){
+    if(n <= 0) return;
+    auto run = select_kernel(DY).relu_backward;
+    long nchunks = (n + VMATH_CHUNK - 1)/VMATH_CHUNK;
+    parallel_rows((int)nchunks, 2*n, [=](int begin, int end){
+        long first = begin*VMATH_CHUNK;
+        long last = min(n, end*VMATH_CHUNK);
+        run(mask + first/64, DY + first, DX + first, last - first);
+    });
+}
+
+void relu_forward(const double* X, double* Y, uint64_t* mask, long n){ relu_forward_impl(X, Y, mask, n); }
+void relu_forward(const float* X, float* Y, uint64_t* mask, long n){ relu_forward_impl(X, Y, mask, n); }
+void relu_backward(const uint64_t* mask, const double* DY, double* DX, long n){ relu_backward_impl(mask, DY, DX, n); }
+void relu_backward(const uint64_t* mask, const float* DY, float* DX, long n){ relu_backward_impl(mask, DY, DX, n); }
+
+template<typename T>
+static void vaxpy_impl(long n, T alpha, const T* X, T* Y){
+    if(n <= 0) return;
+    auto run = select_kernel(X).axpy;
+    long nchunks = (n + VMATH_CHUNK - 1)/VMATH_CHUNK;
+    parallel_rows((int)nchunks, 3*n, [=](int begin, int end){
+        long first = begin*VMATH_CHUNK;
+        long last = min(n, end*VMATH_CHUNK);
+        run(alpha, X + first, Y + first, last - first);
+    });
+}
+
+void vaxpy(long n, double alpha, const double* X, double* Y){ vaxpy_impl(n, alpha, X, Y); }
+void vaxpy(long n, float alpha, const float* X, float* Y){ vaxpy_impl(n, alpha, X, Y); }
+
+//one pass; per value, sqrt and div cost about as much as an exp (in cache)
+template<typename T>
+static void adam_update_impl(long n, T* P, const T* G, T* M, T* V, T beta1, T beta2, T lr_t, T eps){
+    if(n <= 0) return;
+    auto run = select_kernel(G).adam;
+    long nchunks = (n + VMATH_CHUNK - 1)/VMATH_CHUNK;
+    parallel_rows((int)nchunks, n*VMATH_WORK_PER_VALUE, [=](int begin, int end){
+        long first = begin*VMATH_CHUNK;
+        long last = min(n, end*VMATH_CHUNK);
+        run(P + first, G + first, M + first, V + first, last - first, beta1, beta2, lr_t, eps);
+    });
+}
+template<typename T>
+static void adagrad_update_impl(long n, T* P, const T* G, T* Sq, T decay, T lr, T eps){
+    if(n <= 0) return;
+    auto run = select_kernel(G).adagrad;
+    long nchunks = (n + VMATH_CHUNK - 1)/VMATH_CHUNK;
+    parallel_rows((int)nchunks, n*VMATH_WORK_PER_VALUE, [=](int begin, int end){
+        long first = begin*VMATH_CHUNK;
+        long last = min(n, end*VMATH_CHUNK);
+        run(P + first, G + first, Sq + first, last - first, decay, lr, eps);
+    });
+}
+
+void adam_update(long n, double* P, const double* G, double* M, double* V,
+        double beta1, double beta2, double lr_t, double eps){
+    adam_update_impl(n, P, G, M, V, beta1, beta2, lr_t, eps);
+}
+void adam_update(long n, float* P, const float* G, float* M, float* V,
+        float beta1, float beta2, float lr_t, float eps){
+    adam_update_impl(n, P, G, M, V, beta1, beta2, lr_t, eps);
+}
+void adagrad_update(long n, double* P, const double* G, double* Sq, double decay, double lr, double eps){
+    adagrad_update_impl(n, P, G, Sq, decay, lr, eps);
+}
+void adagrad_update(long n, float* P, const float* G, float* Sq, float decay, float lr, float eps){
+    adagrad_update_impl(n, P, G, Sq, decay, lr, eps);
+}
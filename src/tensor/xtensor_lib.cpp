@@ -28,11 +28,12 @@ xt::xarray<double> outer_stack(xt::xarray<double> X, xt::xarray<double>  Y){
     xt::xarray<double> S = xt::zeros<double>({X.shape()[0], X.shape()[1], Y.shape()[1]});
     int nrows = X.shape()[0];
 
+    int m = X.shape()[1], n = Y.shape()[1];
+    
+    //S[r] = outer(X[r], Y[r]): a GEMM with k=1, written in place
     for(int r=0; r < nrows; r++){
-        xt::xarray<double> x = xt::row(X, r);
-        xt::xarray<double> y = xt::row(Y, r);
-        xt::xarray<double> U = xt::linalg::outer(x, y);
-        xt::view(S, r) = U;
+        gemm(false, false, m, n, 1, 1.0, X.data() + r*m, 1, Y.data() + r*n, n,
+                0.0, S.data() + r*m*n, n);
     }
     return S;
 }
@@ -51,11 +52,60 @@ xt::xarray<double> matmul_on_stack(xt::xarray<double> X, xt::xarray<double>  Y){
     xt::xarray<double> S = xt::zeros<double>({X.shape()[0], X.shape()[1]});
     int nrows = X.shape()[0];
     
+    int m = X.shape()[1], k = X.shape()[2];
+    
+    //S[r] = X[r] (a matrix) * Y[r] (a vector): a GEMM with n=1, written in place
     for(int r=0; r < nrows; r++){
-        xt::xarray<double> M = xt::view(X, r); //a matrix
-        xt::xarray<double> v = xt::view(Y, r); //a vector
-        xt::view(S, r) = xt::linalg::dot(M, v);
+        gemm(false, false, m, 1, k, 1.0, X.data() + r*m*k, k, Y.data() + r*k, 1,
+                0.0, S.data() + r*m, 1);
     }
     return S;
 }
 
+real_view make_view(real_t* data, xt::svector<unsigned long> shape){
+    unsigned long size = 1;
+    for(unsigned long dim: shape) size *= dim;
+    return xt::adapt(static_cast<real_t*>(data), size, xt::no_ownership(), shape);
+}
+
+/* load_real_npy:
+ *  load a .npy file stored either as float32 or float64 and convert it to
+ *  real_t; weights saved by a double build stay loadable by a float build
+ *  and vice versa.
+ */
+real_tensor load_real_npy(string filename){
+    ifstream stream(filename, ios::binary);
+    if(!stream.is_open()){
+        throw runtime_error(filename + ": can not open for reading.");
+    }
+    xt::detail::npy_file file = xt::detail::load_npy_file(stream);
+    if(file.m_typestring == xt::detail::build_typestring<float>()){
+        return xt::cast<real_t>(file.cast<float>());
+    }
+    if(file.m_typestring == xt::detail::build_typestring<double>()){
+        return xt::cast<real_t>(file.cast<double>());
+    }
+    throw runtime_error(filename + ": element type " + file.m_typestring + " is not a floating type.");
+}
+
+void gemm(bool trans_a, bool trans_b, real_t alpha,
+        const real_tensor& A, const real_tensor& B, real_t beta, real_tensor& C){
+    if(A.dimension() != 2 || B.dimension() != 2){
+        throw invalid_argument("gemm: A and B must be 2D; got " +
+                shape2str(A.shape()) + " and " + shape2str(B.shape()));
+    }
+    int m = trans_a ? A.shape()[1] : A.shape()[0];
+    int k = trans_a ? A.shape()[0] : A.shape()[1];
+    int kb = trans_b ? B.shape()[1] : B.shape()[0];
+    int n = trans_b ? B.shape()[0] : B.shape()[1];
+    if(k != kb){
+        throw invalid_argument("gemm: inner dimensions do not match: " +
+                shape2str(A.shape()) + " and " + shape2str(B.shape()));
+    }
+    if(C.dimension() != 2 || int(C.shape()[0]) != m || int(C.shape()[1]) != n){
+        if(beta != 0) throw invalid_argument("gemm: C must be " + to_string(m) + "x" + to_string(n));
+        C.resize({(unsigned long)m, (unsigned long)n});
+    }
+    gemm(trans_a, trans_b, m, n, k, alpha, A.data(), A.shape()[1], B.data(), B.shape()[1],
+            beta, C.data(), n);
+}